@@ -0,0 +1,158 @@
+#pragma once
+
+#include "Utility.h"
+
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// if it is 0, FMOD is not included and the sounds are only recorded by bms::RecordingBackend (ex. headless build)
+#ifndef USE_FMOD
+#define USE_FMOD 1
+#endif
+
+namespace bms {
+	/// <summary>
+	/// An interface of the sound output used by <see cref="bms::PlayThread"/>.
+	/// <see cref="CreateSound"/> can be called by several loading threads at the same time, and the others are called by the play thread.
+	/// </summary>
+	class AudioBackend {
+	public:
+		virtual ~AudioBackend() = default;
+
+		/// <summary> initialize the sound system. return false if it failed </summary>
+		virtual bool Init() = 0;
+		virtual bool IsInitialized() const = 0;
+		/// <summary> load the sound file of <paramref name="filePath"/> as the sound of <paramref name="key"/>. the previous one is replaced </summary>
+		virtual void CreateSound(const std::string& filePath, int key) = 0;
+		/// <summary>
+		/// play the sound of <paramref name="key"/> now. <paramref name="noteTime"/> is the time of the note in the chart
+		/// and <paramref name="playTime"/> is the current time of the play (microseconds from the start)
+		/// </summary>
+		virtual void PlaySingleSound(int key, long long noteTime, long long playTime) = 0;
+		/// <summary> return true if the backend can start a sound at a future time of its own audio clock (<see cref="ScheduleSound"/>) </summary>
+		virtual bool CanSchedule() const {
+			return false;
+		}
+		/// <summary> set the current time of the audio clock as the start of the play. called by the play thread before the first frame </summary>
+		virtual void StartClock() {}
+		/// <summary> the time of the audio clock from <see cref="StartClock"/> (microseconds) </summary>
+		virtual long long GetClockTime() const {
+			return 0;
+		}
+		/// <summary>
+		/// start the sound of <paramref name="key"/> exactly at <paramref name="noteTime"/> of the audio clock, which is later than <paramref name="playTime"/>.
+		/// <paramref name="playTime"/> is the current time of the play. only called if <see cref="CanSchedule"/> is true.
+		/// return the time of the audio clock when the sound starts, which is later than <paramref name="noteTime"/> if the clock already passed it
+		/// </summary>
+		virtual long long ScheduleSound(int key, long long noteTime, long long playTime) {
+			PlaySingleSound(key, noteTime, playTime);
+			return playTime;
+		}
+		/// <summary> called once at the end of each frame of the play thread </summary>
+		virtual void Update() = 0;
+		/// <summary> release all sounds </summary>
+		virtual void ReleaseAllSounds() = 0;
+	};
+
+	/// <summary> a sound trigger recorded by <see cref="bms::RecordingBackend"/>. unit = microsecond </summary>
+	struct TriggerEvent {
+		int mKey;
+		long long mNoteTime;			// the time of the note in the chart
+		long long mPlayTime;			// the time of the play when it is triggered. the note time if it is scheduled
+		long long mRequestTime;			// the time of the play when it is requested. earlier than mPlayTime if it is scheduled
+		long long mWallTime;			// the steady clock from Init when it is triggered
+		bool mbLoaded;					// false if the sound was not created yet
+	};
+
+	/// <summary>
+	/// A software backend that plays nothing and records the timestamped triggers,
+	/// so the player runs without a sound device and the latency of the triggers can be measured.
+	/// if <see cref="bms::PlayThread::PlayOffline"/> is used, the play times are deterministic.
+	/// if <paramref name="bSchedule"/> is true, it acts as a software mixer that starts the scheduled sounds at the exact sample (the audio clock is the steady clock)
+	/// </summary>
+	class RecordingBackend : public AudioBackend {
+	public:
+		RecordingBackend(bool bSchedule = true) : mbInitialized(false), mbSchedule(bSchedule) {}
+		DISALLOW_COPY_AND_ASSIGN(RecordingBackend)
+
+		bool Init() override {
+			std::lock_guard<std::mutex> guard{mMutex};
+			mStart = std::chrono::steady_clock::now();
+			mListEvent.clear();
+			mbInitialized = true;
+			return true;
+		}
+
+		bool IsInitialized() const override {
+			return mbInitialized;
+		}
+
+		void CreateSound(const std::string& filePath, int key) override {
+			std::lock_guard<std::mutex> guard{mMutex};
+			mDicSound[key] = filePath;
+		}
+
+		void PlaySingleSound(int key, long long noteTime, long long playTime) override {
+			auto wallTime = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - mStart);
+			std::lock_guard<std::mutex> guard{mMutex};
+			mListEvent.push_back(TriggerEvent{key, noteTime, playTime, playTime, wallTime.count(), mDicSound.count(key) != 0});
+		}
+
+		bool CanSchedule() const override {
+			return mbSchedule;
+		}
+
+		void StartClock() override {
+			mClockStart = std::chrono::steady_clock::now();
+		}
+
+		long long GetClockTime() const override {
+			return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - mClockStart).count();
+		}
+
+		/// <summary> the mixer starts the sound at the exact sample, and the play time is the audio clock (also in <see cref="bms::PlayThread::PlayOffline"/>) </summary>
+		long long ScheduleSound(int key, long long noteTime, long long playTime) override {
+			auto wallTime = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - mStart);
+			long long startTime = std::max(noteTime, playTime);
+			std::lock_guard<std::mutex> guard{mMutex};
+			mListEvent.push_back(TriggerEvent{key, noteTime, startTime, playTime, wallTime.count(), mDicSound.count(key) != 0});
+			return startTime;
+		}
+
+		void Update() override {}
+
+		void ReleaseAllSounds() override {
+			std::lock_guard<std::mutex> guard{mMutex};
+			mDicSound.clear();
+		}
+
+		/// <summary> return the recorded triggers in the order of the play and clear them </summary>
+		std::vector<TriggerEvent> TakeEvents() {
+			std::lock_guard<std::mutex> guard{mMutex};
+			std::vector<TriggerEvent> events;
+			events.swap(mListEvent);
+			return events;
+		}
+
+		/// <summary> the file path of the sound of <paramref name="key"/>. empty if it is not created </summary>
+		std::string GetSoundPath(int key) {
+			std::lock_guard<std::mutex> guard{mMutex};
+			auto iter = mDicSound.find(key);
+			return iter == mDicSound.end() ? std::string() : iter->second;
+		}
+
+	private:
+		bool mbInitialized;
+		bool mbSchedule;
+		std::chrono::steady_clock::time_point mStart;
+		std::chrono::steady_clock::time_point mClockStart;		// the start of the play by StartClock
+
+		std::mutex mMutex;
+		std::unordered_map<int, std::string, Utility::Bypass> mDicSound;
+		std::vector<TriggerEvent> mListEvent;
+	};
+}
\ No newline at end of file
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "BMSChartCache.h"
 #include "BMSDecryptor.h"
 #include "BMSPlayThread.h"
 #include "BMSTree.h"
@@ -13,10 +14,13 @@ namespace bms {
 	public:
 		// ----- constructor, operator overloading -----
 
-		BMSAdapter() : mDecryptor(mCurData), mThread(mCurData), mPathTree(mDecryptor) {
+		BMSAdapter() : mDecryptor(mCurData), mThread(mCurData), mPathTree() {
 			Load();
 		};
 		~BMSAdapter() {
+			// the streaming build stores the compiled chart with the strings of the tree, which Save detaches
+			mThread.ForceEnd();
+			WaitForBuild();
 			Save();
 		};
 		DISALLOW_COPY_AND_ASSIGN(BMSAdapter)
@@ -46,22 +50,50 @@ namespace bms {
 				LOG("Invalid BMSInfoData format");
 				return;
 			}
+			auto request = std::chrono::steady_clock::now();
 			clock_t s;
 			if (info != mCurData.mInfo) {
 				s = clock();
+				// the previous data is read by the play thread and the streaming build
+				mThread.ForceEnd();
+				WaitForBuild();
 				mCurData.Reset(info, true);
-				if (!mDecryptor.Build(true)) {
-					LOG("parse bms failed : " + Utility::WideToUTF8(info->mFilePath));
-					return;
+				// the #RANDOM values of the preview are decided by the path, so the same branches are played and cached
+				uint64_t randomSeed = HashFNV1a(reinterpret_cast<const char*>(info->mFilePath.data()), info->mFilePath.size() * sizeof(wchar_t));
+				mDecryptor.SetRandomSeed(randomSeed);
+				// the chart played before is loaded from the compiled chart without parsing
+				if (mChartCache.Load(mCurData, randomSeed)) {
+					mCurData.mReady = true;
+					LOG("compiled chart load time(ms) : " << clock() - s);
+				} else {
+					if (!mDecryptor.BuildTiming(true)) {
+						LOG("parse bms failed : " + Utility::WideToUTF8(std::wstring(info->mFilePath)));
+						return;
+					}
+					// the notes before ASYNC_READY_TIME are made before playing, and the rest are made while playing
+					bool bRemain = true;
+					while (bRemain && mDecryptor.GetBuiltTime() < ASYNC_READY_TIME) {
+						bRemain = mDecryptor.BuildNextMeasure();
+					}
+					if (bRemain) {
+						mBuildFuture = std::async(std::launch::async, [this, randomSeed]() {
+							while (mDecryptor.BuildNextMeasure());
+							mCurData.mReady = true;
+							mChartCache.Store(mCurData, randomSeed);
+						});
+					} else {
+						mCurData.mReady = true;
+						mChartCache.Store(mCurData, randomSeed);
+					}
+					LOG("bms data build time before play(ms) : " << clock() - s);
 				}
-				LOG("bms data build time(ms) : " << clock() - s);
-				mCurData.mReady = true;
 			}
 
-			LOG("Play data : " + Utility::WideToUTF8(mCurData.mInfo->mFilePath));
+			LOG("Play data : " + Utility::WideToUTF8(std::wstring(mCurData.mInfo->mFilePath)));
 			s = clock();
-			mThread.Play();
-			LOG("mThread.Play time(ms) : " << clock() - s);
+			mThread.Play(request);
+			LOG("mThread.Play time(ms) : " << clock() - s << ", time to play start(ms) : " 
+				<< std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - request).count());
 		}
 
 		inline bool IsPlayingMusic() {
@@ -72,6 +104,23 @@ namespace bms {
 			mThread.ForceEnd();
 		}
 
+		/// <summary> the trigger timing, dropped notes and frame jitter of the current or the last preview </summary>
+		inline const PlaybackStats& GetPlaybackStats() const {
+			return mThread.GetStats();
+		}
+
+		/// <summary> write the records of <see cref="GetPlaybackStats"/> to the csv file of <paramref name="path"/> at the end of each preview. empty means no file </summary>
+		inline void SetPlaybackStatsCsvPath(const std::wstring& path) {
+			mThread.SetStatsCsvPath(path);
+		}
+
+		/// <summary> wait until the streaming build of the current data is finished </summary>
+		inline void WaitForBuild() {
+			if (mBuildFuture.valid()) {
+				mBuildFuture.get();
+			}
+		}
+
 		// ----- get, set function -----
 
 		/// <summary> return all list of bms folder name </summary>
@@ -79,11 +128,17 @@ namespace bms {
 			return mPathTree.GetFolderList();
 		}
 
-		/// <summary> return proper list of bms music folder </summary>
-		const std::vector<BMSNode>& GetMusicList(uint16_t index) {
+		/// <summary> return proper list of bms music folder in the current sort order </summary>
+		MusicListView GetMusicList(uint16_t index) {
 			return mPathTree.GetMusicList(index);
 		}
 
+		/// <summary> return the charts that match <paramref name="utf8Query"/> and <paramref name="filter"/> in all loaded folders </summary>
+		std::vector<BMSInfoData*> Search(std::string_view utf8Query, const SearchFilter& filter = SearchFilter(),
+										 SearchMode mode = SearchMode::SUBSTRING, size_t maxCount = 0) const {
+			return mPathTree.Search(utf8Query, filter, mode, maxCount);
+		}
+
 	private:
 		///<summary> The class that stores all data of a single <see cref="bms::BMSInfoData"/> object </summary>
 		BMSData mCurData;
@@ -94,6 +149,10 @@ namespace bms {
 
 		///<summary> The class to store and manage bms list and folder path </summary>
 		BMSTree mPathTree;
+		///<summary> The class that keeps the built data of the charts played before </summary>
+		ChartCache mChartCache;
+		///<summary> The streaming build of the rest measures. it is declared last, so it is finished before the data is destroyed </summary>
+		std::future<void> mBuildFuture;
 
 		/// <summary> call <see cref="bms::BMSTree::Load()"/> function </summary>
 		void Load() {
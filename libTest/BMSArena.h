@@ -0,0 +1,72 @@
+#pragma once
+
+#include "BMSData.h"
+
+#include <memory>
+
+namespace bms {
+	/// <summary>
+	/// A slab allocator of <see cref="bms::BMSInfoData"/>. Objects are placed in blocks of <see cref="BLOCK_SIZE"/> objects,
+	/// and destroyed objects are reused by the next <see cref="Create"/>.
+	/// <see cref="bms::BMSInfoData"/> doesn't own any memory, so all objects are released by freeing the blocks.
+	/// It is not thread-safe. objects are created only in the thread that enumerates the folders.
+	/// </summary>
+	class InfoArena {
+		static_assert(std::is_trivially_destructible<BMSInfoData>::value, "BMSInfoData must be released without destructor");
+		using Slot = std::aligned_storage_t<sizeof(BMSInfoData), alignof(BMSInfoData)>;
+
+	public:
+		static constexpr size_t BLOCK_SIZE = 1024;
+
+		InfoArena() : mUsed(BLOCK_SIZE), mCount(0) {}
+		DISALLOW_COPY_AND_ASSIGN(InfoArena)
+		InfoArena(InfoArena&&) noexcept = default;
+		InfoArena& operator=(InfoArena&&) noexcept = default;
+
+		/// <summary> return a new default-constructed object </summary>
+		BMSInfoData* Create() {
+			void* slot;
+			if (!mFreeList.empty()) {
+				slot = mFreeList.back();
+				mFreeList.pop_back();
+			} else {
+				if (mUsed == BLOCK_SIZE) {
+					mBlocks.emplace_back(std::make_unique<Slot[]>(BLOCK_SIZE));
+					mUsed = 0;
+				}
+				slot = &mBlocks.back()[mUsed++];
+			}
+			++mCount;
+			return new (slot) BMSInfoData();
+		}
+
+		/// <summary> return <paramref name="data"/> to the arena. the slot is reused by the next <see cref="Create"/> </summary>
+		inline void Destroy(BMSInfoData* data) {
+			mFreeList.emplace_back(data);
+			--mCount;
+		}
+
+		/// <summary> release all objects at once </summary>
+		void Clear() {
+			mBlocks.clear();
+			mFreeList.clear();
+			mUsed = BLOCK_SIZE;
+			mCount = 0;
+		}
+
+		/// <summary> return the number of living objects </summary>
+		inline size_t GetCount() const {
+			return mCount;
+		}
+		/// <summary> return the allocated bytes of all blocks </summary>
+		inline size_t GetBytes() const {
+			return mBlocks.size() * BLOCK_SIZE * sizeof(Slot);
+		}
+
+	private:
+		std::vector<std::unique_ptr<Slot[]>> mBlocks;
+		std::vector<void*> mFreeList;
+		size_t mUsed;					// the number of used slots in the last block
+		size_t mCount;
+	};
+}
\ No newline at end of file
@@ -0,0 +1,1186 @@
+#pragma once
+
+#include "BMSChartCache.h"
+#include "BMSDecryptor.h"
+#include "BMSPlayThread.h"
+#include "BMSTree.h"
+#include "SoftwareMixer.h"
+
+#include <functional>
+#include <iomanip>
+#include <set>
+#ifdef _WIN32
+#include <psapi.h>			// GetProcessMemoryInfo
+#endif
+
+namespace bms {
+	/// <summary>
+	/// Functions that measure the time of the library functions using the bms files in <see cref="ROOT_PATH"/>.
+	/// It is called instead of the main loop when RUN_BENCHMARK is defined in main.cpp
+	/// </summary>
+	namespace benchmark {
+		/// <summary> return the working set (resident memory) of the process in bytes. 0 if it is not available </summary>
+		inline long long GetWorkingSet() {
+#ifdef _WIN32
+			PROCESS_MEMORY_COUNTERS counters;
+			if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+				return static_cast<long long>(counters.WorkingSetSize);
+			}
+			return 0;
+#else
+			std::ifstream is("/proc/self/statm");
+			long long pages, resident;
+			if (is >> pages >> resident) {
+				return resident * sysconf(_SC_PAGESIZE);
+			}
+			return 0;
+#endif
+		}
+
+		/// <summary>
+		/// the result of a benchmark that compares the previous implementation with the new one. return true if <paramref name="mismatch"/> is 0.
+		/// the benchmarks with a comparison return it, and <see cref="RunAll"/> fails if any of them fails
+		/// </summary>
+		inline bool Check(const char* name, size_t mismatch) {
+			if (mismatch != 0) {
+				LOG("CHECK FAILED : " << name << ", mismatch count : " << mismatch)
+			}
+			return mismatch == 0;
+		}
+
+		/// <summary> collect all bms file paths in <paramref name="path"/> folder up to <paramref name="depth"/> subdirectory </summary>
+		inline void CollectBmsFiles(const std::wstring& path, std::vector<std::wstring>& result, int depth = 2) {
+			DirLoop loop(path);
+			wchar_t* name;
+			while (name = loop.Read()) {
+				std::wstring subPath = path + L'/' + name;
+				if (loop.IsDirectory()) {
+					if (depth > 0) {
+						CollectBmsFiles(subPath, result, depth - 1);
+					}
+					continue;
+				}
+				size_t len = subPath.size();
+				if (len > 4 && subPath.compare(len - 4, 3, L".bm") == 0) {
+					result.emplace_back(std::move(subPath));
+				}
+			}
+		}
+
+		/// <summary> compare the line reading time of the stream mode and the memory mapped mode of <see cref="BMSifstream"/> </summary>
+		inline void ReadLines(const std::vector<std::wstring>& files) {
+			size_t streamBytes = 0, mappedBytes = 0;
+			clock_t s = clock();
+			std::string line;
+			for (const auto& path : files) {
+				BMSifstream in(path.c_str());
+				while (in.GetLine(line, true)) {
+					streamBytes += line.size();
+				}
+			}
+			LOG("stream reader time(ms) : " << clock() - s << ", bytes : " << streamBytes)
+
+			s = clock();
+			std::string_view view;
+			for (const auto& path : files) {
+				BMSifstream in(path.c_str(), true);
+				while (in.GetLine(view, true)) {
+					mappedBytes += view.size();
+				}
+			}
+			LOG("mapped reader time(ms) : " << clock() - s << ", bytes : " << mappedBytes)
+		}
+
+		/// <summary> compare the full line parsing and the fast body scan of <see cref="BMSDecryptor::BuildInfoData"/> </summary>
+		inline void BuildInfoData(const std::vector<std::wstring>& files) {
+			BMSData data;
+			BMSDecryptor decryptor(data);
+			Utility::StringPool stringPool;
+			for (int mode = 0; mode < 2; ++mode) {
+				clock_t s = clock();
+				for (const auto& path : files) {
+					BMSInfoData info;
+					decryptor.BuildInfoData(&info, path.c_str(), stringPool, mode == 1);
+				}
+				LOG((mode == 1 ? "fast scan" : "line parse") << " BuildInfoData time(ms) : " << clock() - s)
+			}
+		}
+
+		/// <summary>
+		/// compare the fast body scan with the line parsing of <see cref="BMSDecryptor::BuildInfoData"/> on small charts of the edge cases
+		/// (the last line without a newline, the key type decided by the order of the channels)
+		/// </summary>
+		inline bool ScanEdgeCases() {
+			const std::pair<const wchar_t*, const char*> cases[] = {
+				{L"benchmark_no_newline.bms", "#TITLE a\r\n#PLAYER 1\r\n#WAV01 a.wav\r\n#00119:01"},
+				{L"benchmark_no_newline_double.bms", "#TITLE a\r\n#00119:01\r\n#00229:01"},
+				{L"benchmark_channel_order.bms", "#TITLE a\n#00211:01\n#00219:01\n#00121:01\n#00118:01\n"}
+			};
+			BMSData data;
+			BMSDecryptor decryptor(data);
+			Utility::StringPool stringPool;
+			int mismatch = 0;
+			for (const auto& c : cases) {
+				{
+					std::ofstream os(c.first, std::ios::binary);
+					os << c.second;
+				}
+				BMSInfoData line = {}, fast = {};
+				decryptor.BuildInfoData(&line, c.first, stringPool, false);
+				decryptor.BuildInfoData(&fast, c.first, stringPool, true);
+				std::remove(Utility::WideToUTF8(c.first).c_str());
+				mismatch += line.mKeyType != fast.mKeyType || line.mMeasureCount != fast.mMeasureCount || line.mHasRandom != fast.mHasRandom;
+			}
+			LOG("fast scan edge case mismatch count : " << mismatch << " / " << sizeof(cases) / sizeof(cases[0]))
+			return Check("fast scan edge cases", mismatch);
+		}
+
+		/// <summary> measure the scaling of <see cref="ScanPool"/> at 1, 2, 4, 8 and 16 threads </summary>
+		inline void ParallelScan(const std::vector<std::wstring>& files) {
+			std::vector<BMSInfoData> infos(files.size());
+			Utility::StringPool stringPool;
+			for (unsigned threadCount = 1; threadCount <= 16; threadCount *= 2) {
+				// wall clock time. clock() is the process time in some platforms
+				auto s = std::chrono::steady_clock::now();
+				{
+					ScanPool pool(stringPool, threadCount);
+					for (size_t i = 0; i < files.size(); ++i) {
+						pool.Push(&infos[i], files[i]);
+					}
+					pool.Wait();
+				}
+				auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - s);
+				LOG("ScanPool thread : " << threadCount << ", time(ms) : " << elapsed.count())
+			}
+		}
+
+		/// <summary>
+		/// compare <see cref="BMSDecryptor::Build"/> and loading the compiled chart of <see cref="ChartCache"/> with up to <paramref name="maxCount"/> files.
+		/// the loaded note times are checked with the built ones
+		/// </summary>
+		inline bool CompiledChart(const std::vector<std::wstring>& files, size_t maxCount) {
+			std::vector<BMSInfoData> infos(std::min(files.size(), maxCount));
+			std::vector<std::string> blobs(infos.size());
+			Utility::StringPool stringPool;
+			BMSData data;
+			BMSDecryptor decryptor(data);
+			size_t count = 0, mismatch = 0, bytes = 0;
+			clock_t buildTime = 0, loadTime = 0, verifyTime = 0;
+			for (size_t i = 0; i < infos.size(); ++i) {
+				if (!decryptor.BuildInfoData(&infos[i], files[i].c_str(), stringPool)) {
+					continue;
+				}
+				clock_t s = clock();
+				data.Reset(&infos[i], true);
+				if (!decryptor.Build(true)) {
+					continue;
+				}
+				buildTime += clock() - s;
+				ChartCache::Encode(data, ChartFingerprint{}, 0, blobs[i]);
+				bytes += blobs[i].size();
+
+				std::vector<long long> times;
+				for (size_t k = 0; k < data.mPlayNote.size(); ++k) {
+					times.push_back(data.mPlayNote.GetTime(k));
+				}
+				// from the disk (with checksum) and from the memory
+				s = clock();
+				data.Reset(&infos[i], true);
+				bool bLoad = ChartCache::Decode(blobs[i], ChartFingerprint{}, 0, data, true);
+				verifyTime += clock() - s;
+				s = clock();
+				data.Reset(&infos[i], true);
+				bLoad = bLoad && ChartCache::Decode(blobs[i], ChartFingerprint{}, 0, data, false);
+				loadTime += clock() - s;
+				if (!bLoad || times.size() != data.mPlayNote.size()) {
+					++mismatch;
+				} else {
+					for (size_t k = 0; k < times.size(); ++k) {
+						mismatch += times[k] != data.mPlayNote.GetTime(k);
+					}
+				}
+				++count;
+			}
+			LOG("compiled chart count : " << count << ", bytes : " << bytes << ", mismatch : " << mismatch)
+			LOG("Build time(ms) : " << buildTime << ", compiled chart load time(ms) : " << verifyTime << ", without checksum(ms) : " << loadTime)
+			return Check("compiled chart", mismatch);
+		}
+
+		/// <summary> compare <see cref="BMSDecryptor::Build"/> and <see cref="BMSDecryptor::Rebuild"/> (select other #RANDOM branches without reading) </summary>
+		inline void RandomRebuild(const std::vector<std::wstring>& files) {
+			BMSData data;
+			BMSDecryptor decryptor(data);
+			Utility::StringPool stringPool;
+			size_t count = 0;
+			clock_t buildTime = 0, rebuildTime = 0;
+			for (const auto& path : files) {
+				BMSInfoData info;
+				if (!decryptor.BuildInfoData(&info, path.c_str(), stringPool) || !info.mHasRandom) {
+					continue;
+				}
+				clock_t s = clock();
+				data.Reset(&info, true);
+				if (!decryptor.Build(true)) {
+					continue;
+				}
+				buildTime += clock() - s;
+				s = clock();
+				decryptor.Rebuild();
+				rebuildTime += clock() - s;
+				++count;
+			}
+			LOG("#RANDOM chart count : " << count << ", Build time(ms) : " << buildTime << ", Rebuild time(ms) : " << rebuildTime)
+		}
+
+		/// <summary>
+		/// make a synthetic bms file content that has <paramref name="measureCount"/> measures.
+		/// if <paramref name="bBme"/> is true, 7 key channels (18, 19) and comment lines are included like .bme files
+		/// </summary>
+		inline std::string MakeSyntheticChart(int measureCount, bool bBme) {
+			static const char* channels[] = {"01", "11", "12", "13", "14", "15", "16", "18", "19"};
+			int channelCount = bBme ? 9 : 7;
+			std::string result;
+			result.reserve(measureCount * channelCount * 48);
+			result.append("#PLAYER 1\r\n#TITLE synthetic\r\n#BPM 150\r\n");
+			for (int i = 1; i < MAX_INDEX_LENGTH; ++i) {
+				result.append("#WAV").append(std::to_string(i)).append(" sound.wav\r\n");
+			}
+			char buf[64];
+			for (int m = 0; m < measureCount; ++m) {
+				if (bBme) {
+					result.append("*---------------------- MAIN DATA FIELD\r\n\r\n");
+				}
+				for (int c = 0; c < channelCount; ++c) {
+					snprintf(buf, sizeof(buf), "#%03d%s:%02X00%02X00%02X00%02X00\r\n", m % 1000, channels[c], m % 255 + 1, c + 1, m % 7 + 1, c + 2);
+					result.append(buf);
+				}
+			}
+			return result;
+		}
+
+		/// <summary> compare the byte loop of <see cref="BMSifstream"/> and the block scanner of <see cref="LineScanner.h"/> </summary>
+		inline bool ScanLines(int measureCount, int repeat) {
+			size_t mismatch = 0;
+			for (int type = 0; type < 2; ++type) {
+				std::string chart = MakeSyntheticChart(measureCount, type == 1);
+				const char* first = chart.data();
+				const char* last = first + chart.size();
+
+				// 1) one byte at a time like getLineDefault
+				clock_t s = clock();
+				size_t lineCount = 0, commandCount = 0;
+				for (int r = 0; r < repeat; ++r) {
+					bool bLineStart = true;
+					for (const char* p = first; p < last; ++p) {
+						if (bLineStart && *p == '#') ++commandCount;
+						bLineStart = *p == '\n';
+						lineCount += bLineStart;
+					}
+				}
+				LOG((type == 1 ? ".bme" : ".bms") << " scalar scan time(ms) : " << clock() - s << ", lines : " << lineCount << ", commands : " << commandCount)
+
+				// 2) line boundaries with FindNewLine
+				s = clock();
+				const size_t scalarLineCount = lineCount, scalarCommandCount = commandCount;
+				lineCount = 0;
+				for (int r = 0; r < repeat; ++r) {
+					for (const char* p = Utility::FindNewLine(first, last); p != last; p = Utility::FindNewLine(p + 1, last)) {
+						++lineCount;
+					}
+				}
+				LOG((type == 1 ? ".bme" : ".bms") << " FindNewLine scan time(ms) : " << clock() - s << ", lines : " << lineCount)
+
+				// 3) command lines with FindCommandLine + FindNewLine
+				s = clock();
+				commandCount = 0;
+				for (int r = 0; r < repeat; ++r) {
+					const char* p = first;
+					while ((p = Utility::FindCommandLine(p, last)) != last) {
+						++commandCount;
+						p = Utility::FindNewLine(p, last);
+						if (p != last) ++p;
+					}
+				}
+				LOG((type == 1 ? ".bme" : ".bms") << " FindCommandLine scan time(ms) : " << clock() - s << ", commands : " << commandCount)
+				mismatch += lineCount != scalarLineCount || commandCount != scalarCommandCount;
+			}
+			return Check("line scan", mismatch);
+		}
+
+		/// <summary>
+		/// compare the load time of the legacy stream cache and the mapped cache (<see cref="bms::CacheReader"/>)
+		/// with <paramref name="count"/> synthetic <see cref="bms::BMSInfoData"/> objects (8 patterns per folder)
+		/// </summary>
+		inline void LoadCache(int count) {
+			constexpr int PATTERN_COUNT = 8;
+			constexpr auto LEGACY_PATH = "benchmark_legacy.bin";
+			constexpr auto MAPPED_PATH = L"benchmark_cache.bin";
+
+			Utility::StringPool stringPool;
+			std::vector<BMSInfoData> infos(count);
+			std::vector<BMSInfoData*> folder;
+			CacheWriter writer;
+			{
+				std::ofstream os(LEGACY_PATH, std::ios::binary);
+				for (int i = 0; i < count; ++i) {
+					BMSInfoData& info = infos[i];
+					info.mFilePath = stringPool.Intern(L"StreamingAssets/folder" + std::to_wstring(i / PATTERN_COUNT) + L"/pattern" + std::to_wstring(i % PATTERN_COUNT) + L".bms");
+					info.mTitle = stringPool.Intern("synthetic title " + std::to_string(i));
+					info.mArtist = stringPool.Intern(std::string_view("synthetic artist"));
+					info.mGenre = stringPool.Intern(std::string_view("synthetic genre"));
+					info.mSoundExtension = stringPool.Intern(std::string_view(".wav"));
+					info.mFileTime = 1600000000 + i;
+					info.mFileSize = 100000 + i;
+					info.mLevel = i % 12 + 1;
+					info.mNoteCount = static_cast<uint16_t>(i % 3000);
+					folder.emplace_back(&info);
+					if (folder.size() == PATTERN_COUNT || i == count - 1) {
+						std::wstring path = L"StreamingAssets/folder" + std::to_wstring(i / PATTERN_COUNT);
+						WriteToBinary(os, Utility::WideToUTF8(path));
+						WriteToBinary(os, static_cast<uint8_t>(folder.size()));
+						for (auto data : folder) {
+							os << *data;
+						}
+						writer.AddFolder(path, info.mFileTime, folder);
+						folder.clear();
+					}
+				}
+			}
+			writer.Write(MAPPED_PATH);
+
+			// 1) legacy stream format : field by field stream reads
+			clock_t s = clock();
+			std::vector<BMSInfoData> result(count);
+			{
+				std::ifstream is(LEGACY_PATH, std::ios::binary);
+				int index = 0;
+				while (is.peek() != std::ifstream::traits_type::eof()) {
+					ReadFromBinary<std::string>(is);
+					uint8_t size = ReadFromBinary<uint8_t>(is);
+					for (uint8_t i = 0; i < size; ++i) {
+						result[index++].Deserialize(is, stringPool);
+					}
+				}
+			}
+			LOG("legacy cache load time(ms) : " << clock() - s << ", count : " << count)
+
+			// 2) mapped format : validate once and fill the objects from the record table. the text fields are the views of the mapped file
+			s = clock();
+			std::vector<BMSInfoData> mapped(count);
+			{
+				CacheReader reader;
+				if (reader.Open(MAPPED_PATH)) {
+					for (uint32_t i = 0; i < reader.GetRecordCount(); ++i) {
+						reader.ReadInfo(i, mapped[i]);
+					}
+				}
+			}
+			LOG("mapped cache load time(ms) : " << clock() - s << ", count : " << count)
+
+			std::remove(LEGACY_PATH);
+			std::remove(Utility::WideToUTF8(MAPPED_PATH).c_str());
+		}
+
+		/// <summary>
+		/// measure the memory and the release time of <paramref name="count"/> objects in <see cref="bms::InfoArena"/> and <see cref="Utility::StringPool"/>,
+		/// and of the same objects allocated one by one with their own strings. the memory is the growth of the working set of the process.
+		/// artists and genres are repeated like a real library
+		/// </summary>
+		inline void InfoMemory(int count) {
+			constexpr int PATTERN_COUNT = 8;
+			long long workingSet = GetWorkingSet();
+			clock_t s = clock();
+			InfoArena arena;
+			Utility::StringPool stringPool;
+			std::vector<BMSInfoData*> list(count);
+			for (int i = 0; i < count; ++i) {
+				BMSInfoData* info = arena.Create();
+				int music = i / PATTERN_COUNT;
+				info->mFilePath = stringPool.Intern(L"StreamingAssets/folder" + std::to_wstring(music) + L"/pattern" + std::to_wstring(i % PATTERN_COUNT) + L".bms");
+				info->mTitle = stringPool.Intern("synthetic title " + std::to_string(music));
+				info->mArtist = stringPool.Intern("synthetic artist " + std::to_string(music % 500));
+				info->mGenre = stringPool.Intern("synthetic genre " + std::to_string(music % 50));
+				info->mSoundExtension = stringPool.Intern(std::string_view("wav"));
+				list[i] = info;
+			}
+			LOG("arena create time(ms) : " << clock() - s << ", count : " << arena.GetCount()
+				<< ", object bytes : " << arena.GetBytes() << ", string bytes : " << stringPool.GetBytes()
+				<< ", working set growth : " << GetWorkingSet() - workingSet)
+
+			// the layout before the arena : each object is allocated alone and owns its strings.
+			// the arena is released after both are measured, so the heap objects don't reuse its memory
+			struct HeapInfo {
+				std::wstring mFilePath;
+				uint8_t mFields[48];		// the numeric fields of BMSInfoData
+				std::string mTitle, mArtist, mGenre, mSoundExtension;
+			};
+			workingSet = GetWorkingSet();
+			s = clock();
+			std::vector<HeapInfo*> heapList(count);
+			for (int i = 0; i < count; ++i) {
+				HeapInfo* info = new HeapInfo();
+				int music = i / PATTERN_COUNT;
+				info->mFilePath = L"StreamingAssets/folder" + std::to_wstring(music) + L"/pattern" + std::to_wstring(i % PATTERN_COUNT) + L".bms";
+				info->mTitle = "synthetic title " + std::to_string(music);
+				info->mArtist = "synthetic artist " + std::to_string(music % 500);
+				info->mGenre = "synthetic genre " + std::to_string(music % 50);
+				info->mSoundExtension = "wav";
+				heapList[i] = info;
+			}
+			LOG("heap create time(ms) : " << clock() - s << ", count : " << count << ", working set growth : " << GetWorkingSet() - workingSet)
+
+			s = clock();
+			arena.Clear();
+			stringPool.Clear();
+			LOG("arena release time(ms) : " << clock() - s)
+
+			s = clock();
+			for (HeapInfo* info : heapList) {
+				delete info;
+			}
+			LOG("heap release time(ms) : " << clock() - s)
+		}
+
+		/// <summary>
+		/// compare sorting <paramref name="count"/> music with a comparator for each sort option
+		/// and building the permutations of all sort keys at once with <see cref="bms::SortKey"/>
+		/// </summary>
+		inline void SortOrder(int count) {
+			InfoArena arena;
+			Utility::StringPool stringPool;
+			std::vector<BMSNode> listMusic;
+			listMusic.reserve(count);
+			std::mt19937 random(0);
+			for (int i = 0; i < count; ++i) {
+				BMSInfoData* info = arena.Create();
+				info->mFilePath = stringPool.Intern(L"StreamingAssets/folder/music" + std::to_wstring(random()) + L"/pattern.bms");
+				info->mTitle = stringPool.Intern("synthetic title " + std::to_string(random()));
+				info->mArtist = stringPool.Intern("synthetic artist " + std::to_string(random() % 500));
+				info->mGenre = stringPool.Intern("synthetic genre " + std::to_string(random() % 50));
+				info->mLevel = random() % 12 + 1;
+				info->mBpm = random() % 200 + 100;
+				listMusic.emplace_back(L"music" + std::to_wstring(random()), std::vector<BMSInfoData*>{info});
+			}
+
+			// 1) std::sort of the list with the comparator of each option (title comparator as the worst case)
+			std::vector<BMSNode*> list(count);
+			for (int i = 0; i < count; ++i) {
+				list[i] = &listMusic[i];
+			}
+			std::function<bool(BMSNode* const&, BMSNode* const&)> compare = [](BMSNode* const& lhs, BMSNode* const& rhs) {
+				return lhs->mListData[0]->mTitle < rhs->mListData[0]->mTitle;
+			};
+			clock_t s = clock();
+			for (size_t key = 0; key < SORT_KEY_COUNT * 2; ++key) {
+				std::shuffle(list.begin(), list.end(), random);
+				std::sort(list.begin(), list.end(), compare);
+			}
+			LOG("comparator sort time of " << SORT_KEY_COUNT * 2 << " options(ms) : " << clock() - s << ", count : " << count)
+
+			// 2) build all permutations once. changing the option after this is an assignment
+			s = clock();
+			std::vector<SortKey> keys;
+			keys.reserve(count);
+			for (auto& node : listMusic) {
+				keys.emplace_back(node.mListData[0], node.mFolderName);
+			}
+			std::vector<uint32_t> order;
+			SortKey::BuildOrder(keys, order);
+			LOG("sort key order build time(ms) : " << clock() - s << ", count : " << count)
+		}
+
+		/// <summary>
+		/// compare a linear scan of the title, artist and genre of <paramref name="count"/> charts
+		/// with <see cref="bms::SearchIndex"/> for substring, prefix and filtered queries
+		/// </summary>
+		inline void SearchQuery(int count) {
+			constexpr int QUERY_REPEAT = 100;
+			InfoArena arena;
+			Utility::StringPool stringPool;
+			std::vector<BMSInfoData*> list(count);
+			std::mt19937 random(0);
+			for (int i = 0; i < count; ++i) {
+				BMSInfoData* info = arena.Create();
+				info->mFilePath = stringPool.Intern(L"StreamingAssets/folder/music" + std::to_wstring(i) + L"/pattern.bms");
+				info->mTitle = stringPool.Intern("Synthetic Title " + std::to_string(random()));
+				info->mArtist = stringPool.Intern("synthetic artist " + std::to_string(random() % 500));
+				info->mGenre = stringPool.Intern("synthetic genre " + std::to_string(random() % 50));
+				info->mFileType = EncodingType::UTF_8;
+				info->mLevel = random() % 12 + 1;
+				info->mDifficulty = random() % 5 + 1;
+				info->mBpm = random() % 200 + 100;
+				list[i] = info;
+			}
+
+			clock_t s = clock();
+			SearchIndex index;
+			index.Build(list);
+			LOG("search index build time(ms) : " << clock() - s << ", count : " << count)
+
+			// 1) linear scan of the fields (case-sensitive, so it is a lower bound of the real cost)
+			const std::string query = "artist 42";
+			size_t found = 0;
+			s = clock();
+			for (int r = 0; r < QUERY_REPEAT; ++r) {
+				found = 0;
+				for (auto info : list) {
+					if (info->mTitle.find(query) != std::string_view::npos || info->mArtist.find(query) != std::string_view::npos ||
+						info->mGenre.find(query) != std::string_view::npos) {
+						++found;
+					}
+				}
+			}
+			LOG("linear search time of " << QUERY_REPEAT << " queries(ms) : " << clock() - s << ", found : " << found)
+
+			// 2) index queries
+			s = clock();
+			for (int r = 0; r < QUERY_REPEAT; ++r) {
+				found = index.Search(query).size();
+			}
+			LOG("index substring search time of " << QUERY_REPEAT << " queries(ms) : " << clock() - s << ", found : " << found)
+
+			s = clock();
+			for (int r = 0; r < QUERY_REPEAT; ++r) {
+				found = index.Search("tit", SearchFilter(), SearchMode::PREFIX).size();
+			}
+			LOG("index prefix search time of " << QUERY_REPEAT << " queries(ms) : " << clock() - s << ", found : " << found)
+
+			SearchFilter filter;
+			filter.mMinLevel = 10;
+			filter.mMaxLevel = 12;
+			filter.mMinBpm = 150;
+			filter.mMaxBpm = 180;
+			s = clock();
+			for (int r = 0; r < QUERY_REPEAT; ++r) {
+				found = index.Search("genre 1", filter).size();
+			}
+			LOG("index filtered search time of " << QUERY_REPEAT << " queries(ms) : " << clock() - s << ", found : " << found)
+		}
+
+		/// <summary>
+		/// check <see cref="bms::EncodingDetector"/> with a small corpus of titles in each encoding,
+		/// and compare the detection time of the locale conversion used before with the detector
+		/// </summary>
+		inline void DetectEncoding(int repeat) {
+			struct Sample {
+				const char* mText;
+				EncodingType mExpected;
+			};
+			static const Sample CORPUS[] = {
+				// Shift-JIS : kana, kanji, half-width katakana, full-width alphabet
+				{"\x96\xE9\x96\xBE\x82\xAF\x82\xCC\x83\x81\x83\x8D\x83" "f\x83" "B\x81[", EncodingType::SHIFT_JIS},
+				{"\x97\xF6\x82\xCC\x83G\x83\x8C\x83N\x83g\x83\x8A\x83" "b\x83N", EncodingType::SHIFT_JIS},
+				{"\x93\x8C\x95\xFB\x97" "d\x81X\x96\xB2", EncodingType::SHIFT_JIS},
+				{"\x82\xB3\x82\xAD\x82\xE7", EncodingType::SHIFT_JIS},
+				{"\xB1\xB2\xB3\xB4\xB5 \xC3\xBD\xC4 01", EncodingType::SHIFT_JIS},
+				{"\x89\xB9\x8Ay \x82" "a\x82" "f\x82l", EncodingType::SHIFT_JIS},
+				{"\x83s\x83" "A\x83m\x8B\xA6\x91t\x8B\xC8\x91\xE6\x88\xEA\x94\xD4", EncodingType::SHIFT_JIS},
+				{"\x8F\x89\x89\xB9\x83~\x83N", EncodingType::SHIFT_JIS},
+				{"\x96\xBB", EncodingType::SHIFT_JIS},
+				// EUC-KR : hangul, hanja
+				{"\xBB\xE7\xB6\xFB\xC0\xC7 \xB8\xE1\xB7\xCE\xB5\xF0", EncodingType::EUC_KR},
+				{"\xC7\xD1\xB1\xB9\xBE\xEE \xC1\xA6\xB8\xF1", EncodingType::EUC_KR},
+				{"\xB9\xE3\xC7\xCF\xB4\xC3\xC0\xC7 \xBA\xB0", EncodingType::EUC_KR},
+				{"\xB0\xA1\xB3\xAA\xB4\xD9\xB6\xF3", EncodingType::EUC_KR},
+				{"\xBC\xAD\xBF\xEF 1988", EncodingType::EUC_KR},
+				{"\xC8\xE6\xB9\xE9 (Remix)", EncodingType::EUC_KR},
+				{"\xBA\xBD", EncodingType::EUC_KR},
+				{"\xF9\xD3\xED\xAE \xC7\xD1\xC0\xDA", EncodingType::EUC_KR},
+				// UTF-8 and ASCII
+				{"\xE5\xA4\x9C\xE6\x98\x8E\xE3\x81\x91\xE3\x81\xAE\xE3\x83\xA1\xE3\x83\xAD\xE3\x83\x87\xE3\x82\xA3\xE3\x83\xBC", EncodingType::UTF_8},
+				{"\xEC\x82\xAC\xEB\x9E\x91\xEC\x9D\x98 \xEB\xA9\x9C\xEB\xA1\x9C\xEB\x94\x94", EncodingType::UTF_8},
+				{"\xC3\x9Cn\xC3\xAF" "c\xC3\xB6" "d\xC3\xA9 caf\xC3\xA9", EncodingType::UTF_8},
+				{"Hello World", EncodingType::UTF_8},
+				{"#WAV01 kick.wav", EncodingType::UTF_8},
+			};
+
+			int failCount = 0;
+			std::string buffer;
+			for (const Sample& sample : CORPUS) {
+				EncodingType type = EncodingDetector::Detect(sample.mText);
+				if (type != sample.mExpected) {
+					++failCount;
+					LOG("encoding detection failed : " << sample.mText << ", expected : " << static_cast<int>(sample.mExpected)
+						<< ", result : " << static_cast<int>(type))
+				}
+			}
+			LOG("encoding corpus count : " << sizeof(CORPUS) / sizeof(Sample) << ", fail : " << failCount)
+
+			// a header of a chart : title, artist, genre and about 300 #WAV file names (about 10KB) in one encoding
+			std::vector<std::string> headers;
+			for (const Sample& sample : CORPUS) {
+				if (sample.mExpected == EncodingType::UTF_8) {
+					continue;
+				}
+				std::string header;
+				while (header.size() < 10240) {
+					header.append(sample.mText).append("_").append(std::to_string(header.size())).append(".wav");
+				}
+				headers.emplace_back(std::move(header));
+			}
+
+			// 1) validate UTF-8, convert with both locales and convert back to check the encoding
+			clock_t s = clock();
+			size_t count = 0;
+			for (int r = 0; r < repeat; ++r) {
+				for (const auto& header : headers) {
+					if (Utility::IsValidUTF8(header.data())) {
+						continue;
+					}
+					std::wstring kws = Utility::AnsiToWide(header, Utility::GetKorLocale());
+					std::wstring jws = Utility::AnsiToWide(header, Utility::GetJpnLocale());
+					if (kws.size() != 0 && jws.size() != 0) {
+						count += Utility::WideToAnsi(kws, Utility::GetJpnLocale()).size();
+					}
+				}
+			}
+			LOG("locale encoding check time(ms) : " << clock() - s << ", count : " << repeat * headers.size())
+
+			// 2) single pass detector. most headers are confirmed in the first few fields
+			s = clock();
+			count = 0;
+			for (int r = 0; r < repeat; ++r) {
+				for (const auto& header : headers) {
+					count += static_cast<size_t>(EncodingDetector::Detect(header));
+				}
+			}
+			LOG("encoding detector time(ms) : " << clock() - s << ", count : " << repeat * headers.size())
+		}
+
+		/// <summary>
+		/// compare the conversion time of <paramref name="count"/> #WAV file names (Shift-JIS) to UTF-8
+		/// with the locale conversion and the built-in table of <see cref="Utility::CP932ToUTF8"/>
+		/// </summary>
+		inline void ConvertCodePage(int count) {
+			// "kick_" + katakana + number + ".wav"
+			std::vector<std::string> names(count);
+			for (int i = 0; i < count; ++i) {
+				names[i] = "kick_\x83L\x83" "b\x83N\x83h\x83\x89\x83\x80" + std::to_string(i) + ".wav";
+			}
+
+			clock_t s = clock();
+			size_t bytes = 0;
+			for (const auto& name : names) {
+				bytes += Utility::ToUTF8(name, Utility::GetJpnLocale()).size();
+			}
+			LOG("locale conversion time(ms) : " << clock() - s << ", count : " << count << ", bytes : " << bytes)
+
+			s = clock();
+			bytes = 0;
+			std::string out;
+			for (const auto& name : names) {
+				Utility::CP932ToUTF8(name, out);
+				bytes += out.size();
+			}
+			LOG("code page table conversion time(ms) : " << clock() - s << ", count : " << count << ", bytes : " << bytes)
+		}
+
+		/// <summary>
+		/// compare the timeline of a synthetic chart with <paramref name="noteCount"/> notes (random divisions, odd measure lengths, bpm changes)
+		/// between the fraction beats (the previous implementation) and the integer ticks of <see cref="bms::BMSDecryptor::MakeTickTimeline"/>.
+		/// the chart is written to a file and built by <see cref="bms::BMSDecryptor"/>, and the notes are looked up by <see cref="bms::BMSDecryptor::GetTick"/>
+		/// </summary>
+		inline bool Timeline(int noteCount) {
+			struct RawNote {
+				int mMeasure, mIndex, mDivision;
+				double mBpm;		// 0 : not a bpm change
+			};
+			constexpr int DIVISIONS[] = { 3, 4, 5, 7, 8, 12, 16, 24, 32, 48, 64, 96, 192 };
+			constexpr int measureCount = 400;
+			srand(1);
+			std::vector<BeatFraction> lengths(measureCount);
+			for (int i = 0; i < measureCount; ++i) {
+				int r = rand() % 10;
+				lengths[i] = r == 0 ? BeatFraction(3, 1) : r == 1 ? BeatFraction(7, 2) : r == 2 ? BeatFraction(5, 4) : BeatFraction(4, 1);
+			}
+			std::vector<RawNote> raws(noteCount);
+			std::set<double> bpmPositions;
+			for (auto& raw : raws) {
+				raw.mMeasure = rand() % measureCount;
+				raw.mDivision = DIVISIONS[rand() % (sizeof(DIVISIONS) / sizeof(int))];
+				raw.mIndex = rand() % raw.mDivision;
+				// written as the hex value of CHANGE_BPM channel. one bpm change at a position, so the order of the segments is defined
+				raw.mBpm = rand() % 50 == 0 && bpmPositions.insert(raw.mMeasure + static_cast<double>(raw.mIndex) / raw.mDivision).second ? 100.0 + rand() % 155 : 0;
+			}
+			struct Segment {
+				long long mTime;
+				double mBpm;
+				BeatFraction mBeat;
+			};
+
+			// 1) fraction : cumulative beats, beats of each note, sort by the value of fraction, search the segment
+			clock_t s = clock();
+			std::vector<BeatFraction> cumulative(measureCount);
+			BeatFraction sum;
+			for (int i = 0; i < measureCount; ++i) {
+				sum += lengths[i];
+				cumulative[i] = sum;
+			}
+			std::vector<BeatFraction> beats(noteCount);
+			for (int i = 0; i < noteCount; ++i) {
+				const RawNote& raw = raws[i];
+				BeatFraction beat = BeatFraction(Utility::Fraction(raw.mIndex, raw.mDivision) * lengths[raw.mMeasure]);
+				beats[i] = raw.mMeasure == 0 ? beat : BeatFraction(cumulative[raw.mMeasure - 1] + beat);
+			}
+			std::vector<int> order(noteCount);
+			for (int i = 0; i < noteCount; ++i) {
+				order[i] = i;
+			}
+			std::sort(order.begin(), order.end(), [&](int lhs, int rhs) { return beats[lhs] < beats[rhs]; });
+			std::vector<Segment> segs(1, Segment{ 0, 130.0, BeatFraction() });
+			for (int i : order) {
+				if (raws[i].mBpm != 0) {
+					const Segment& prev = segs.back();
+					segs.push_back({ prev.mTime + BeatFraction(beats[i] - prev.mBeat).GetTime(prev.mBpm), raws[i].mBpm, beats[i] });
+				}
+			}
+			std::vector<long long> fractionTimes(noteCount);
+			for (int i : order) {
+				size_t index = segs.size() - 1;
+				while (index > 0 && beats[i] < segs[index].mBeat) {
+					--index;
+				}
+				fractionTimes[i] = segs[index].mTime + BeatFraction(beats[i] - segs[index].mBeat).GetTime(segs[index].mBpm);
+			}
+			LOG("fraction timeline time(ms) : " << clock() - s << ", note count : " << noteCount)
+
+			// 2) tick : the same chart is built by the decryptor (MakeTickTimeline), then the ticks of GetTick are sorted
+			//    and the times are found by GetTimeUsingTick. all operations are integer operations except the conversion to time
+			constexpr auto TIMELINE_PATH = L"benchmark_timeline.bms";
+			{
+				std::ofstream os(TIMELINE_PATH, std::ios::binary);
+				os << "#TITLE timeline\n#BPM 130\n#WAV01 a.wav\n";
+				for (int i = 0; i < measureCount; ++i) {
+					const BeatFraction& length = lengths[i];
+					if (length.mNumerator != 4 || length.mDenominator != 1) {
+						os << '#' << std::setw(3) << std::setfill('0') << i << "02:" << static_cast<double>(length.mNumerator) / (length.mDenominator * 4) << '\n';
+					}
+				}
+				// one line for each note, so the notes at the same position are not overwritten
+				for (const RawNote& raw : raws) {
+					os << '#' << std::setw(3) << std::setfill('0') << raw.mMeasure << "01:";
+					for (int j = 0; j < raw.mDivision; ++j) {
+						os << (j == raw.mIndex ? "01" : "00");
+					}
+					os << '\n';
+					if (raw.mBpm != 0) {
+						os << '#' << std::setw(3) << std::setfill('0') << raw.mMeasure << "03:";
+						for (int j = 0; j < raw.mDivision; ++j) {
+							if (j == raw.mIndex) {
+								os << std::hex << std::setw(2) << std::uppercase << static_cast<int>(raw.mBpm) << std::dec;
+							} else {
+								os << "00";
+							}
+						}
+						os << '\n';
+					}
+				}
+			}
+			Utility::StringPool stringPool;
+			BMSInfoData info;
+			BMSData data;
+			BMSDecryptor decryptor(data);
+			s = clock();
+			bool bBuilt = decryptor.BuildInfoData(&info, TIMELINE_PATH, stringPool);
+			if (bBuilt) {
+				data.Reset(&info, true);
+				bBuilt = decryptor.Build(true);
+			}
+			std::remove(Utility::WideToUTF8(TIMELINE_PATH).c_str());
+			if (!bBuilt) {
+				return Check("timeline build", 1);
+			}
+			LOG("tick chart build time(ms) : " << clock() - s << ", tick per beat : " << data.mTickPerBeat)
+
+			s = clock();
+			std::vector<long long> ticks(noteCount);
+			for (int i = 0; i < noteCount; ++i) {
+				ticks[i] = decryptor.GetTick(raws[i].mMeasure, raws[i].mIndex, raws[i].mDivision);
+			}
+			for (int i = 0; i < noteCount; ++i) {
+				order[i] = i;
+			}
+			std::sort(order.begin(), order.end(), [&](int lhs, int rhs) { return ticks[lhs] < ticks[rhs]; });
+			std::vector<long long> tickTimes(noteCount);
+			for (int i : order) {
+				tickTimes[i] = decryptor.GetTimeUsingTick(ticks[i]);
+			}
+			LOG("tick timeline time(ms) : " << clock() - s << ", tick per beat : " << data.mTickPerBeat)
+
+			int mismatch = 0;
+			long long maxDiff = 0;
+			for (int i = 0; i < noteCount; ++i) {
+				long long diff = std::abs(fractionTimes[i] - tickTimes[i]);
+				mismatch += diff != 0;
+				maxDiff = std::max(maxDiff, diff);
+			}
+			LOG("timeline mismatch count : " << mismatch << ", max difference(us) : " << maxDiff)
+
+			// the built bgm notes have the same times
+			std::vector<long long> builtTimes;
+			for (uint32_t i = 0; i < data.mPlayBgm.size(); ++i) {
+				builtTimes.push_back(data.mPlayBgm.GetTime(i));
+			}
+			std::sort(fractionTimes.begin(), fractionTimes.end());
+			LOG("built note count : " << builtTimes.size() << ", same times : " << (builtTimes == fractionTimes))
+			return Check("timeline", mismatch + (builtTimes != fractionTimes));
+		}
+
+		/// <summary>
+		/// compare the time lookup of <paramref name="noteCount"/> notes in a chart with <paramref name="segmentCount"/> bpm changes and stops (soflan)
+		/// between the backward linear scan (the previous implementation), the binary search and the merged sweep of <see cref="bms::BMSDecryptor"/>.
+		/// all results must be the same microsecond
+		/// </summary>
+		inline bool SegmentLookup(int segmentCount, int noteCount) {
+			constexpr long long tickPerBeat = 192;
+			BMSData data;
+			BMSDecryptor decryptor(data);
+			data.mTickPerBeat = tickPerBeat;
+			data.mListTimeSeg.resize(segmentCount + 1);
+			data.mListTimeSeg.push(TimeSegment(0, 150.0, 0));
+			srand(1);
+			long long tick = 0, time = 0;
+			double bpm = 150.0;
+			for (int i = 0; i < segmentCount; ++i) {
+				long long delta = 1 + rand() % (tickPerBeat * 2);
+				time += decryptor.GetTimeUsingTick(delta, bpm);
+				tick += delta;
+				if (rand() % 8 == 0) {
+					// stop : two segments at the same tick
+					data.mListTimeSeg.push(TimeSegment(time, 0, tick));
+					time += 1000 + rand() % 500000;
+					data.mListTimeSeg.push(TimeSegment(time, bpm, tick));
+					++i;
+				} else {
+					bpm = 60.0 + rand() % 300;
+					data.mListTimeSeg.push(TimeSegment(time, bpm, tick));
+				}
+			}
+			std::vector<long long> ticks(noteCount);
+			for (auto& t : ticks) {
+				t = static_cast<long long>(rand()) * rand() % (tick + tickPerBeat * 4);
+			}
+			std::sort(ticks.begin(), ticks.end());
+
+			// 1) backward linear scan from the last segment for each note
+			clock_t s = clock();
+			std::vector<long long> linear(noteCount);
+			for (int i = 0; i < noteCount; ++i) {
+				uint32_t index = data.mListTimeSeg.size() - 1;
+				while (index > 0 && ticks[i] < data.mListTimeSeg[index].mCurTick) {
+					--index;
+				}
+				const TimeSegment& prev = data.mListTimeSeg[index];
+				linear[i] = prev.mCurTime + decryptor.GetTimeUsingTick(ticks[i] - prev.mCurTick, prev.mCurBpm);
+			}
+			LOG("linear segment lookup time(ms) : " << clock() - s << ", segment count : " << data.mListTimeSeg.size() << ", note count : " << noteCount)
+
+			// 2) binary search for each note
+			s = clock();
+			std::vector<long long> binary(noteCount);
+			for (int i = 0; i < noteCount; ++i) {
+				binary[i] = decryptor.GetTimeUsingTick(ticks[i]);
+			}
+			LOG("binary segment lookup time(ms) : " << clock() - s)
+
+			// 3) merged sweep in ascending order of ticks
+			s = clock();
+			std::vector<long long> sweep(noteCount);
+			uint32_t segIndex = 0;
+			for (int i = 0; i < noteCount; ++i) {
+				sweep[i] = decryptor.GetTimeUsingTick(ticks[i], segIndex);
+			}
+			LOG("sweep segment lookup time(ms) : " << clock() - s)
+
+			int mismatch = 0;
+			for (int i = 0; i < noteCount; ++i) {
+				mismatch += linear[i] != binary[i] || linear[i] != sweep[i];
+			}
+			LOG("segment lookup mismatch count : " << mismatch)
+			return Check("segment lookup", mismatch);
+		}
+
+		/// <summary>
+		/// compare the sort of objects in <paramref name="measureCount"/> measures with <paramref name="lineCount"/> channel lines each
+		/// between the comparison sort and the merge of the ascending lines (<see cref="bms::ListPool::MergeRuns"/>)
+		/// </summary>
+		inline bool SortObjects(int measureCount, int lineCount) {
+			constexpr int DIVISIONS[] = { 1, 2, 4, 8, 16, 32, 48, 64, 96, 192 };
+			constexpr long long tickPerBeat = 192 * 4;
+			std::vector<ListPool<Object>> sorted(measureCount), merged(measureCount);
+			srand(1);
+			size_t objectCount = 0;
+			for (int m = 0; m < measureCount; ++m) {
+				for (int l = 0; l < lineCount; ++l) {
+					int division = DIVISIONS[rand() % (sizeof(DIVISIONS) / sizeof(int))];
+					for (int i = 0; i < division; ++i) {
+						if (rand() % 3 == 0) {
+							continue;
+						}
+						Object obj(static_cast<uint16_t>(1 + rand() % 1000), m, Channel::BGM, i, division);
+						obj.mTick = m * tickPerBeat + tickPerBeat / division * i;
+						sorted[m].push(obj);
+						merged[m].push(obj);
+						++objectCount;
+					}
+				}
+			}
+			auto less = [](const Object& lhs, const Object& rhs) ->bool { return lhs.mTick < rhs.mTick; };
+
+			clock_t s = clock();
+			for (auto& objs : sorted) {
+				objs.Sort(less);
+			}
+			LOG("comparison sort time(ms) : " << clock() - s << ", object count : " << objectCount)
+
+			s = clock();
+			std::vector<Object> buffer;
+			for (auto& objs : merged) {
+				objs.MergeRuns(less, buffer);
+			}
+			LOG("line merge sort time(ms) : " << clock() - s)
+
+			int mismatch = 0;
+			for (int m = 0; m < measureCount; ++m) {
+				for (uint32_t i = 0; i < merged[m].size(); ++i) {
+					mismatch += sorted[m][i].mTick != merged[m][i].mTick || (i > 0 && merged[m][i - 1].mTick > merged[m][i].mTick);
+				}
+			}
+			LOG("sort mismatch count : " << mismatch)
+			return Check("object sort", mismatch);
+		}
+
+		/// <summary>
+		/// compare the memory and the play loop scan of <paramref name="noteCount"/> player notes
+		/// between the note list of all fields (the previous <see cref="bms::PlayerNote"/>) and the packed list (<see cref="bms::PlaybackTrack"/>).
+		/// the loop is called <paramref name="frameCount"/> times like <see cref="bms::PlayThread::Update"/>
+		/// </summary>
+		inline bool PlaybackScan(int noteCount, int frameCount) {
+			constexpr long long errorRange = 4000;	// MAX_ERROR_RANGE of the play thread
+			struct ListNote {
+				int mKey;
+				Channel mChannel;
+				long long mTick;
+				long long mTime;
+				NoteType mType;
+				long long mEndTick;
+			};
+			std::vector<ListNote> list;
+			list.reserve(noteCount);
+			BMSData data;
+			data.BeginPlaybackTracks(0, noteCount);
+			srand(1);
+			long long time = 0;
+			for (int i = 0; i < noteCount; ++i) {
+				time += rand() % 20000;
+				NoteType type = rand() % 20 == 0 ? NoteType::LANDMINE : NoteType::NORMAL;
+				int key = 1 + rand() % 1295;
+				Channel channel = static_cast<Channel>(37 + rand() % 9);
+				list.push_back(ListNote{key, channel, 0, time, type, 0});
+				data.PushPlayerNote(key, channel, time, 0, type);
+			}
+			data.PublishPlaybackTracks(noteCount, true);
+			// the playback track is the only storage of time, tick, key and type, so its bytes and the player note list are the whole footprint
+			LOG("note list bytes : " << noteCount * sizeof(ListNote) << ", playback track + player note list bytes : " << data.GetNoteBytes())
+
+			const long long frameTime = time / frameCount + 1;
+			clock_t s = clock();
+			long long keySum = 0;
+			int index = 0;
+			for (int f = 1; f <= frameCount; ++f) {
+				long long now = f * frameTime, minTime = now - errorRange;
+				for (; index < noteCount; ++index) {
+					const ListNote& note = list[index];
+					if (note.mTime >= now) {
+						break;
+					}
+					if (note.mType != NoteType::LANDMINE && note.mTime > minTime) {
+						keySum += note.mKey;
+					}
+				}
+			}
+			LOG("note list play loop time(ms) : " << clock() - s << ", key sum : " << keySum)
+
+			s = clock();
+			long long listKeySum = keySum;
+			keySum = 0;
+			index = 0;
+			const PlaybackTrack& track = data.mPlayNote;
+			for (int f = 1; f <= frameCount; ++f) {
+				long long now = f * frameTime, minTime = now - errorRange;
+				for (; index < noteCount; ++index) {
+					long long noteTime = track.GetTime(index);
+					if (noteTime >= now) {
+						break;
+					}
+					if (noteTime > minTime && track.GetType(index) != NoteType::LANDMINE) {
+						keySum += track.GetKey(index);
+					}
+				}
+			}
+			LOG("playback track play loop time(ms) : " << clock() - s << ", key sum : " << keySum)
+			return Check("playback scan key sum", keySum != listKeySum);
+		}
+
+		/// <summary>
+		/// play <paramref name="noteCount"/> synthetic notes with <see cref="PlayThread::PlayOffline"/> and <see cref="RecordingBackend"/>.
+		/// the frames are 1 / FRAMERATE seconds late by up to <paramref name="maxFrameDelay"/> microseconds, and the latency of the triggers is measured.
+		/// if <paramref name="bSchedule"/> is true, the sounds are scheduled <see cref="LOOK_AHEAD_TIME"/> ahead and the frames are 1 / SCHEDULE_FRAMERATE seconds
+		/// </summary>
+		inline void PlaybackTrigger(int noteCount, int maxFrameDelay, bool bSchedule) {
+			BMSData data;
+			data.BeginPlaybackTracks(0, noteCount);
+			Utility::Xorshf96 random(1);
+			long long time = 0;
+			for (int i = 0; i < noteCount; ++i) {
+				time += random() % 20000;
+				data.PushPlayerNote(1 + random() % 1295, static_cast<Channel>(37 + random() % 9), time, 0, NoteType::NORMAL);
+			}
+			data.PublishPlaybackTracks(noteCount, true);
+
+			std::vector<long long> frames;
+			for (long long frame = 0; frame < time + 1000000; frame += 1000000 / (bSchedule ? SCHEDULE_FRAMERATE : FRAMERATE)) {
+				frames.push_back(frame + random() % (maxFrameDelay + 1));
+			}
+			PlayThread thread(data, std::make_unique<RecordingBackend>(bSchedule));
+			clock_t s = clock();
+			thread.PlayOffline(frames);
+			LOG("offline play time(ms) : " << clock() - s << ", frame count : " << frames.size())
+
+			// the lateness is logged by the play thread at the end
+			std::vector<uint32_t> histogram = thread.GetStats().GetHistogram(false, 500, 9);
+			std::ostringstream os;
+			for (size_t i = 0; i < histogram.size(); ++i) {
+				os << (i == 0 ? "" : ", ") << i * 500 << (i + 1 < histogram.size() ? "~ : " : "+ : ") << histogram[i];
+			}
+			LOG("lateness histogram(us) : " << os.str())
+		}
+
+		/// <summary>
+		/// play a synthetic chart that uses <paramref name="keyCount"/> keysounds from the start to the end, with a backend that takes <paramref name="loadMicros"/> microseconds
+		/// to create a sound. the blocking preload time and the notes whose sound is not created in time are measured. it plays in real time
+		/// </summary>
+		inline void KeysoundLoading(int keyCount, int loadMicros) {
+			struct SlowBackend : RecordingBackend {
+				int mLoadMicros;
+				SlowBackend(int loadMicros) : RecordingBackend(false), mLoadMicros(loadMicros) {}
+				void CreateSound(const std::string& filePath, int key) override {
+					std::this_thread::sleep_for(std::chrono::microseconds(mLoadMicros));
+					RecordingBackend::CreateSound(filePath, key);
+				}
+			};
+
+			BMSInfoData info = {};
+			info.mFilePath = L"benchmark/keysound.bms";
+			BMSData data;
+			data.mInfo = &info;
+			// a new key at every other note, and a used key at the others
+			Utility::Xorshf96 random(1);
+			const long long interval = 2500;
+			data.BeginPlaybackTracks(0, keyCount * 2);
+			for (int i = 0; i < keyCount * 2; ++i) {
+				int key = i % 2 == 0 ? 1 + i / 2 : 1 + random() % (i / 2 + 1);
+				data.PushPlayerNote(key, static_cast<Channel>(37 + random() % 9), i * interval, 0, NoteType::NORMAL);
+			}
+			for (int key = 1; key <= keyCount; ++key) {
+				data.mListWavName[key] = std::to_string(key) + ".wav";
+			}
+			data.PublishPlaybackTracks(keyCount * 2, true);
+			info.mTotalTime = keyCount * 2 * interval;
+
+			PlayThread thread(data, std::make_unique<SlowBackend>(loadMicros));
+			auto s = std::chrono::steady_clock::now();
+			thread.Play();
+			LOG("keysound count : " << keyCount << ", blocking preload time(ms) : "
+				<< std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - s).count())
+			// the stats are logged at the end of the song
+			std::this_thread::sleep_for(std::chrono::microseconds(info.mTotalTime + 600000));
+			thread.ForceEnd();
+			LOG("missing sound count : " << thread.GetStats().GetSummary().mMissingCount)
+		}
+
+		/// <summary>
+		/// render a synthetic chart of <paramref name="seconds"/> seconds with <paramref name="noteCount"/> notes and a backing track
+		/// by <see cref="SoftwareMixer"/> with 1 thread and all threads. the keysounds are 0.2 ~ 1 second
+		/// </summary>
+		inline bool RenderChart(int seconds, int noteCount) {
+			BMSData data;
+			Utility::Xorshf96 random(1);
+			const long long totalTime = seconds * 1000000ll;
+			data.BeginPlaybackTracks(noteCount / 4 + 1, noteCount);
+			data.PushBgm(1, 0, 0);
+			for (int i = 0; i < noteCount; ++i) {
+				long long time = totalTime * i / noteCount;
+				if (i % 4 == 0) {
+					data.PushBgm(2 + random() % 1294, time, 0);
+				}
+				data.PushPlayerNote(2 + random() % 1294, static_cast<Channel>(37 + random() % 9), time, 0, NoteType::NORMAL);
+			}
+			data.PublishPlaybackTracks(noteCount, true);
+
+			size_t mismatch = 0;
+			for (unsigned threadCount : {1u, 0u}) {
+				SoftwareMixer mixer(MIXER_SAMPLE_RATE, threadCount);
+				for (uint16_t key = 1; key < MAX_INDEX_LENGTH; ++key) {
+					size_t frames = key == 1 ? static_cast<size_t>(seconds) * MIXER_SAMPLE_RATE : MIXER_SAMPLE_RATE / 5 + random() % (MIXER_SAMPLE_RATE * 4 / 5);
+					std::vector<float> samples(frames * 2);
+					for (float& sample : samples) {
+						sample = (static_cast<int>(random() % 2001) - 1000) / 8000.0f;
+					}
+					mixer.SetSound(key, std::move(samples));
+				}
+				std::vector<float> out;
+				auto s = std::chrono::steady_clock::now();
+				mixer.Render(data, out);
+				auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - s);
+				LOG("mixer thread : " << (threadCount == 0 ? std::thread::hardware_concurrency() : threadCount) << ", render time(ms) : " << elapsed.count()
+					<< ", frames : " << out.size() / 2)
+
+				// empty ranges : the start after the end, and no decoded sound (the last frame is 0)
+				mixer.Render(data, out, totalTime * 2);
+				size_t pastEnd = out.size();
+				SoftwareMixer silent(MIXER_SAMPLE_RATE, threadCount);
+				silent.Render(data, out, 1000000);
+				LOG("mixer frames of the start after the end : " << pastEnd / 2 << ", without sounds : " << out.size() / 2)
+				mismatch += pastEnd != 0 || !out.empty();
+			}
+			return Check("mixer empty ranges", mismatch);
+		}
+
+		/// <summary> run all benchmarks with the bms files in <paramref name="root"/> folder. return false if a comparison fails (<see cref="Check"/>) </summary>
+		inline bool RunAll(const std::wstring& root) {
+			std::vector<std::wstring> files;
+			bool bPass = true;
+			bPass &= ScanLines(1000, 100);
+			bPass &= ScanEdgeCases();
+			DetectEncoding(1000);
+			ConvertCodePage(100000);
+			bPass &= Timeline(8000);
+			bPass &= SegmentLookup(500, 10000);
+			bPass &= SortObjects(1000, 16);
+			bPass &= PlaybackScan(1000000, 100000);
+			PlaybackTrigger(100000, 0, false);
+			PlaybackTrigger(100000, 3000, false);
+			PlaybackTrigger(100000, 3000, true);
+			PlaybackTrigger(100000, 25000, true);
+			KeysoundLoading(1295, 1000);
+			bPass &= RenderChart(180, 2000);
+			LoadCache(50000);
+			InfoMemory(40000);
+			SortOrder(40000);
+			SearchQuery(50000);
+
+			CollectBmsFiles(root, files);
+			LOG("benchmark file count : " << files.size())
+			if (!files.empty()) {
+				ReadLines(files);
+				BuildInfoData(files);
+				ParallelScan(files);
+				bPass &= CompiledChart(files, 200);
+				RandomRebuild(files);
+			}
+			LOG("benchmark checks : " << (bPass ? "passed" : "FAILED"))
+			return bPass;
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,338 @@
+#pragma once
+
+#include "BMSData.h"
+#include "MappedFile.h"
+
+namespace bms {
+	constexpr uint32_t CACHE_MAGIC = 0x43534D42;	// "BMSC" in little endian
+	constexpr uint16_t CACHE_VERSION = 2;
+
+	// -- on-disk layout : [CacheHeader][CacheFolder * folderCount][CacheRecord * recordCount][string pool]
+	//    all structures are 8 byte aligned, so tables can be used directly in the mapped file.
+	//    strings in the pool are null-terminated, so the views of the mapped file can be used as the text fields of BMSInfoData.
+
+	/// <summary>
+	/// a reference to a string in the string pool of cache file. <see cref="CacheRecord::mFilePath"/> is wchar_t string aligned to wchar_t,
+	/// the others are UTF-8. <see cref="mLength"/> is the number of characters without the null character
+	/// </summary>
+	struct CacheString {
+		uint32_t mOffset;
+		uint32_t mLength;
+	};
+
+	struct CacheHeader {
+		uint32_t mMagic;
+		uint16_t mVersion;
+		uint16_t mHeaderSize;
+		uint32_t mFolderCount;
+		uint32_t mRecordCount;
+		uint32_t mPoolSize;
+		uint32_t mReserved;
+		uint64_t mChecksum;				// FNV-1a hash of all bytes after the header
+	};
+
+	/// <summary> a music folder (<see cref="bms::BMSNode"/>). records of the folder are [mFirstRecord, mFirstRecord + mRecordCount) </summary>
+	struct CacheFolder {
+		CacheString mPath;
+		uint64_t mFolderTime;
+		uint32_t mFirstRecord;
+		uint32_t mRecordCount;
+	};
+
+	/// <summary> fixed-size record of <see cref="bms::BMSInfoData"/> </summary>
+	struct CacheRecord {
+		CacheString mFilePath;
+		CacheString mTitle;
+		CacheString mArtist;
+		CacheString mGenre;
+		CacheString mSoundExtension;
+		uint64_t mFileTime;
+		uint64_t mFileSize;
+		uint64_t mTotalTime;
+		double mBpm;
+		double mMinBpm;
+		double mMaxBpm;
+		uint16_t mNoteCount;
+		uint16_t mWavCount;
+		uint16_t mMeasureCount;
+		uint8_t mFileType;
+		uint8_t mKeyType;
+		uint8_t mLevel;
+		uint8_t mDifficulty;
+		uint8_t mHasRandom;
+		uint8_t mReserved[5];
+	};
+
+	static_assert(sizeof(CacheHeader) == 32, "CacheHeader must be 32 bytes");
+	static_assert(sizeof(CacheFolder) == 24, "CacheFolder must be 24 bytes");
+	static_assert(sizeof(CacheRecord) == 104, "CacheRecord must be 104 bytes");
+
+	// reference : http://www.isthe.com/chongo/tech/comp/fnv/index.html
+	/// <summary> 64-bit FNV-1a hash used for the checksum of cache file </summary>
+	inline uint64_t HashFNV1a(const char* data, size_t length, uint64_t hash = 14695981039346656037ull) {
+		const uint8_t* p = reinterpret_cast<const uint8_t*>(data);
+		for (size_t i = 0; i < length; ++i) {
+			hash ^= p[i];
+			hash *= 1099511628211ull;
+		}
+		return hash;
+	}
+
+	/// <summary>
+	/// A class that collects music folders and writes them to the cache file at once.
+	/// </summary>
+	class CacheWriter {
+	public:
+		CacheWriter() = default;
+		DISALLOW_COPY_AND_ASSIGN(CacheWriter)
+
+		/// <summary> add a music folder of <paramref name="path"/> and its patterns </summary>
+		void AddFolder(const std::wstring& path, uint64_t folderTime, const std::vector<BMSInfoData*>& list) {
+			CacheFolder folder;
+			folder.mPath = AddString(Utility::WideToUTF8(path));
+			folder.mFolderTime = folderTime;
+			folder.mFirstRecord = static_cast<uint32_t>(mListRecord.size());
+			folder.mRecordCount = static_cast<uint32_t>(list.size());
+			mListFolder.emplace_back(folder);
+
+			for (const BMSInfoData* info : list) {
+				CacheRecord record = {};
+				record.mFilePath = AddString(info->mFilePath);
+				record.mTitle = AddString(info->mTitle);
+				record.mArtist = AddString(info->mArtist);
+				record.mGenre = AddString(info->mGenre);
+				record.mSoundExtension = AddString(info->mSoundExtension);
+				record.mFileTime = info->mFileTime;
+				record.mFileSize = info->mFileSize;
+				record.mTotalTime = info->mTotalTime;
+				record.mBpm = info->mBpm;
+				record.mMinBpm = info->mMinBpm;
+				record.mMaxBpm = info->mMaxBpm;
+				record.mNoteCount = info->mNoteCount;
+				record.mWavCount = info->mWavCount;
+				record.mMeasureCount = info->mMeasureCount;
+				record.mFileType = static_cast<uint8_t>(info->mFileType);
+				record.mKeyType = static_cast<uint8_t>(info->mKeyType);
+				record.mLevel = info->mLevel;
+				record.mDifficulty = info->mDifficulty;
+				record.mHasRandom = info->mHasRandom;
+				mListRecord.emplace_back(record);
+			}
+		}
+
+		/// <summary>
+		/// write all folders to the temporary file and replace the file of <paramref name="path"/> with it,
+		/// so the previous cache file is kept if the process stops while writing.
+		/// caution : the file of <paramref name="path"/> must not be mapped by <see cref="CacheReader"/> (it can't be replaced on Windows)
+		/// </summary>
+		bool Write(const wchar_t* path) {
+			// pad the string pool so that the file size is a multiple of 8
+			mPool.resize((mPool.size() + 7) & ~static_cast<size_t>(7), '\0');
+
+			CacheHeader header = {};
+			header.mMagic = CACHE_MAGIC;
+			header.mVersion = CACHE_VERSION;
+			header.mHeaderSize = sizeof(CacheHeader);
+			header.mFolderCount = static_cast<uint32_t>(mListFolder.size());
+			header.mRecordCount = static_cast<uint32_t>(mListRecord.size());
+			header.mPoolSize = static_cast<uint32_t>(mPool.size());
+
+			const char* folders = reinterpret_cast<const char*>(mListFolder.data());
+			const char* records = reinterpret_cast<const char*>(mListRecord.data());
+			size_t folderBytes = mListFolder.size() * sizeof(CacheFolder);
+			size_t recordBytes = mListRecord.size() * sizeof(CacheRecord);
+			uint64_t hash = HashFNV1a(folders, folderBytes);
+			hash = HashFNV1a(records, recordBytes, hash);
+			header.mChecksum = HashFNV1a(mPool.data(), mPool.size(), hash);
+
+			std::wstring tempPath = std::wstring(path) + L".tmp";
+			{
+				std::ofstream os(tempPath.c_str(), std::ios::binary);
+				if (!os.is_open()) {
+					return false;
+				}
+				os.write(reinterpret_cast<const char*>(&header), sizeof(CacheHeader));
+				os.write(folders, folderBytes);
+				os.write(records, recordBytes);
+				os.write(mPool.data(), mPool.size());
+				os.close();
+				if (!os) {
+					_wremove(tempPath.c_str());
+					return false;
+				}
+			}
+#ifdef _WIN32
+			bool bReplaced = MoveFileExW(tempPath.c_str(), path, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+			bool bReplaced = std::rename(Utility::WideToUTF8(tempPath).c_str(), Utility::WideToUTF8(path).c_str()) == 0;
+#endif
+			if (!bReplaced) {
+				_wremove(tempPath.c_str());
+			}
+			return bReplaced;
+		}
+
+	private:
+		std::vector<CacheFolder> mListFolder;
+		std::vector<CacheRecord> mListRecord;
+		std::string mPool;
+
+		inline CacheString AddString(std::string_view s) {
+			CacheString result = {static_cast<uint32_t>(mPool.size()), static_cast<uint32_t>(s.size())};
+			mPool.append(s);
+			mPool.push_back('\0');
+			return result;
+		}
+		inline CacheString AddString(std::wstring_view s) {
+			mPool.resize((mPool.size() + sizeof(wchar_t) - 1) / sizeof(wchar_t) * sizeof(wchar_t), '\0');
+			CacheString result = {static_cast<uint32_t>(mPool.size()), static_cast<uint32_t>(s.size())};
+			mPool.append(reinterpret_cast<const char*>(s.data()), s.size() * sizeof(wchar_t));
+			mPool.append(sizeof(wchar_t), '\0');
+			return result;
+		}
+	};
+
+	/// <summary>
+	/// A class that maps the cache file and reads the tables in place.
+	/// The file is validated once when it is opened (magic number, version, size, checksum).
+	/// the strings are not copied : <see cref="ReadInfo"/> returns the views of the mapped file, which are valid until <see cref="Close"/>
+	/// </summary>
+	class CacheReader {
+	public:
+		CacheReader() : mHeader(nullptr), mListFolder(nullptr), mListRecord(nullptr), mPool(nullptr) {}
+		DISALLOW_COPY_AND_ASSIGN(CacheReader)
+
+		/// <summary>
+		/// map the cache file of <paramref name="path"/>. return false if the file does not exist or is invalid.
+		/// an invalid file is not kept mapped, so it can be replaced
+		/// </summary>
+		bool Open(const wchar_t* path) {
+			Close();
+			if (!mFile.Open(path)) {
+				return false;
+			}
+			if (!Validate()) {
+				Close();
+				return false;
+			}
+			return true;
+		}
+
+		/// <summary> unmap the file. all views returned before become invalid </summary>
+		void Close() {
+			mHeader = nullptr;
+			mFile.Close();
+		}
+
+		inline bool IsOpen() const {
+			return mHeader != nullptr;
+		}
+		inline uint32_t GetFolderCount() const {
+			return mHeader->mFolderCount;
+		}
+		inline uint32_t GetRecordCount() const {
+			return mHeader->mRecordCount;
+		}
+		inline const CacheFolder& GetFolder(uint32_t index) const {
+			return mListFolder[index];
+		}
+		inline const CacheRecord& GetRecord(uint32_t index) const {
+			return mListRecord[index];
+		}
+
+		/// <summary> return true if <paramref name="p"/> points to the mapped file (the view returned by this reader) </summary>
+		inline bool Contains(const void* p) const {
+			return mHeader != nullptr && p >= mFile.Data() && p < mFile.Data() + mFile.Size();
+		}
+
+		/// <summary> return the null-terminated string in the string pool. invalid reference returns an empty string </summary>
+		inline std::string_view GetString(const CacheString& s) const {
+			if (static_cast<uint64_t>(s.mOffset) + s.mLength >= mHeader->mPoolSize || mPool[s.mOffset + s.mLength] != '\0') {
+				return std::string_view("", 0);
+			}
+			return std::string_view(mPool + s.mOffset, s.mLength);
+		}
+		/// <summary> return the null-terminated wchar_t string in the string pool. invalid reference returns an empty string </summary>
+		inline std::wstring_view GetWideString(const CacheString& s) const {
+			uint64_t end = s.mOffset + (static_cast<uint64_t>(s.mLength) + 1) * sizeof(wchar_t);
+			const wchar_t* p = reinterpret_cast<const wchar_t*>(mPool + s.mOffset);
+			if (s.mOffset % sizeof(wchar_t) != 0 || end > mHeader->mPoolSize || p[s.mLength] != L'\0') {
+				return std::wstring_view(L"", 0);
+			}
+			return std::wstring_view(p, s.mLength);
+		}
+
+		/// <summary>
+		/// fill <paramref name="info"/> with the record of <paramref name="index"/>.
+		/// text fields are the views of the mapped file, so nothing is copied or converted and the pages of the pool are read when the text is used
+		/// </summary>
+		void ReadInfo(uint32_t index, BMSInfoData& info) const {
+			const CacheRecord& record = mListRecord[index];
+			info.mFilePath = GetWideString(record.mFilePath);
+			info.mTitle = GetString(record.mTitle);
+			info.mArtist = GetString(record.mArtist);
+			info.mGenre = GetString(record.mGenre);
+			info.mSoundExtension = GetString(record.mSoundExtension);
+			info.mFileTime = record.mFileTime;
+			info.mFileSize = record.mFileSize;
+			info.mTotalTime = record.mTotalTime;
+			info.mBpm = record.mBpm;
+			info.mMinBpm = record.mMinBpm;
+			info.mMaxBpm = record.mMaxBpm;
+			info.mNoteCount = record.mNoteCount;
+			info.mWavCount = record.mWavCount;
+			info.mMeasureCount = record.mMeasureCount;
+			info.mFileType = static_cast<EncodingType>(record.mFileType);
+			info.mKeyType = static_cast<KeyType>(record.mKeyType);
+			info.mLevel = record.mLevel;
+			info.mDifficulty = record.mDifficulty;
+			info.mHasRandom = record.mHasRandom != 0;
+		}
+
+	private:
+		Utility::MappedFile mFile;
+		const CacheHeader* mHeader;
+		const CacheFolder* mListFolder;
+		const CacheRecord* mListRecord;
+		const char* mPool;
+
+		/// <summary> check the mapped file and set the tables </summary>
+		bool Validate() {
+			if (mFile.Size() < sizeof(CacheHeader)) {
+				return false;
+			}
+
+			const char* data = mFile.Data();
+			const CacheHeader* header = reinterpret_cast<const CacheHeader*>(data);
+			if (header->mMagic != CACHE_MAGIC || header->mVersion != CACHE_VERSION || header->mHeaderSize != sizeof(CacheHeader)) {
+				LOG("cache file has different format. magic : " << header->mMagic << ", version : " << header->mVersion)
+				return false;
+			}
+
+			uint64_t expected = sizeof(CacheHeader) + static_cast<uint64_t>(header->mFolderCount) * sizeof(CacheFolder) +
+								static_cast<uint64_t>(header->mRecordCount) * sizeof(CacheRecord) + header->mPoolSize;
+			if (expected != mFile.Size()) {
+				LOG("cache file size is not correct : " << mFile.Size() << ", expected : " << expected)
+				return false;
+			}
+			if (HashFNV1a(data + sizeof(CacheHeader), mFile.Size() - sizeof(CacheHeader)) != header->mChecksum) {
+				LOG("cache file checksum is not correct")
+				return false;
+			}
+
+			mListFolder = reinterpret_cast<const CacheFolder*>(data + sizeof(CacheHeader));
+			mListRecord = reinterpret_cast<const CacheRecord*>(mListFolder + header->mFolderCount);
+			mPool = reinterpret_cast<const char*>(mListRecord + header->mRecordCount);
+			for (uint32_t i = 0; i < header->mFolderCount; ++i) {
+				const CacheFolder& folder = mListFolder[i];
+				if (static_cast<uint64_t>(folder.mFirstRecord) + folder.mRecordCount > header->mRecordCount) {
+					LOG("cache file has invalid folder : " << i)
+					return false;
+				}
+			}
+			mHeader = header;
+
+			return true;
+		}
+	};
+}
\ No newline at end of file
@@ -0,0 +1,264 @@
+#pragma once
+
+#include "BMSCache.h"
+
+#include <list>
+
+namespace bms {
+	constexpr auto CHART_CACHE_DIR = L"chartcache";
+	constexpr uint32_t CHART_CACHE_MAGIC = 0x50534D42;	// "BMSP" in little endian
+	/// <summary> increase when the format of <see cref="bms::BMSData::Serialize"/> or the result of <see cref="bms::BMSDecryptor::Build"/> changes </summary>
+	constexpr uint16_t CHART_CACHE_VERSION = 5;
+	/// <summary> the number of compiled charts kept in memory </summary>
+	constexpr size_t CHART_CACHE_MEMORY_COUNT = 8;
+
+	// -- compiled chart layout : [ChartCacheHeader][payload of BMSData::Serialize with the file path at first]
+
+	/// <summary> the state of the files a compiled chart is built from. a compiled chart is used only if all fields are the same </summary>
+	struct ChartFingerprint {
+		uint64_t mFileTime;				// the bms file
+		uint64_t mFileSize;
+		uint64_t mFolderTime;			// the folder of the bms file. changes when a keysound file is added, removed or renamed
+		uint64_t mExtensionHash;		// FNV-1a hash of BMSInfoData::mSoundExtension, which mListWavName is resolved with
+
+		inline bool operator==(const ChartFingerprint& other) const {
+			return mFileTime == other.mFileTime && mFileSize == other.mFileSize && mFolderTime == other.mFolderTime && mExtensionHash == other.mExtensionHash;
+		}
+	};
+
+	struct ChartCacheHeader {
+		uint32_t mMagic;
+		uint16_t mVersion;
+		uint16_t mHeaderSize;
+		ChartFingerprint mFingerprint;	// when it is built
+		uint64_t mTotalTime;			// BMSInfoData::mTotalTime
+		double mMinBpm;					// BMSInfoData::mMinBpm and mMaxBpm, also made by the build
+		double mMaxBpm;
+		uint64_t mRandomSeed;			// the seed of #RANDOM values (BMSDecryptor::SetRandomSeed)
+		uint64_t mPayloadSize;
+		uint64_t mChecksum;				// FNV-1a hash of the payload
+	};
+
+	static_assert(sizeof(ChartCacheHeader) == 88, "ChartCacheHeader must be 88 bytes");
+
+	/// <summary>
+	/// A cache of built <see cref="bms::BMSData"/> (compiled chart) so that the chart played again is loaded without parsing.
+	/// The compiled charts are kept in memory up to <see cref="CHART_CACHE_MEMORY_COUNT"/> (least recently used is removed)
+	/// and in <see cref="CHART_CACHE_DIR"/> folder, one file per chart named by the hash of the path.
+	/// invalidation : a compiled chart is used only if the version, the path and the checksum match,
+	/// and the <see cref="bms::ChartFingerprint"/> (the bms file, its folder and the sound extension) is the same as when it was built. otherwise the chart is built again and overwritten.
+	/// charts with #RANDOM are cached with the seed of the values, and the chart built with another seed is not used.
+	/// It is not thread-safe. <see cref="bms::BMSAdapter"/> calls <see cref="Store"/> on the thread that finishes the build, which is the streaming build thread
+	/// if the notes are still made while playing, and waits for that thread (<see cref="bms::BMSAdapter::WaitForBuild"/>) before the next <see cref="Load"/>.
+	/// </summary>
+	class ChartCache {
+	public:
+		ChartCache(size_t memoryCount = CHART_CACHE_MEMORY_COUNT, bool bUseDisk = true) : mMemoryCount(memoryCount), mbUseDisk(bUseDisk) {}
+		DISALLOW_COPY_AND_ASSIGN(ChartCache)
+
+		/// <summary>
+		/// fill <paramref name="data"/> with the compiled chart of data.mInfo built with <paramref name="randomSeed"/>.
+		/// call after <see cref="bms::BMSData::Reset"/>. return false if there is no valid one
+		/// </summary>
+		bool Load(BMSData& data, uint64_t randomSeed) {
+			BMSInfoData* info = data.mInfo;
+			ChartFingerprint fingerprint;
+			if (!MakeFingerprint(*info, fingerprint)) {
+				return false;
+			}
+
+			// 1) memory
+			auto iter = mDicEntry.find(info->mFilePath);
+			if (iter != mDicEntry.end()) {
+				std::list<Entry>::iterator entry = iter->second;
+				if (Decode(entry->mBlob, fingerprint, randomSeed, data, false)) {
+					mListEntry.splice(mListEntry.begin(), mListEntry, entry);
+					return true;
+				}
+				mDicEntry.erase(iter);
+				mListEntry.erase(entry);
+				data.Reset(info, true);
+			}
+
+			// 2) disk
+			if (!mbUseDisk) {
+				return false;
+			}
+			std::string blob;
+			{
+				Utility::MappedFile file;
+				if (!file.Open(GetFilePath(info->mFilePath).c_str())) {
+					return false;
+				}
+				blob.assign(file.Data(), file.Size());
+			}
+			if (!Decode(blob, fingerprint, randomSeed, data, true)) {
+				LOG("compiled chart is not valid : " << Utility::WideToUTF8(std::wstring(info->mFilePath)))
+				data.Reset(info, true);
+				return false;
+			}
+			Remember(info->mFilePath, std::move(blob));
+			return true;
+		}
+
+		/// <summary>
+		/// save the <paramref name="data"/> built with <paramref name="randomSeed"/> in memory and disk.
+		/// the fingerprint is the current state of the bms file
+		/// </summary>
+		void Store(const BMSData& data, uint64_t randomSeed) {
+			const BMSInfoData* info = data.mInfo;
+			ChartFingerprint fingerprint;
+			if (!MakeFingerprint(*info, fingerprint)) {
+				return;
+			}
+			std::string blob;
+			try {
+				Encode(data, fingerprint, randomSeed, blob);
+			} catch (const std::exception& e) {
+				LOG("compiled chart write failed : " << e.what())
+				return;
+			}
+
+			if (mbUseDisk && Utility::MakeDirectory(CHART_CACHE_DIR)) {
+				std::ofstream os(GetFilePath(info->mFilePath).c_str(), std::ios::binary);
+				if (!os.is_open() || !os.write(blob.data(), blob.size())) {
+					LOG("compiled chart file write failed : " << Utility::WideToUTF8(std::wstring(info->mFilePath)))
+				}
+			}
+			Remember(info->mFilePath, std::move(blob));
+		}
+
+		/// <summary> remove all compiled charts in memory. the files are not removed </summary>
+		void Clear() {
+			mDicEntry.clear();
+			mListEntry.clear();
+		}
+
+		inline size_t GetMemoryCount() const {
+			return mListEntry.size();
+		}
+
+		/// <summary> the current state of the files of <paramref name="info"/>. return false if the bms file or its folder is not found </summary>
+		static bool MakeFingerprint(const BMSInfoData& info, ChartFingerprint& fingerprint) {
+			uint64_t folderSize;
+			// _wstat64 fails with the trailing separator
+			size_t separator = info.mFilePath.find_last_of(L"/\\");
+			std::wstring folder = separator == std::wstring_view::npos ? L"." : std::wstring(info.mFilePath.substr(0, separator));
+			if (!Utility::GetFileStat(info.mFilePath.data(), fingerprint.mFileTime, fingerprint.mFileSize) ||
+				!Utility::GetFileStat(folder.c_str(), fingerprint.mFolderTime, folderSize)) {
+				return false;
+			}
+			fingerprint.mExtensionHash = HashFNV1a(info.mSoundExtension.data(), info.mSoundExtension.size());
+			return true;
+		}
+
+		/// <summary> write the compiled chart of <paramref name="data"/> to <paramref name="blob"/> with the fingerprint of the bms file </summary>
+		static void Encode(const BMSData& data, const ChartFingerprint& fingerprint, uint64_t randomSeed, std::string& blob) {
+			std::ostringstream os(std::ios::binary);
+			WriteToBinary(os, data.mInfo->mFilePath);
+			data.Serialize(os);
+			std::string payload = os.str();
+
+			ChartCacheHeader header = {};
+			header.mMagic = CHART_CACHE_MAGIC;
+			header.mVersion = CHART_CACHE_VERSION;
+			header.mHeaderSize = sizeof(ChartCacheHeader);
+			header.mFingerprint = fingerprint;
+			header.mTotalTime = data.mInfo->mTotalTime;
+			header.mMinBpm = data.mInfo->mMinBpm;
+			header.mMaxBpm = data.mInfo->mMaxBpm;
+			header.mRandomSeed = randomSeed;
+			header.mPayloadSize = payload.size();
+			header.mChecksum = HashFNV1a(payload.data(), payload.size());
+
+			blob.reserve(sizeof(ChartCacheHeader) + payload.size());
+			blob.assign(reinterpret_cast<const char*>(&header), sizeof(ChartCacheHeader));
+			blob.append(payload);
+		}
+
+		/// <summary>
+		/// fill <paramref name="data"/> with <paramref name="blob"/> if it is valid for data.mInfo, the fingerprint and the seed.
+		/// the checksum is checked only if <paramref name="bVerify"/> is true, because it costs about as much as the decoding. the blobs in memory are not verified.
+		/// <paramref name="data"/> is partially filled if it returns false
+		/// </summary>
+		static bool Decode(std::string_view blob, const ChartFingerprint& fingerprint, uint64_t randomSeed, BMSData& data, bool bVerify) {
+			if (blob.size() < sizeof(ChartCacheHeader)) {
+				return false;
+			}
+			ChartCacheHeader header;
+			memcpy(&header, blob.data(), sizeof(ChartCacheHeader));
+			if (header.mMagic != CHART_CACHE_MAGIC || header.mVersion != CHART_CACHE_VERSION || header.mHeaderSize != sizeof(ChartCacheHeader) ||
+				!(header.mFingerprint == fingerprint) || header.mRandomSeed != randomSeed || header.mPayloadSize != blob.size() - sizeof(ChartCacheHeader)) {
+				return false;
+			}
+			const char* payload = blob.data() + sizeof(ChartCacheHeader);
+			if (bVerify && HashFNV1a(payload, header.mPayloadSize) != header.mChecksum) {
+				return false;
+			}
+
+			ViewBuffer buffer(payload, header.mPayloadSize);
+			std::istream is(&buffer);
+			try {
+				if (ReadFromBinary<std::wstring>(is) != data.mInfo->mFilePath) {
+					return false;	// another file with the same hash
+				}
+				data.Deserialize(is);
+			} catch (const std::exception& e) {
+				LOG("compiled chart read failed : " << e.what())
+				return false;
+			}
+			data.mInfo->mTotalTime = header.mTotalTime;
+			data.mInfo->mMinBpm = header.mMinBpm;
+			data.mInfo->mMaxBpm = header.mMaxBpm;
+			return true;
+		}
+
+	private:
+		/// <summary> a read-only stream buffer of memory, to read the blob without copying it to a string stream </summary>
+		struct ViewBuffer : std::streambuf {
+			ViewBuffer(const char* data, size_t size) {
+				char* p = const_cast<char*>(data);
+				setg(p, p, p + size);
+			}
+		};
+
+		struct Entry {
+			std::wstring mPath;
+			std::string mBlob;
+		};
+
+		size_t mMemoryCount;
+		bool mbUseDisk;
+		/// <summary> compiled charts in memory, the most recently used is the first </summary>
+		std::list<Entry> mListEntry;
+		/// <summary> key : Entry::mPath </summary>
+		std::unordered_map<std::wstring_view, std::list<Entry>::iterator> mDicEntry;
+
+		/// <summary> put <paramref name="blob"/> at the first of the memory cache and remove the least recently used ones </summary>
+		void Remember(std::wstring_view path, std::string&& blob) {
+			if (mMemoryCount == 0) {
+				return;
+			}
+			auto iter = mDicEntry.find(path);
+			if (iter != mDicEntry.end()) {
+				iter->second->mBlob = std::move(blob);
+				mListEntry.splice(mListEntry.begin(), mListEntry, iter->second);
+				return;
+			}
+			mListEntry.push_front(Entry{std::wstring(path), std::move(blob)});
+			mDicEntry.emplace(mListEntry.front().mPath, mListEntry.begin());
+			while (mListEntry.size() > mMemoryCount) {
+				mDicEntry.erase(mListEntry.back().mPath);
+				mListEntry.pop_back();
+			}
+		}
+
+		/// <summary> return the file path of the compiled chart of <paramref name="path"/> </summary>
+		static std::wstring GetFilePath(std::wstring_view path) {
+			uint64_t hash = HashFNV1a(reinterpret_cast<const char*>(path.data()), path.size() * sizeof(wchar_t));
+			wchar_t name[24];
+			swprintf(name, 24, L"/%016llx.bin", static_cast<unsigned long long>(hash));
+			return CHART_CACHE_DIR + std::wstring(name);
+		}
+	};
+}
\ No newline at end of file
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "BMSObjects.h"
+#include "StringPool.h"
 
 namespace bms {
 	constexpr uint16_t MAX_INDEX_LENGTH = 1296;		// 00~ZZ, 36 * 36
@@ -8,9 +9,11 @@ namespace bms {
 	/// <summary>
 	/// a data structure include information of <see cref="mPath"/> file for write UI information
 	/// contains sorting information and minimal information to help you read the file.
+	/// text fields are views of <see cref="Utility::StringPool"/> owned by the container (ex. <see cref="bms::BMSTree"/>),
+	/// so the object has no memory to release and can be placed in <see cref="bms::InfoArena"/>.
 	/// </summary>
 	struct BMSInfoData {
-		std::wstring mFilePath;
+		std::wstring_view mFilePath;	// null-terminated
 		EncodingType mFileType;
 
 		KeyType mKeyType;				// determine how many keys the file uses.
@@ -24,9 +27,9 @@ namespace bms {
 		double mMinBpm;					// max bpm at variable bpm
 		double mMaxBpm;					// min bpm at variable bpm
 
-		std::string mTitle;
-		std::string mArtist;
-		std::string mGenre;
+		std::string_view mTitle;
+		std::string_view mArtist;
+		std::string_view mGenre;
 
 		// -- additional BMSInfo (for construct preview data)
 
@@ -34,14 +37,19 @@ namespace bms {
 		uint16_t mWavCount;				// The number of total wav file
 		uint16_t mMeasureCount;			// The number of total measure of current bms data
 
-		// non-save data (when filesystem check, this value is filled)
+		// -- file fingerprint (used to check if the file is modified after the cache is saved)
+
+		uint64_t mFileTime;				// last modification time of the file
+		uint64_t mFileSize;				// size of the file in bytes
+
+		// filled when filesystem check, and saved to restore the music folder that is not enumerated
 		/// <summary> Defined for confirmation because the extension of the music list written in the bms file may be different due to its capacity. </summary>
-		std::string mSoundExtension;
+		std::string_view mSoundExtension;	// null-terminated
 
 		// ----- constructor, operator overloading -----
 
-		BMSInfoData() : mLevel(0), mDifficulty(0),
-						mNoteCount(0), mTotalTime(0), mMinBpm(0), mMaxBpm(0) {
+		BMSInfoData() : mFilePath(L""), mLevel(0), mDifficulty(0),
+						mNoteCount(0), mTotalTime(0), mMinBpm(0), mMaxBpm(0), mFileTime(0), mFileSize(0), mSoundExtension("") {
 			// Do not use it if class contains pointer variables.
 			// I don't know why below link throw an error that says an access violation.
 			// reference : https://www.sysnet.pe.kr/2/0/4
@@ -76,8 +84,13 @@ namespace bms {
 			
 			return os;
 		}
-		friend std::istream& operator>>(std::istream& is, BMSInfoData& s) {
-			s.mFilePath = ReadFromBinary<std::wstring>(is);
+		/// <summary>
+		/// read the object written by operator&lt;&lt; (the record of the legacy cache file, test.bin). text fields are stored in <paramref name="pool"/>.
+		/// the legacy record has no fingerprint and sound extension, so they are left as they are
+		/// </summary>
+		void Deserialize(std::istream& is, Utility::StringPool& pool) {
+			BMSInfoData& s = *this;
+			s.mFilePath = pool.Intern(ReadFromBinary<std::wstring>(is));
 			s.mFileType = static_cast<EncodingType>(ReadFromBinary<uint8_t>(is));
 			s.mKeyType = static_cast<KeyType>(ReadFromBinary<uint8_t>(is));
 			s.mLevel = ReadFromBinary<uint8_t>(is);
@@ -87,14 +100,12 @@ namespace bms {
 			s.mBpm = ReadFromBinary<double>(is);
 			s.mMinBpm = ReadFromBinary<double>(is);
 			s.mMaxBpm = ReadFromBinary<double>(is);
-			s.mTitle = ReadFromBinary<std::string>(is);
-			s.mArtist = ReadFromBinary<std::string>(is);
-			s.mGenre = ReadFromBinary<std::string>(is);
+			s.mTitle = pool.Intern(ReadFromBinary<std::string>(is));
+			s.mArtist = pool.Intern(ReadFromBinary<std::string>(is));
+			s.mGenre = pool.Intern(ReadFromBinary<std::string>(is));
 			s.mWavCount = ReadFromBinary<uint16_t>(is);
 			s.mMeasureCount = ReadFromBinary<uint16_t>(is);
 			s.mHasRandom = ReadFromBinary<bool>(is);
-
-			return is;
 		}
 	};
 
@@ -106,7 +117,7 @@ namespace bms {
 	public:
 		// ----- constructor, operator overloading -----
 
-		BMSData() : mInfo(nullptr), mReady(false), mRank(2), mTotal(200), mLongNoteType(LongnoteType::RDM_TYPE_1) {
+		BMSData() : mInfo(nullptr), mReady(false), mRank(2), mTotal(200), mLongNoteType(LongnoteType::RDM_TYPE_1), mTickPerBeat(1) {
 			mListWavName = new std::string[MAX_INDEX_LENGTH];
 			mListBmpName = new std::string[MAX_INDEX_LENGTH];
 		}
@@ -124,27 +135,131 @@ namespace bms {
 
 		///<summary> reset all member variable </summary>
 		void Reset(BMSInfoData* const& info, bool bPreview) {
-			mReady = false;
 			mInfo = info;
+			ClearNotes();
+
+			for (uint16_t i = 0; i < MAX_INDEX_LENGTH; ++i) {
+				mListWavName[i].clear();
+				if (!bPreview) {
+					mListBmpName[i].clear();
+				}
+			}
+
+			uint16_t measureCnt = info->mMeasureCount;
+			if (mListCumulativeTick.size() < measureCnt) {
+				mListCumulativeTick.resize(measureCnt);
+			}
+		}
 
+		///<summary> reset the time segments and the note lists. the header and the wav file names are kept </summary>
+		void ClearNotes() {
+			mReady = false;
 			mNoteCount = 0;
 			mLongCount = 0;
 			mListTimeSeg.clear();
 			mListBga.clear();
-			mListBgm.clear();
 			mListPlayerNote.clear();
+			mPlayBgm.clear();
+			mPlayNote.clear();
+			mTickPerBeat = 1;
+		}
+
+		/// <summary>
+		/// write the built data except <see cref="mInfo"/> : header values, wav file names, time segments, playback tracks and note lists
+		/// </summary>
+		void Serialize(std::ostream& os) const {
+			WriteToBinary(os, mRank);
+			WriteToBinary(os, mTotal);
+			WriteToBinary(os, static_cast<uint8_t>(mLongNoteType));
+			WriteToBinary(os, mNoteCount);
+			WriteToBinary(os, mLongCount);
+			WriteToBinary(os, mStageFile);
+			WriteToBinary(os, mBannerFile);
 
+			uint16_t wavCount = 0;
 			for (uint16_t i = 0; i < MAX_INDEX_LENGTH; ++i) {
-				mListWavName[i].clear();
-				if (!bPreview) {
-					mListBmpName[i].clear();
+				wavCount += !mListWavName[i].empty();
+			}
+			WriteToBinary(os, wavCount);
+			for (uint16_t i = 0; i < MAX_INDEX_LENGTH; ++i) {
+				if (!mListWavName[i].empty()) {
+					WriteToBinary(os, i);
+					WriteToBinary(os, mListWavName[i]);
 				}
 			}
 
-			uint16_t measureCnt = info->mMeasureCount;
-			if (mListCumulativeBeat.size() < measureCnt) {
-				mListCumulativeBeat.resize(measureCnt);
+			WriteToBinary(os, mTickPerBeat);
+			WriteToBinary(os, mListCumulativeTick);
+			WriteToBinary(os, mListTimeSeg);
+			WriteToBinary(os, mListBga);
+			WriteToBinary(os, mPlayBgm);
+			WriteToBinary(os, mPlayNote);
+			WriteToBinary(os, mListPlayerNote);
+		}
+		/// <summary> read the data written by <see cref="Serialize"/>. the playback tracks are published. call after <see cref="Reset"/> </summary>
+		void Deserialize(std::istream& is) {
+			mRank = ReadFromBinary<int>(is);
+			mTotal = ReadFromBinary<int>(is);
+			mLongNoteType = static_cast<LongnoteType>(ReadFromBinary<uint8_t>(is));
+			mNoteCount = ReadFromBinary<int>(is);
+			mLongCount = ReadFromBinary<int>(is);
+			ReadFromBinary(is, mStageFile);
+			ReadFromBinary(is, mBannerFile);
+
+			uint16_t wavCount = ReadFromBinary<uint16_t>(is);
+			for (uint16_t i = 0; i < wavCount; ++i) {
+				uint16_t index = ReadFromBinary<uint16_t>(is);
+				if (index >= MAX_INDEX_LENGTH) {
+					throw std::ios_base::failure("wav index " + std::to_string(index) + " is out of range");
+				}
+				ReadFromBinary(is, mListWavName[index]);
 			}
+
+			mTickPerBeat = ReadFromBinary<long long>(is);
+			ReadFromBinary(is, mListCumulativeTick);
+			ReadFromBinary(is, mListTimeSeg);
+			ReadFromBinary(is, mListBga);
+			ReadFromBinary(is, mPlayBgm);
+			ReadFromBinary(is, mPlayNote);
+			ReadFromBinary(is, mListPlayerNote);
+			if (mListPlayerNote.size() != mPlayNote.size()) {
+				throw std::ios_base::failure("player note list and playback track have different sizes");
+			}
+		}
+
+		/// <summary>
+		/// clear the playback tracks and the player note list, and reserve the maximum number of notes. 
+		/// the tracks are not reallocated while they are filled, so they can be played at the same time
+		/// </summary>
+		void BeginPlaybackTracks(uint32_t bgmCapacity, uint32_t noteCapacity) {
+			mPlayBgm.clear();
+			mPlayBgm.reserve(bgmCapacity);
+			mPlayNote.clear();
+			mPlayNote.reserve(noteCapacity);
+			mListPlayerNote.clear();
+			mListPlayerNote.resize(noteCapacity);
+		}
+
+		inline void PushBgm(int key, long long time, long long tick) {
+			mPlayBgm.push(time, tick, key, NoteType::NORMAL, PlaybackTrack::BGM_LANE);
+		}
+		inline void PushPlayerNote(int key, Channel ch, long long time, long long tick, NoteType type) {
+			mPlayNote.push(time, tick, key, type, static_cast<uint8_t>(static_cast<int>(ch) % 36 - 1));
+			mListPlayerNote.push(PlayerNote(ch));
+		}
+
+		/// <summary>
+		/// publish all bgm notes and the player notes before <paramref name="noteLimit"/>. 
+		/// the player notes after it can be still changed (ex. the start of a long note)
+		/// </summary>
+		void PublishPlaybackTracks(uint32_t noteLimit, bool bComplete) {
+			mPlayBgm.Publish(mPlayBgm.size(), bComplete);
+			mPlayNote.Publish(noteLimit, bComplete);
+		}
+
+		/// <summary> return the bytes used by the notes of the playback tracks and the player note list </summary>
+		inline size_t GetNoteBytes() const {
+			return mPlayBgm.GetBytes() + mPlayNote.GetBytes() + mListPlayerNote.size() * sizeof(PlayerNote);
 		}
 
 		BMSInfoData* mInfo;
@@ -166,15 +281,22 @@ namespace bms {
 		///<summary> a list of bmp or video file name, the index is bmp file mapping value </summary>
 		std::string* mListBmpName;
 
-		///<summary> a list of the cumulative number of bits per measure  </summary>
-		std::vector<BeatFraction> mListCumulativeBeat;
+		/// <summary>
+		/// the resolution of all ticks in this data. it is the least common multiple of all measure divisions and measure length denominators,
+		/// so every object is on an exact integer tick
+		/// </summary>
+		long long mTickPerBeat;
+		///<summary> a list of the cumulative number of ticks at the end of each measure </summary>
+		std::vector<long long> mListCumulativeTick;
 		///<summary> a list of the change timing point  </summary>
 		ListPool<TimeSegment> mListTimeSeg;
 		///<summary> a list of the note include BGA data  </summary>
 		ListPool<Note> mListBga;
-		///<summary> a list of the note include BGM data  </summary>
-		ListPool<Note> mListBgm;
-		///<summary> a list of the note that shown on the track </summary>
+		///<summary> channel and end tick of the notes that shown on the track, at the same index as <see cref="mPlayNote"/> </summary>
 		ListPool<PlayerNote> mListPlayerNote;
+		///<summary> time, tick and key of the BGM notes </summary>
+		PlaybackTrack mPlayBgm;
+		///<summary> time, tick, key and type of the notes that shown on the track </summary>
+		PlaybackTrack mPlayNote;
 	};
 }
\ No newline at end of file
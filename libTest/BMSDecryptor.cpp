@@ -7,9 +7,14 @@ using namespace bms;
 /// read file and build for fill data in header. no file dictionary is created.
 /// Read only information that is displayed on the UI or is helpful when reading information for previewing.
 /// </summary>
+/// <param name="pool"> the pool that stores text fields of <paramref name="data"/> </param>
+/// <param name="bFastScan"> 
+/// if it is true, only header lines are parsed by line and the body is scanned by bytes 
+/// to find the measure count, key type and #RANDOM. 
+/// </param>
 /// <returns> return true if all line is correctly saved </returns>
-bool BMSDecryptor::BuildInfoData(BMSInfoData* data, const wchar_t* path) {
-	BMSifstream in(path);
+bool BMSDecryptor::BuildInfoData(BMSInfoData* data, const wchar_t* path, Utility::StringPool& pool, bool bFastScan) {
+	BMSifstream in(path, true);
 	if (!in.IsOpen()) {
 		TRACE("The file does not exist in this path : " + Utility::WideToUTF8(path));
 		return false;
@@ -21,27 +26,34 @@ bool BMSDecryptor::BuildInfoData(BMSInfoData* data, const wchar_t* path) {
 	char prevMeasure[4] = {0,};
 	bool b5key = true, bSingle = true;
 	int player = 1;
-	std::string encodeChecker; encodeChecker.reserve(10240);
+	EncodingDetector detector;	// text fields are checked while they are read
 
 	bool isHeader = true;
-	std::string line; line.reserve(1024);
-	while (in.GetLine(line, true)) {
-		const char* pLine = line.data();
-		// check incorrect line
-		if (*pLine != '#') {
-			continue;
-		}
-		++pLine;
+	std::string header; header.reserve(1024);
+	std::string_view line;
+	while (in.GetCommandLine(line)) {
+		const char* pLine = line.data() + 1;
+		size_t length = line.size() - 1;
 		// separate header line and body line
-		if (isHeader && *pLine == '0') {	// '0' means that measure 000 is start
+		if (isHeader && length > 0 && *pLine == '0') {	// '0' means that measure 000 is start
 			isHeader = false;
+			// the rest of the mapped file follows this line -> scan it at once
+			if (bFastScan && in.IsMapped()) {
+				// the rest is empty if this line is the last one without a newline
+				std::string_view rest = in.ReadToEnd();
+				const char* last = rest.empty() ? line.data() + line.size() : rest.data() + rest.size();
+				ScanBody(line.data(), last, measureCnt, bSingle, b5key, hasRandom);
+				break;
+			}
 		}
 
-		size_t length = line.size() - 1;
 		if (isHeader) {
+			// the line view is not null-terminated. header lines are few, so copy it for the string parser
+			header.assign(pLine, length);
+			pLine = header.c_str();
 			if (Utility::StartsWith(pLine, "WAV") && length > 6) {
 				++wavCnt;
-				encodeChecker.append(pLine + 6);
+				detector.Feed(std::string_view(pLine + 6, length - 6));
 			} else if (Utility::StartsWith(pLine, "BPM") && *(pLine + 3) == ' ') {
 				data->mBpm = data->mMinBpm = data->mMaxBpm = Utility::parseInt(pLine + 4);
 			} else if (Utility::StartsWith(pLine, "PLAYER") && length > 7) {
@@ -52,14 +64,14 @@ bool BMSDecryptor::BuildInfoData(BMSInfoData* data, const wchar_t* path) {
 			} else if (Utility::StartsWith(pLine, "DIFFICULTY") && length > 11) {
 				data->mDifficulty = Utility::parseInt(pLine + 11);
 			} else if (Utility::StartsWith(pLine, "GENRE") && length > 6) {
-				data->mGenre = std::string(pLine + 6);
-				encodeChecker.append(data->mGenre);
+				data->mGenre = pool.Intern(std::string_view(pLine + 6, length - 6));
+				detector.Feed(data->mGenre);
 			} else if (Utility::StartsWith(pLine, "TITLE") && length > 6) {
-				data->mTitle = std::string(pLine + 6);
-				encodeChecker.append(data->mTitle);
+				data->mTitle = pool.Intern(std::string_view(pLine + 6, length - 6));
+				detector.Feed(data->mTitle);
 			} else if (Utility::StartsWith(pLine, "ARTIST") && length > 7) {
-				data->mArtist = std::string(pLine + 7);
-				encodeChecker.append(data->mArtist);
+				data->mArtist = pool.Intern(std::string_view(pLine + 7, length - 7));
+				detector.Feed(data->mArtist);
 			}
 		} else {
 			if (length > 7 && *(pLine + 5) == ':') {
@@ -81,7 +93,7 @@ bool BMSDecryptor::BuildInfoData(BMSInfoData* data, const wchar_t* path) {
 					*(pLine + 3) == (bSingle ? '1' : '2')) {
 					b5key = false;
 				}
-			} else if (!hasRandom && Utility::StartsWith(pLine, "RANDOM")) {
+			} else if (!hasRandom && Utility::StartsWith(std::string_view(pLine, length), "RANDOM")) {
 				hasRandom = true;
 			}
 		}
@@ -99,64 +111,215 @@ bool BMSDecryptor::BuildInfoData(BMSInfoData* data, const wchar_t* path) {
 	// set encoding type
 	EncodingType type = in.GetEncodeType();
 	if (type == EncodingType::UNKNOWN) {
-		type = GetEncodeType(encodeChecker);
+		type = detector.GetResult();
 	}
 	data->mFileType = type;
-	data->mFilePath = std::wstring(path);
+	data->mFilePath = pool.Intern(std::wstring_view(path));
+	Utility::GetFileStat(path, data->mFileTime, data->mFileSize);
 
 	return true;
 }
 
+/// <summary>
+/// scan body bytes in [<paramref name="first"/>, <paramref name="last"/>) without splitting lines.
+/// only the first 7 bytes of each command line are read. <paramref name="first"/> must point to '#' of a command line.
+/// </summary>
+void BMSDecryptor::ScanBody(const char* first, const char* last, uint16_t& measureCnt, bool& bSingle, bool& b5key, bool& hasRandom) {
+	// note : the measure order is not guaranteed in bms file (ex. #RANDOM block), so the whole body is scanned.
+	for (const char* p = first; p != last; p = Utility::FindCommandLine(p + 1, last)) {
+		// correct line -> #00116:0010F211
+		if (last - p > 8 && p[6] == ':' && p[1] >= '0' && p[1] <= '9') {
+			uint16_t measure = Utility::parseInt(p + 1, 3);
+			if (measureCnt < measure) {
+				measureCnt = measure;
+			}
+
+			// check key type. same as the line parser of BuildInfoData
+			if (bSingle && p[4] == '2') {
+				bSingle = false;
+			}
+			if (b5key && (p[5] == '8' || p[5] == '9') && p[4] == (bSingle ? '1' : '2')) {
+				b5key = false;
+			}
+		} else if (!hasRandom && Utility::StartsWith(std::string_view(p + 1, last - p - 1), "RANDOM")) {
+			hasRandom = true;
+		}
+	}
+}
+
 /// <summary>
 /// build using line in <paramref name="lines"/> list for fill data in header or body
 /// </summary>
 /// <param name="bPreview"> Read only information for previewing </param>
 /// <returns> return true if all line is correctly saved </returns>
 bool BMSDecryptor::Build(bool bPreview) {
+	if (!BuildTiming(bPreview)) {
+		return false;
+	}
+	while (BuildNextMeasure());
+	return true;
+}
+
+/// <summary>
+/// parse the file and make the timeline (steps 1 ~ 3 of <see cref="Build"/>). the notes are made by <see cref="BuildNextMeasure"/>
+/// </summary>
+bool BMSDecryptor::BuildTiming(bool bPreview) {
 	// 1. parse raw data line to Object list
 	//    At this stage, the header information is completely organized.
 	clock_t s = clock();
 	// TODO : separate preview and game play
-	if (!ParseToPreviewRaw()) {
-		LOG("The file does not exist in this path : " + Utility::WideToUTF8(mData.mInfo->mFilePath));
+	bool bParsed = ParseToPreviewRaw();
+	// the requested #RANDOM values are for this file only
+	mRandomRequest.clear();
+	if (!bParsed) {
+		LOG("The file does not exist in this path : " + Utility::WideToUTF8(std::wstring(mData.mInfo->mFilePath)));
 		return false;
 	}
 	LOG("raw object make time(ms) : " << clock() - s);
 
-	// 2. Create a list that stores the cumulative number of beats per measure 
-	//	  with the number of measures found when body parsing.
-	s = clock();
-	BeatFraction frac;
-	for (int i = 0; i < mMeasureCount; ++i) {
-		frac += mListBeatInMeasure[i];
-		mData.mListCumulativeBeat[i].Set(frac.mNumerator, frac.mDenominator);
+	MakeTiming();
+	return true;
+}
+
+/// <summary>
+/// build again with the other #RANDOM values without reading the file. the header of <see cref="bms::BMSData"/> is kept
+/// </summary>
+bool BMSDecryptor::Rebuild() {
+	if (!mbBranchParsed) {
+		return false;
+	}
+	clock_t s = clock();
+	mData.ClearNotes();
+	mData.mInfo->mMinBpm = mData.mInfo->mMaxBpm = mData.mInfo->mBpm;
+	SelectBranches();
+	mRandomRequest.clear();
+	LOG("branch select time(ms) : " << clock() - s)
+
+	MakeTiming();
+	while (BuildNextMeasure());
+	return true;
+}
+
+/// <summary>
+/// build all combinations of the #RANDOM values (up to <paramref name="maxVariant"/>) and find the range of the normal note count
+/// </summary>
+bool BMSDecryptor::GetNoteCountRange(int& minCount, int& maxCount, uint32_t maxVariant) {
+	minCount = maxCount = mData.mNoteCount;
+	if (!mbBranchParsed) {
+		return true;
+	}
+
+	// the combinations are counted like an odometer. the statements in the branches not selected make the same chart again
+	std::vector<int> request = std::move(mRandomRequest);
+	std::vector<int> prevValues = mRandomValue;
+	uint64_t prevSeed = mRandomSeed;
+	std::vector<int> values(mListRandom.size(), 1);
+	uint32_t variant = 0;
+	bool bAll = false;
+	while (variant < maxVariant) {
+		mRandomRequest = values;
+		Rebuild();
+		minCount = std::min(minCount, mData.mNoteCount);
+		maxCount = std::max(maxCount, mData.mNoteCount);
+		++variant;
+
+		size_t i = 0;
+		while (i < values.size() && values[i] == mListRandom[i].mRange) {
+			values[i++] = 1;
+		}
+		if (i == values.size()) {
+			bAll = true;
+			break;
+		}
+		++values[i];
 	}
-	LOG("cumulative beat make time(ms) : " << clock() - s)
+
+	// the data of the previous values
+	bool bFixedSeed = mbFixedSeed;
+	mbFixedSeed = true;
+	mRandomSeed = prevSeed;
+	mRandomRequest = std::move(prevValues);
+	Rebuild();
+	mbFixedSeed = bFixedSeed;
+	mRandomRequest = std::move(request);
+	return bAll;
+}
+
+/// <summary>
+/// steps 2 ~ 4 of <see cref="Build"/> with the parsed objects
+/// </summary>
+void BMSDecryptor::MakeTiming() {
+	// 2. Create a list that stores the cumulative number of ticks per measure 
+	//	  with the number of measures found when body parsing, and set the tick of all objects.
+	clock_t s = clock();
+	MakeTickTimeline();
+	LOG("tick timeline make time(ms) : " << clock() - s << ", tick per beat : " << mData.mTickPerBeat)
 
 	// 3. Create a list that stores the change time point. include time, beats, bpm
 	s = clock();
+	mSortTime = std::chrono::steady_clock::duration::zero();
 	MakeTimeSegment();
-	LOG("time segment make time(ms) : " << clock() - s)
+	LOG("time segment make time(ms) : " << clock() - s << ", sort time(us) : " << std::chrono::duration_cast<std::chrono::microseconds>(mSortTime).count())
 
+	mData.mInfo->mTotalTime = GetTotalPlayTime();
+
+	// 4. prepare the note lists. the notes are made measure by measure
+	//	  the end notes of RDM type 2 can be converted to BGM
+	mData.BeginPlaybackTracks(mBgmCount + mNoteCount, mNoteCount);
+	mBuiltMeasure = 0;
+	mSegIndex = 0;
+	std::fill(std::begin(mLastIndex), std::end(mLastIndex), SIZE_MAX);
+	std::fill(std::begin(mPendingEndCount), std::end(mPendingEndCount), 0);
+	if (mData.mLongNoteType == LongnoteType::RDM_TYPE_2 && mEndNoteVal != 0) {
+		for (int i = 0; i < mMeasureCount; ++i) {
+			const ListPool<Object>& objs = mListObj[i];
+			for (uint32_t j = 0; j < objs.size(); ++j) {
+				const Object& obj = objs[j];
+				if (obj.mChannel != Channel::BGM && obj.mChannel < Channel::KEY_INVISIBLE_START && obj.mValue == mEndNoteVal) {
+					++mPendingEndCount[static_cast<int>(obj.mChannel) % 36 - 1];
+				}
+			}
+		}
+	}
+	mNoteListClock = clock();
+}
+
+/// <summary>
+/// make the notes of the next measure and publish them to <see cref="bms::BMSData::mPlayBgm"/> and <see cref="bms::BMSData::mPlayNote"/>.
+/// return false if all measures are built
+/// </summary>
+bool BMSDecryptor::BuildNextMeasure() {
 	// 4. Read a list of objects and create a list that stores information such as time and beats of the note.
-	s = clock();
-	MakeNoteList();
-	LOG("note list make time(ms) : " << clock() - s)
+	if (mBuiltMeasure < mMeasureCount) {
+		MakeMeasureNoteList(mBuiltMeasure++);
+	}
 
-	mData.mInfo->mTotalTime = GetTotalPlayTime();
+	// 5. Publish the notes of the playback tracks.
+	//	  a long note start is held until its end is found, because its type changes
+	if (mBuiltMeasure < mMeasureCount) {
+		size_t limit = mData.mPlayNote.size();
+		for (size_t index : mLastIndex) {
+			limit = std::min(limit, index);
+		}
+		mData.PublishPlaybackTracks(static_cast<uint32_t>(limit), false);
+		return true;
+	}
+	mData.PublishPlaybackTracks(mData.mPlayNote.size(), true);
+	LOG("note list make time(ms) : " << clock() - mNoteListClock << ", note bytes : " << mData.GetNoteBytes())
+	LOG("object sort time(us) : " << std::chrono::duration_cast<std::chrono::microseconds>(mSortTime).count() << ", including the time segments")
 
-	//LOG("total player note num : " << mData.mListPlayerNote.size())
+	//LOG("total player note num : " << mData.mPlayNote.size())
 	LOG("total player normal note num : " << mData.mNoteCount)
 	LOG("total player long note num : " << mData.mLongCount)
 	/*LOG("total player invisible note num : " << [&](int n) ->int {
-		std::vector<PlayerNote>& v = mData.mListPlayerNote;
-		for (int i = 0; i < v.size(); ++i) if (v[i].mType == NoteType::INVISIBLE) ++n;
+		const PlaybackTrack& v = mData.mPlayNote;
+		for (uint32_t i = 0; i < v.size(); ++i) if (v.GetType(i) == NoteType::INVISIBLE) ++n;
 		return n; }(0))
 	LOG("total player landmine note num : " << [&](int n) ->int {
-		std::vector<PlayerNote>& v = mData.mListPlayerNote;
-		for (int i = 0; i < v.size(); ++i) if (v[i].mType == NoteType::LANDMINE) ++n;
+		const PlaybackTrack& v = mData.mPlayNote;
+		for (uint32_t i = 0; i < v.size(); ++i) if (v.GetType(i) == NoteType::LANDMINE) ++n;
 		return n; }(0))*/
-	return true;
+	return false;
 }
 
 /// <summary>
@@ -164,7 +327,7 @@ bool BMSDecryptor::Build(bool bPreview) {
 /// in appropriate variable and temporary data structure
 /// </summary>
 bool BMSDecryptor::ParseToPreviewRaw() noexcept {
-	BMSifstream in((mData.mInfo->mFilePath).data());
+	BMSifstream in((mData.mInfo->mFilePath).data(), true);
 	if (!in.IsOpen()) {
 		return false;
 	}
@@ -177,17 +340,24 @@ bool BMSDecryptor::ParseToPreviewRaw() noexcept {
 
 	// declare instant variable for parse
 	bool hasRandom = mData.mInfo->mHasRandom;
-	bool ignoreLine = false;
-	uint8_t rndDepth = 0, ifDepth = 0;
-	std::stack<int> rndValue;
+	// the branch of the current line (0 : not in #IF) and the open #RANDOM statements
+	uint32_t branch = 0;
+	std::stack<uint32_t> randoms;
+	// an #IF of the top #RANDOM is closed. #ENDIF can be omitted before the next #IF or #ENDRANDOM
+	auto CloseBranch = [&]() {
+		if (branch != 0 && !randoms.empty() && mListBranch[branch].mRandom == randoms.top()) {
+			branch = mListBranch[branch].mParent;
+		}
+	};
 
-	// lambda function that returns a string modified for a file type
-	auto GetUTFString = [](const char* s, EncodingType type) {
-		// TODO : unicode file names other than Japanese will be added later.
+	// lambda function that stores a string converted to UTF-8 for a file type in <out>. no locale is used
+	auto SetUTFString = [](std::string_view s, EncodingType type, std::string& out) {
 		if (type == EncodingType::SHIFT_JIS) {
-			return Utility::ToUTF8(s, Utility::sJpnLoc);
+			Utility::CP932ToUTF8(s, out);
+		} else if (type == EncodingType::EUC_KR) {
+			Utility::CP949ToUTF8(s, out);
 		} else {
-			return std::string(s);
+			out.assign(s);
 		}
 	};
 
@@ -207,22 +377,23 @@ bool BMSDecryptor::ParseToPreviewRaw() noexcept {
 			}
 			c = *++p;
 		}
-		if (bFraction) {
-			int gcd = Utility::GCD(numerator, denominator);
+		// reduced, so that the denominator is small in the tick resolution
+		numerator *= 4;
+		int gcd = Utility::GCD(numerator, denominator);
+		if (gcd > 1) {
 			numerator /= gcd;
 			denominator /= gcd;
 		}
-		return BeatFraction(numerator * 4, denominator);
+		return BeatFraction(numerator, denominator);
 	};
 
 	bool isHeader = true;
 	std::string line; line.reserve(1024);
-	while (in.GetLine(line, true)) {
+	std::string_view command;
+	while (in.GetCommandLine(command)) {
+		// only command lines are copied. the line is modified below, and the parsers need null-terminated string
+		line.assign(command.data(), command.size());
 		const char* pLine = line.data();
-		// check incorrect line
-		if (*pLine != '#') {
-			continue;
-		}
 		++pLine;
 		// separate header line and body line
 		if (isHeader && *pLine == '0') {	// '0' means that measure 000 is start
@@ -235,7 +406,7 @@ bool BMSDecryptor::ParseToPreviewRaw() noexcept {
 			if (Utility::StartsWith(pLine, "WAV") && length > 6) {
 				char* sPoint = &(line[line.size() - 3]);
 				strncpy_s(sPoint, 4, extension, 3);
-				mData.mListWavName[ParseValue(pLine + 3, 36)] = GetUTFString(pLine + 6, encodingType);
+				SetUTFString(std::string_view(pLine + 6, length - 6), encodingType, mData.mListWavName[ParseValue(pLine + 3, 36)]);
 			} else if (Utility::StartsWith(pLine, "BPM") && *(pLine + 3) != ' ' && length > 6) {	// #BPMXX
 				mListBpm[ParseValue(pLine + 3, 36)] = static_cast<float>(Utility::parseFloat(pLine + 6));
 			} else if (Utility::StartsWith(pLine, "STAGEFILE") && length > 10) {
@@ -257,35 +428,29 @@ bool BMSDecryptor::ParseToPreviewRaw() noexcept {
 
 		// body phase
 		if (hasRandom) {
-			// process random conditional statement
-			if (ignoreLine) {
-				if (Utility::StartsWith(pLine, "IF") && length > 3) {
-					++ifDepth;
-				} else if (Utility::StartsWith(pLine, "ENDIF")) {
-					if (ifDepth == rndDepth) {	// if non-ignored line
-						ignoreLine = false;
-					}
-					--ifDepth;
+			// process random conditional statement. all branches are parsed, and the values are decided in SelectBranches
+			if (Utility::StartsWith(pLine, "RANDOM") && length > 7) {
+				mListRandom.push_back(RandomStatement{std::max(Utility::parseInt(pLine + 7), 1), branch});
+				randoms.push(static_cast<uint32_t>(mListRandom.size() - 1));
+				continue;
+			} else if (Utility::StartsWith(pLine, "IF") && length > 3) {
+				if (!randoms.empty()) {
+					CloseBranch();
+					mListBranch.push_back(RandomBranch{branch, randoms.top(), Utility::parseInt(pLine + 3)});
+					branch = static_cast<uint32_t>(mListBranch.size() - 1);
 				}
 				continue;
-			} else if (Utility::StartsWith(pLine, "RANDOM") && length > 7) {
-				rndValue.push(Utility::xorshf96() % Utility::parseInt(pLine + 7));
-				++rndDepth;
+			} else if (Utility::StartsWith(pLine, "ENDIF")) {
+				if (branch != 0) {
+					branch = mListBranch[branch].mParent;
+				}
 				continue;
-			} else if (rndDepth > 0) {
-				if (Utility::StartsWith(pLine, "IF") && length > 3) {
-					if (rndValue.top() != Utility::parseInt(pLine + 3)) {
-						ignoreLine = true;
-					}
-					++ifDepth;
-					continue;
-				} else if (Utility::StartsWith(pLine, "ENDIF")) {
-					--ifDepth;
-					continue;
-				} else if (Utility::StartsWith(pLine, "ENDRANDOM")) {
-					--rndDepth;
-					continue;
+			} else if (Utility::StartsWith(pLine, "ENDRANDOM")) {
+				if (!randoms.empty()) {
+					CloseBranch();
+					randoms.pop();
 				}
+				continue;
 			}
 		}
 
@@ -309,6 +474,10 @@ bool BMSDecryptor::ParseToPreviewRaw() noexcept {
 		// create time signature dictionary for calculate beat
 		uint16_t measure = ((*pLine - '0') * 100) + ((*(pLine + 1) - '0') * 10) + (*(pLine + 2) - '0');
 		if (channel == Channel::MEASURE_LENGTH) {
+			if (hasRandom) {
+				mListBranchLine.push_back(BranchLine{branch, mListBranchObj.size(), measure, 0, GetBeatFraction(pLine + 6)});
+				continue;
+			}
 			mListBeatInMeasure[measure] = GetBeatFraction(pLine + 6);
 			TRACE("Add TimeSignature : " << measure << ", length : " << mListBeatInMeasure[measure].mNumerator << " / " << mListBeatInMeasure[measure].mDenominator);
 			continue;
@@ -324,8 +493,14 @@ bool BMSDecryptor::ParseToPreviewRaw() noexcept {
 		}
 
 		// Separate each beat fragment into objects with information.
-		ListPool<Object>& objs = mListObj[measure];
+		// the lines of the chart with #RANDOM are kept in the branch list, and the selected ones are added by SelectBranches
+		bool isTiming = channel == Channel::CHANGE_BPM || channel == Channel::CHANGE_BPM_BY_KEY || channel == Channel::STOP_BY_KEY;
+		ListPool<Object>& objs = hasRandom ? mListBranchObj : isTiming ? mListRawTiming : mListObj[measure];
 		int item = static_cast<int>(length - 6) / 2;
+		// every division is a divisor of the tick resolution
+		if (mDivisionLcm != 0) {
+			mDivisionLcm = Utility::LCM64(mDivisionLcm, item, MAX_TICK_PER_BEAT);
+		}
 		for (int i = 0; i < item; ++i) {
 			// convert value to base-36, if channel is CHANGE_BPM, convert value to hex
 			uint16_t val = ParseValue(pLine + 6 + i * 2, channel == Channel::CHANGE_BPM ? 16 : 36);
@@ -341,9 +516,9 @@ bool BMSDecryptor::ParseToPreviewRaw() noexcept {
 					objs.push(Object(val, measure, channel, i, item));
 					++mBgmCount;
 				}
-			} else if (channel == Channel::CHANGE_BPM || channel == Channel::CHANGE_BPM_BY_KEY || channel == Channel::STOP_BY_KEY) {
+			} else if (isTiming) {
 				// add object to time segment list
-				mListRawTiming.push(Object(val, measure, channel, i, item));
+				objs.push(Object(val, measure, channel, i, item));
 				++mRawTimingCount;
 			} else {
 				// Override checking is done in another function.
@@ -351,173 +526,287 @@ bool BMSDecryptor::ParseToPreviewRaw() noexcept {
 				++mNoteCount;
 			}
 		}
+		if (hasRandom) {
+			mListBranchLine.push_back(BranchLine{branch, objs.size(), measure, static_cast<uint16_t>(item), BeatFraction()});
+		}
 	}
 
+	if (hasRandom) {
+		mbBranchParsed = true;
+		SelectBranches();
+	}
 	return true;
 }
 
+/// <summary>
+/// decide the values of all #RANDOM statements and fill the object lists with the lines in the selected #IF branches
+/// </summary>
+void BMSDecryptor::SelectBranches() {
+	// 1) the values are drawn for all statements in the order of the file, so a value doesn't depend on the other statements
+	if (!mbFixedSeed) {
+		mRandomSeed = (static_cast<uint64_t>(Utility::xorshf96()) << 32) ^ Utility::xorshf96();
+	}
+	mRandom.Seed(mRandomSeed);
+	mRandomValue.resize(mListRandom.size());
+	for (size_t i = 0; i < mListRandom.size(); ++i) {
+		int range = mListRandom[i].mRange;
+		int value = static_cast<int>(mRandom() % static_cast<uint32_t>(range)) + 1;
+		if (i < mRandomRequest.size() && mRandomRequest[i] >= 1 && mRandomRequest[i] <= range) {
+			value = mRandomRequest[i];
+		}
+		mRandomValue[i] = value;
+	}
+
+	// 2) selected branches. the parent is before the child
+	std::vector<bool> selected(mListBranch.size(), true);
+	for (size_t i = 1; i < mListBranch.size(); ++i) {
+		const RandomBranch& b = mListBranch[i];
+		selected[i] = selected[b.mParent] && mRandomValue[b.mRandom] == b.mValue;
+	}
+
+	// 3) the lines of the selected branches in the order of the file
+	mDivisionLcm = 1;
+	mRawTimingCount = 0;
+	mBgmCount = 0;
+	mNoteCount = 0;
+	mListRawTiming.clear();
+	for (uint16_t i = 0; i < mMeasureCount; ++i) {
+		mListBeatInMeasure[i].Set(4, 1);
+		mListObj[i].clear();
+	}
+	uint32_t first = 0;
+	for (const BranchLine& line : mListBranchLine) {
+		uint32_t last = line.mEnd;
+		if (selected[line.mBranch]) {
+			if (line.mDivision == 0) {
+				mListBeatInMeasure[line.mMeasure] = line.mLength;
+			} else if (mDivisionLcm != 0) {
+				mDivisionLcm = Utility::LCM64(mDivisionLcm, line.mDivision, MAX_TICK_PER_BEAT);
+			}
+			for (uint32_t i = first; i < last; ++i) {
+				const Object& obj = mListBranchObj[i];
+				if (obj.mChannel == Channel::CHANGE_BPM || obj.mChannel == Channel::CHANGE_BPM_BY_KEY || obj.mChannel == Channel::STOP_BY_KEY) {
+					mListRawTiming.push(obj);
+					++mRawTimingCount;
+				} else {
+					mListObj[line.mMeasure].push(obj);
+					++(obj.mChannel == Channel::BGM ? mBgmCount : mNoteCount);
+				}
+			}
+		}
+		first = last;
+	}
+}
+
+/// <summary>
+/// decide the tick resolution and make the cumulative tick list and the ticks of all objects
+/// </summary>
+void BMSDecryptor::MakeTickTimeline() {
+	// 1) resolution = lcm(divisions) * lcm(denominators of measure lengths)
+	//    then index / division * (numerator / denominator) beats is always an integer tick
+	long long denominatorLcm = 1;
+	for (int i = 0; i < mMeasureCount && denominatorLcm != 0; ++i) {
+		denominatorLcm = Utility::LCM64(denominatorLcm, mListBeatInMeasure[i].mDenominator, MAX_TICK_PER_BEAT);
+	}
+	mbExactTick = mDivisionLcm != 0 && denominatorLcm != 0 && mDivisionLcm <= MAX_TICK_PER_BEAT / denominatorLcm;
+	mData.mTickPerBeat = mbExactTick ? mDivisionLcm * denominatorLcm : MAX_TICK_PER_BEAT;
+	if (!mbExactTick) {
+		LOG("tick resolution is limited. ticks are rounded : " << MAX_TICK_PER_BEAT)
+	}
+
+	// 2) cumulative ticks of each measure
+	long long tick = 0;
+	for (int i = 0; i < mMeasureCount; ++i) {
+		const BeatFraction& length = mListBeatInMeasure[i];
+		tick += mbExactTick ? mData.mTickPerBeat / length.mDenominator * length.mNumerator :
+							  std::llround(static_cast<double>(mData.mTickPerBeat) * length.mNumerator / length.mDenominator);
+		mData.mListCumulativeTick[i] = tick;
+	}
+
+	// 3) ticks of all objects. all comparisons after this are integer comparisons
+	for (uint32_t i = 0; i < mListRawTiming.size(); ++i) {
+		Object& obj = mListRawTiming[i];
+		obj.mTick = GetTick(obj.mMeasure, obj.mIndex, obj.mDivision);
+	}
+	for (int i = 0; i < mMeasureCount; ++i) {
+		ListPool<Object>& objs = mListObj[i];
+		for (uint32_t j = 0; j < objs.size(); ++j) {
+			objs[j].mTick = GetTick(i, objs[j].mIndex, objs[j].mDivision);
+		}
+	}
+}
+
 /// <summary>
 /// make time segment list contain <see cref="bms::TimeSegment"/> object
 /// </summary>
 void BMSDecryptor::MakeTimeSegment() {
 	long long curTime = 0;
 	double curBpm = mData.mInfo->mBpm;
-	BeatFraction prevBeat;
+	long long prevTick = 0;
 	mData.mListTimeSeg.resize(mRawTimingCount);
 
 	// push initial time segment
-	mData.mListTimeSeg.push(TimeSegment(0, curBpm, 0, 1));
+	mData.mListTimeSeg.push(TimeSegment(0, curBpm, 0));
 	TRACE("TimeSegment measure : 0, beat : 0, second : 0, bpm : " + std::to_string(curBpm));
 
-	// sort bpm, time-related object list for use as raw TimeSegment struct list
-	mListRawTiming.Sort([](const Object& lhs, const Object& rhs) {
-		return lhs.mMeasure != rhs.mMeasure ? lhs.mMeasure < rhs.mMeasure :
-			 lhs.mFraction != rhs.mFraction ? lhs.mFraction < rhs.mFraction :
+	// sort bpm, time-related object list for use as raw TimeSegment struct list.
+	// each line is pushed in ascending order of ticks, so the lines are merged
+	auto sortStart = std::chrono::steady_clock::now();
+	mListRawTiming.MergeRuns([](const Object& lhs, const Object& rhs) {
+		return lhs.mTick != rhs.mTick ? lhs.mTick < rhs.mTick :
+			   lhs.mMeasure != rhs.mMeasure ? lhs.mMeasure < rhs.mMeasure :
 											  lhs.mChannel < rhs.mChannel;
-	});
+	}, mSortBuffer);
+	mSortTime += std::chrono::steady_clock::now() - sortStart;
 
 	int count = static_cast<int>(mListRawTiming.size());
 	for (int i = 0; i < count; ++i) {
 		Object& obj = mListRawTiming[i];
-		int curMeasure = obj.mMeasure;
 
-		// Beats are only affected by the length of the measure.
-		BeatFraction curBeatSum = GetBeats(curMeasure, obj.mFraction);
-		//curTime += (curBeatSum - prevBeat).GetValue() * 60 / curBpm;
-		long long delta = ((BeatFraction)(curBeatSum - prevBeat)).GetTime(curBpm);
+		// Ticks are only affected by the length of the measure.
+		long long curTick = obj.mTick;
+		long long delta = GetTimeUsingTick(curTick - prevTick, curBpm);
 		curTime += delta;
-		//curTime += ((BeatFraction)(curBeatSum - prevBeat)).GetTime(curBpm);
 
 		if (obj.mChannel == Channel::STOP_BY_KEY && mListStop[obj.mValue] != 0) {
 			// STOP value is the time value of 1/192 of a whole note in 4/4 meter be the unit 1
 			// 48 == 1 beat
-			mData.mListTimeSeg.push(TimeSegment(curTime, 0, curBeatSum.mNumerator, curBeatSum.mDenominator));
-			TRACE("TimeSegment measure : " << curMeasure << ", beat : " << curBeatSum.GetValue() << ", second : " << curTime << ", delta : " << delta << ", bpm : " << 0);
+			mData.mListTimeSeg.push(TimeSegment(curTime, 0, curTick));
+			TRACE("TimeSegment measure : " << obj.mMeasure << ", tick : " << curTick << ", second : " << curTime << ", delta : " << delta << ", bpm : " << 0);
 			// value / 48 = beats to stop, time = beat * (60/bpm), 
 			// --> stop time = (value * 5) / (bpm * 4)
-			TRACE("measure : " << curMeasure << ", obj * value * 5000000ll = " << mListStop[obj.mValue] * 5000000ll << ", curbpm * 4 = " << curBpm * 4 << ", result = " << (mListStop[obj.mValue] * 5000000ll) / (curBpm * 4));
+			TRACE("measure : " << obj.mMeasure << ", obj * value * 5000000ll = " << mListStop[obj.mValue] * 5000000ll << ", curbpm * 4 = " << curBpm * 4 << ", result = " << (mListStop[obj.mValue] * 5000000ll) / (curBpm * 4));
 			delta = static_cast<long long>(std::round((mListStop[obj.mValue] * 5000000ll) / (curBpm * 4)));
 			curTime += delta;
-			mData.mListTimeSeg.push(TimeSegment(curTime, curBpm, curBeatSum.mNumerator, curBeatSum.mDenominator));
+			mData.mListTimeSeg.push(TimeSegment(curTime, curBpm, curTick));
 		} else if (obj.mChannel == Channel::CHANGE_BPM ||
 				  (obj.mChannel == Channel::CHANGE_BPM_BY_KEY && mListBpm[obj.mValue] != 0)) {
 			curBpm = obj.mChannel == Channel::CHANGE_BPM ? obj.mValue : mListBpm[obj.mValue];
 			mData.mInfo->mMinBpm = std::min(mData.mInfo->mMinBpm, curBpm);
 			mData.mInfo->mMaxBpm = std::max(mData.mInfo->mMaxBpm, curBpm);
-			mData.mListTimeSeg.push(TimeSegment(curTime, curBpm, curBeatSum.mNumerator, curBeatSum.mDenominator));
+			mData.mListTimeSeg.push(TimeSegment(curTime, curBpm, curTick));
 		}
 
-		prevBeat = curBeatSum;
-		TRACE("TimeSegment measure : " << curMeasure << ", beat : " << curBeatSum.GetValue() << ", second : " << curTime << ", delta : " << delta << ", bpm : " << curBpm);
+		prevTick = curTick;
+		TRACE("TimeSegment measure : " << obj.mMeasure << ", tick : " << curTick << ", second : " << curTime << ", delta : " << delta << ", bpm : " << curBpm);
 	}
 }
 
 /// <summary>
-/// make note list in <see cref="bms::BMSData::mListTimeSeg"/> vector contain <see cref="bms::Note"/> objects
+/// make note list of measure <paramref name="i"/> in <see cref="bms::BMSData::mPlayBgm"/>, <see cref="bms::BMSData::mPlayNote"/> and <see cref="bms::BMSData::mListPlayerNote"/>.
+/// the measures must be made in ascending order
 /// </summary>
-void BMSDecryptor::MakeNoteList() {
-	mData.mListBgm.resize(mBgmCount);
-	mData.mListPlayerNote.resize(mNoteCount);
+void BMSDecryptor::MakeMeasureNoteList(int i) {
 	// TODO : add logic to remove player notes if they exist on the same channel, same bit
 
+	// check if this measure has information
+	if (mListObj[i].size() == 0) {
+		return;
+	}
+
 	// true if long note type is RDM type 2
 	bool isRDM2 = mData.mLongNoteType == LongnoteType::RDM_TYPE_2;
 	// only work of RDM type 2, true if LNOBJ value is one of the indexes of WAV
 	bool isExistEndWav = mEndNoteVal != 0 && mData.mListWavName[mEndNoteVal] != "";
-	// save each column's last note index. This value is used to determine if this object is a long note.
-	int lastIndex[9] = {0};
-
-	auto addLong = [&](int column, const BeatFraction& bf) {
-		mData.mListPlayerNote[lastIndex[column]].mType = NoteType::LONG;
-		mData.mListPlayerNote[lastIndex[column]].mEndBeat = bf;
-		lastIndex[column] = 0;
+	// save each column's long note start that waits for the end note. This value is used to determine if this object is a long note.
+	size_t* lastIndex = mLastIndex;
+	// current time segment of the sweep. all objects are visited in ascending order of ticks
+	uint32_t& segIndex = mSegIndex;
+
+	auto addLong = [&](int column, long long tick) {
+		// an end note without the start is ignored
+		if (lastIndex[column] == SIZE_MAX) {
+			return;
+		}
+		mData.mPlayNote.SetType(static_cast<uint32_t>(lastIndex[column]), NoteType::LONG);
+		mData.mListPlayerNote[lastIndex[column]].mEndTick = tick;
+		lastIndex[column] = SIZE_MAX;
 		mData.mNoteCount--; mData.mLongCount++;
 	};
-	for (int i = 0; i < mMeasureCount; ++i) {
-		// check if this measure has information
-		if (mListObj[i].size() == 0) {
+
+	ListPool<Object>& objs = mListObj[i];
+	// 1) sort all object list by ascending of ticks. each channel line is already sorted, so merge the lines.
+	//	  stable, so the objects at the same tick keep the order of the lines
+	auto sortStart = std::chrono::steady_clock::now();
+	objs.MergeRuns([](const Object& lhs, const Object& rhs) ->bool { return lhs.mTick < rhs.mTick; }, mSortBuffer);
+	mSortTime += std::chrono::steady_clock::now() - sortStart;
+
+	// 2) Create two lists: a note list that plays sounds and an object list that plays BGA.
+	//	  the time segment moves forward with the objects instead of searching for each object.
+	for (unsigned int j = 0; j < objs.size(); ++j) {
+		Object& obj = objs[j];
+		long long tick = obj.mTick;
+		long long time = GetTimeUsingTick(tick, segIndex);
+		// BG Note list
+		if (obj.mChannel == Channel::BGM) {
+			mData.PushBgm(obj.mValue, time, tick);
+			//TRACE("bgm measure : " << i << ", channel : " << 1 << ", tick : " << tick << ", time : " << time << ", value : " << obj.mValue);
 			continue;
 		}
 
-		ListPool<Object>& objs = mListObj[i];
-		// 1) sort all object list by ascending of beats
-		objs.Sort([](const Object& lhs, const Object& rhs) ->bool { return lhs.mFraction < rhs.mFraction; });
-
-		// 2) Create two lists: a note list that plays sounds and an object list that plays BGA.
-		// TODO : refactor to avoid using GetTimeUsingBeat() functions
-		for (unsigned int j = 0; j < objs.size(); ++j) {
-			Object& obj = objs[j];
-			BeatFraction bf = GetBeats(i, obj.mFraction);
-			// BG Note list
-			if (obj.mChannel == Channel::BGM) {
-				mData.mListBgm.push(Note(obj.mValue, Channel::BGM, GetTimeUsingBeat(bf), bf));
-				//TRACE("bgm measure : " << i << ", channel : " << 1 << ", beat : " << bf.GetValue() << ", time : " << GetTimeUsingBeat(bf) << ", value : " << obj.mValue);
+		// player Note list
+		int intCh = static_cast<int>(obj.mChannel);
+		int column = intCh % 36 - 1;
+		bool bLongNote = obj.mChannel >= Channel::KEY_LONG_START && obj.mChannel < Channel::LANDMINE_START;
+		bool bInvisibleNote = obj.mChannel >= Channel::KEY_INVISIBLE_START && !bLongNote;
+
+		// remove invisible note with no sound data
+		if (bInvisibleNote) {
+			if (mData.mListWavName[obj.mValue] == "") {
 				continue;
 			}
+		}
 
-			// player Note list
-			int intCh = static_cast<int>(obj.mChannel);
-			int column = intCh % 36 - 1;
-			bool bLongNote = obj.mChannel >= Channel::KEY_LONG_START && obj.mChannel < Channel::LANDMINE_START;
-			bool bInvisibleNote = obj.mChannel >= Channel::KEY_INVISIBLE_START && !bLongNote;
-
-			// remove invisible note with no sound data
-			if (bInvisibleNote) {
-				if (mData.mListWavName[obj.mValue] == "") {
-					continue;
-				}
+		// note : RDM type2 shares the long note channel with the normal notes.
+		if (isRDM2) {
+			// It doesn't make sense that RDM type 2 has a long note channel. invalid value -> remove
+			if (bLongNote) {
+				continue;
 			}
-
-			// note : RDM type2 shares the long note channel with the normal notes.
-			if (isRDM2) {
-				// It doesn't make sense that RDM type 2 has a long note channel. invalid value -> remove
-				if (bLongNote) {
-					continue;
-				}
-				// check only visible note. invisible note doesn't have long note.
-				if (obj.mChannel < Channel::KEY_INVISIBLE_START) {
-					// This object is end note of long note -> Do not add to the list.
-					if (obj.mValue == mEndNoteVal) {
-						// convert note object to bgm object if object value is one of the indexes of WAV (always play sound)
-						if (isExistEndWav) {
-							mData.mListBgm.push(Note(obj.mValue, Channel::BGM, GetTimeUsingBeat(bf), bf));
-						}
-						addLong(column, bf);
-						continue;
+			// check only visible note. invisible note doesn't have long note.
+			if (obj.mChannel < Channel::KEY_INVISIBLE_START) {
+				// This object is end note of long note -> Do not add to the list.
+				if (obj.mValue == mEndNoteVal) {
+					// convert note object to bgm object if object value is one of the indexes of WAV (always play sound)
+					if (isExistEndWav) {
+						mData.PushBgm(obj.mValue, time, tick);
 					}
-
-					lastIndex[column] = static_cast<int>(mData.mListPlayerNote.size());
+					--mPendingEndCount[column];
+					addLong(column, tick);
+					continue;
 				}
-			} else {
-				// convert long note channel to normal note channel
-				if (bLongNote) {
-					// This object is end note of long note -> Do not add to the list.
-					if (lastIndex[column] != 0) {
-						addLong(column, bf);
-						continue;
-					}
 
-					lastIndex[column] = static_cast<int>(mData.mListPlayerNote.size());
-					intCh -= 144;	// 36 * 4
-				}
+				// the last note of the column is a long note start only if an end note can follow it
+				lastIndex[column] = mPendingEndCount[column] > 0 ? mData.mPlayNote.size() : SIZE_MAX;
 			}
+		} else {
+			// convert long note channel to normal note channel
+			if (bLongNote) {
+				// This object is end note of long note -> Do not add to the list.
+				if (lastIndex[column] != SIZE_MAX) {
+					addLong(column, tick);
+					continue;
+				}
 
-			// convert variable note channel to normal note channel
-			NoteType type = NoteType::NORMAL;
-			if (intCh / 36 >= 13) {
-				type = NoteType::LANDMINE;
-				intCh -= 432;	// 36 * 12
-			} else if (intCh / 36 >= 3) {
-				type = NoteType::INVISIBLE;
-				intCh -= 72;	// 36 * 2
-			} else {
-				mData.mNoteCount += 1;
+				lastIndex[column] = mData.mPlayNote.size();
+				intCh -= 144;	// 36 * 4
 			}
+		}
 
-			// make note based on the long note information summarized in the above
-			PlayerNote pn(obj.mValue, static_cast<Channel>(intCh), GetTimeUsingBeat(bf), bf, type);
-			TRACE("note measure : " << i << ", channel : " << intCh << ", beat : " << bf.GetValue() << ", time : " << pn.mTime << ", value : " << pn.mKey);
-			mData.mListPlayerNote.push(std::move(pn));
+		// convert variable note channel to normal note channel
+		NoteType type = NoteType::NORMAL;
+		if (intCh / 36 >= 13) {
+			type = NoteType::LANDMINE;
+			intCh -= 432;	// 36 * 12
+		} else if (intCh / 36 >= 3) {
+			type = NoteType::INVISIBLE;
+			intCh -= 72;	// 36 * 2
+		} else {
+			mData.mNoteCount += 1;
 		}
+
+		// make note based on the long note information summarized in the above
+		TRACE("note measure : " << i << ", channel : " << intCh << ", tick : " << tick << ", time : " << time << ", value : " << obj.mValue);
+		mData.PushPlayerNote(obj.mValue, static_cast<Channel>(intCh), time, tick, type);
 	}
 }
\ No newline at end of file
@@ -2,12 +2,17 @@
 
 #include "BMSData.h"
 #include "BMSifstream.h"
+#include "EncodingDetector.h"
 
 #include <algorithm>		// std::min, max, sort
 #include <stack>
 #include <random>
+#include <cstdint>		// SIZE_MAX
 
 namespace bms {
+	/// <summary> the maximum resolution of ticks. if the least common multiple is larger, ticks are rounded at this resolution </summary>
+	constexpr long long MAX_TICK_PER_BEAT = 1ll << 40;
+
 	/// <summary>
 	/// A data structure containing temporary variables and functions required for `bms data` calculations.
 	/// This class is declared as a local variable and will not be saved after the whole process.
@@ -16,7 +21,7 @@ namespace bms {
 	public:
 		// ----- constructor, operator overloading -----
 
-		BMSDecryptor(BMSData& data) : mData(data) {
+		BMSDecryptor(BMSData& data) : mData(data), mRandomSeed(0), mbFixedSeed(false), mbBranchParsed(false), mBuiltMeasure(0), mSegIndex(0), mSortTime(0) {
 			mListStop = new int[MAX_INDEX_LENGTH];
 			mListBpm = new float[MAX_INDEX_LENGTH];
 		};
@@ -34,8 +39,13 @@ namespace bms {
 		/// read file and build for fill data in header. no file dictionary is created.
 		/// Read only information that is displayed on the UI or is helpful when reading information for previewing.
 		/// </summary>
+		/// <param name="pool"> the pool that stores text fields of <paramref name="data"/> </param>
+		/// <param name="bFastScan"> 
+		/// if it is true, only header lines are parsed by line and the body is scanned by bytes 
+		/// to find the measure count, key type and #RANDOM. 
+		/// </param>
 		/// <returns> return true if all line is correctly saved </returns>
-		bool BuildInfoData(BMSInfoData* data, const wchar_t* path);
+		bool BuildInfoData(BMSInfoData* data, const wchar_t* path, Utility::StringPool& pool, bool bFastScan = true);
 
 		/// <summary>
 		/// build using line in <paramref name="lines"/> list for fill data in header or body
@@ -44,6 +54,27 @@ namespace bms {
 		/// <returns> return true if all line is correctly saved </returns>
 		bool Build(bool bPreview);
 		/// <summary>
+		/// the first half of <see cref="Build"/> for streaming. parse all lines and make the timeline, then the notes are made by <see cref="BuildNextMeasure"/>.
+		/// </summary>
+		bool BuildTiming(bool bPreview);
+		/// <summary>
+		/// make the notes of the next measure and publish the finished notes to the playback tracks of <see cref="bms::BMSData"/>.
+		/// it can be called in another thread while the tracks are played. return false if all measures are built
+		/// </summary>
+		bool BuildNextMeasure();
+		/// <summary>
+		/// build again with the other #RANDOM values (<see cref="SetRandomSeed"/>, <see cref="SetRandomValues"/>) without reading the file.
+		/// the branches parsed by the last <see cref="Build"/> are selected, and the header of <see cref="bms::BMSData"/> is kept.
+		/// return false if the last built chart has no #RANDOM
+		/// </summary>
+		bool Rebuild();
+		/// <summary>
+		/// build all combinations of the #RANDOM values (up to <paramref name="maxVariant"/>) with <see cref="Rebuild"/>, and find the range of
+		/// <see cref="bms::BMSData::mNoteCount"/>. call after <see cref="Build"/>. the data is built again with the previous values at the end.
+		/// return false if there are more combinations than <paramref name="maxVariant"/> (the range of the built ones is given)
+		/// </summary>
+		bool GetNoteCountRange(int& minCount, int& maxCount, uint32_t maxVariant = 256);
+		/// <summary>
 		/// parse <paramref name="line"/> for fill header and body data and store parsed line 
 		/// in appropriate variable and temporary data structure
 		/// </summary>
@@ -53,68 +84,104 @@ namespace bms {
 		/// </summary>
 		void MakeTimeSegment();
 		/// <summary>
-		/// make note list in <see cref="bms::BMSData::mListTimeSeg"/> vector contain <see cref="bms::Note"/> objects
+		/// make note list of measure <paramref name="i"/> in <see cref="bms::BMSData::mPlayNote"/> and <see cref="bms::BMSData::mListPlayerNote"/>
+		/// </summary>
+		void MakeMeasureNoteList(int i);
+		/// <summary>
+		/// decide the values of all #RANDOM statements and fill the object lists with the lines in the selected #IF branches
 		/// </summary>
-		void MakeNoteList();
+		void SelectBranches();
 
 		// ----- get, set function -----
 
 		/// <summary>
-		/// check what type <paramref name="str"/> is.
-		/// check order : UTF-8(include english only) -> EUC_KR(expended to CP949) -> Shift-jis(default)
+		/// check what type <paramref name="str"/> is with <see cref="bms::EncodingDetector"/>.
+		/// check order : UTF-8(include english only) -> the only valid one of EUC_KR(expended to CP949) and Shift-jis -> higher score (Shift-jis if same)
 		/// </summary>
-		inline bms::EncodingType GetEncodeType(const std::string& str) {
-			// if english only string, return UTF-8
-			if (Utility::IsValidUTF8(str.data())) {
-				return bms::EncodingType::UTF_8;
-			}
+		inline bms::EncodingType GetEncodeType(std::string_view str) {
+			return EncodingDetector::Detect(str);
+		}
 
-			std::wstring kws = Utility::AnsiToWide(str, Utility::sKorLoc);
-			std::wstring jws = Utility::AnsiToWide(str, Utility::sJpnLoc);
-			// If both locales are converted successfully, it is likely to be Japanese. 
-			// because EUC-KR contains Japanese characters, but Shift-jis does not.
-			if (kws.size() != 0 && jws.size() != 0) {
-				return Utility::WideToAnsi(kws, Utility::sJpnLoc).size() == 0 ?
-						bms::EncodingType::SHIFT_JIS : bms::EncodingType::EUC_KR;
+		/// <summary>
+		/// Function that returns cumulative number of ticks at <paramref name="index"/> / <paramref name="division"/> of <paramref name="measure"/>.
+		/// it is exact integer arithmetic unless the resolution is limited by <see cref="MAX_TICK_PER_BEAT"/>
+		/// </summary>
+		inline long long GetTick(int measure, int index, int division) {
+			if (measure >= mMeasureCount) {
+				return 0;
+			}
+			const BeatFraction& length = mListBeatInMeasure[measure];
+			long long start = measure == 0 ? 0 : mData.mListCumulativeTick[measure - 1];
+			if (mbExactTick) {
+				return start + mData.mTickPerBeat / (static_cast<long long>(division) * length.mDenominator) * index * length.mNumerator;
 			}
+			return start + std::llround(static_cast<double>(index) * length.mNumerator * mData.mTickPerBeat / (static_cast<double>(division) * length.mDenominator));
+		}
 
-			return jws.size() == 0 ? bms::EncodingType::EUC_KR :
-									 bms::EncodingType::SHIFT_JIS;
+		/// <summary> convert <paramref name="tick"/> to time (microsecond) with <paramref name="bpm"/>. time = beat * (60 / bpm) </summary>
+		inline long long GetTimeUsingTick(long long tick, double bpm) const {
+			return std::llround(static_cast<double>(tick) * 60000000.0 / (static_cast<double>(mData.mTickPerBeat) * bpm));
 		}
 
 		/// <summary>
-		/// Function that returns cumulative number of beats at a specific timing
+		/// Function that returns a time at a specific point using ticks. the segment is found by binary search, O(log segments).
+		/// note : Functions that convert time to ticks are not provided because errors can occur during casting.
 		/// </summary>
-		inline BeatFraction GetBeats(int measure, const BeatFraction& frac) {
-			if (measure >= mMeasureCount) {
-				return BeatFraction();
-			} else if (measure == 0) {
-				return frac * mListBeatInMeasure[0];
-			}
-			return frac * mListBeatInMeasure[measure] + mData.mListCumulativeBeat[measure - 1];
+		inline long long GetTimeUsingTick(long long tick) const {
+			return GetTimeUsingSegment(tick, FindTimeSegment(tick));
 		}
 
 		/// <summary>
-		/// Function that returns a time at a specific point using beats.
-		/// note : Functions that convert time to beats are not provided because errors can occur during casting.
+		/// same as <see cref="GetTimeUsingTick(long long)"/>, but the search starts from <paramref name="segIndex"/> and it is updated.
+		/// when the ticks are given in ascending order, all notes and segments are walked only once (merged sweep).
 		/// </summary>
-		inline long long GetTimeUsingBeat(const BeatFraction& beat) {
-			BeatFraction subtract;
-			uint32_t index = static_cast<uint32_t>(mData.mListTimeSeg.size()) - 1;
-			for (; index > 0; --index) {
-				const TimeSegment& t = mData.mListTimeSeg[index];
-				subtract = beat - t.mCurBeat;
-				// zero bpm means stop signal. skip it.
-				if (subtract >= 0) {
-					break;
+		inline long long GetTimeUsingTick(long long tick, uint32_t& segIndex) const {
+			const uint32_t count = mData.mListTimeSeg.size();
+			if (segIndex >= count || tick < mData.mListTimeSeg[segIndex].mCurTick) {
+				segIndex = FindTimeSegment(tick);
+			} else {
+				while (segIndex + 1 < count && tick >= mData.mListTimeSeg[segIndex + 1].mCurTick) {
+					++segIndex;
 				}
 			}
+			return GetTimeUsingSegment(tick, segIndex);
+		}
 
-			// previous saved time + current segment time. if index equals to length, add reversed sign
-			const TimeSegment& prev = mData.mListTimeSeg[index];
+		/// <summary>
+		/// the #RANDOM values are drawn from <paramref name="seed"/> at each build, so the same seed selects the same branches.
+		/// if it is not set, a new seed is drawn at each build
+		/// </summary>
+		inline void SetRandomSeed(uint64_t seed) {
+			mRandomSeed = seed;
+			mbFixedSeed = true;
+		}
+		/// <summary> draw a new seed at each build (default) </summary>
+		inline void ClearRandomSeed() {
+			mbFixedSeed = false;
+		}
+		/// <summary> the seed used by the last build </summary>
+		inline uint64_t GetRandomSeed() const {
+			return mRandomSeed;
+		}
+		/// <summary>
+		/// fix the #RANDOM values of the next build (<see cref="Build"/>, <see cref="BuildTiming"/> or <see cref="Rebuild"/>) only, so they are not applied to another file.
+		/// <paramref name="values"/>[i] is the value of the i-th #RANDOM statement in the file (1 ~ range). 0 or the value out of range is drawn from the seed
+		/// </summary>
+		inline void SetRandomValues(std::vector<int> values) {
+			mRandomRequest = std::move(values);
+		}
+		/// <summary> the values of all #RANDOM statements selected by the last build, in the order of the file </summary>
+		inline const std::vector<int>& GetRandomValues() const {
+			return mRandomValue;
+		}
+		/// <summary> the number of #RANDOM statements of the last built chart </summary>
+		inline uint32_t GetRandomCount() const {
+			return static_cast<uint32_t>(mListRandom.size());
+		}
 
-			return index == 0 ? beat.GetTime(prev.mCurBpm) :
-								prev.mCurTime + subtract.GetTime(prev.mCurBpm);
+		/// <summary> return the time of the end of the measures built by <see cref="BuildNextMeasure"/> </summary>
+		inline long long GetBuiltTime() {
+			return mBuiltMeasure == 0 ? 0 : GetTimeUsingTick(mData.mListCumulativeTick[mBuiltMeasure - 1]);
 		}
 
 		/// <summary>
@@ -122,14 +189,78 @@ namespace bms {
 		/// </summary>
 		inline long long GetTotalPlayTime() {
 			const TimeSegment& seg = mData.mListTimeSeg[mData.mListTimeSeg.size() - 1];
-			BeatFraction subtract = mData.mListCumulativeBeat[mMeasureCount - 1] - seg.mCurBeat;
-
-			return seg.mCurTime + subtract.GetTime(seg.mCurBpm);
+			return seg.mCurTime + GetTimeUsingTick(mData.mListCumulativeTick[mMeasureCount - 1] - seg.mCurTick, seg.mCurBpm);
 		}
 
 	private:
 		BMSData& mData;
 
+		/// <summary>
+		/// return the index of the last time segment that starts at or before <paramref name="tick"/> (0 if none).
+		/// the stop segment has the same tick as the next segment, so the next one is found.
+		/// </summary>
+		inline uint32_t FindTimeSegment(long long tick) const {
+			uint32_t low = 1, high = mData.mListTimeSeg.size();
+			while (low < high) {
+				uint32_t mid = (low + high) / 2;
+				if (mData.mListTimeSeg[mid].mCurTick <= tick) {
+					low = mid + 1;
+				} else {
+					high = mid;
+				}
+			}
+			return low - 1;
+		}
+
+		/// <summary> previous saved time + current segment time </summary>
+		inline long long GetTimeUsingSegment(long long tick, uint32_t index) const {
+			const TimeSegment& prev = mData.mListTimeSeg[index];
+			return prev.mCurTime + GetTimeUsingTick(tick - prev.mCurTick, prev.mCurBpm);
+		}
+
+		/// <summary>
+		/// scan body bytes in [<paramref name="first"/>, <paramref name="last"/>) without splitting lines.
+		/// only the first 7 bytes of each command line are read. <paramref name="first"/> must point to '#' of a command line.
+		/// </summary>
+		void ScanBody(const char* first, const char* last, uint16_t& measureCnt, bool& bSingle, bool& b5key, bool& hasRandom);
+		/// <summary> steps 2 ~ 4 of <see cref="Build"/> with the parsed objects </summary>
+		void MakeTiming();
+
+		/// <summary> a #RANDOM statement </summary>
+		struct RandomStatement {
+			int mRange;						// the value is 1 ~ mRange
+			uint32_t mBranch;				// the branch that contains this statement
+		};
+		/// <summary> an #IF branch. it is selected if the value of mRandom is mValue and the parent branch is selected </summary>
+		struct RandomBranch {
+			uint32_t mParent;
+			uint32_t mRandom;				// index of mListRandom
+			int mValue;
+		};
+		/// <summary> a body line of the chart with #RANDOM </summary>
+		struct BranchLine {
+			uint32_t mBranch;				// 0 : not in #IF
+			uint32_t mEnd;					// the objects of this line are [the previous line's mEnd, mEnd) of mListBranchObj
+			uint16_t mMeasure;
+			uint16_t mDivision;				// 0 : measure length line
+			BeatFraction mLength;			// the length of the measure length line
+		};
+
+		// -- #RANDOM. the body lines of the chart with #RANDOM are parsed once with all branches, and selected by SelectBranches
+
+		uint64_t mRandomSeed;
+		bool mbFixedSeed;
+		/// <summary> true if the branches of the current data are parsed </summary>
+		bool mbBranchParsed;
+		Utility::Xorshf96 mRandom;
+		std::vector<int> mRandomRequest;
+		std::vector<int> mRandomValue;
+		std::vector<RandomStatement> mListRandom;
+		/// <summary> the first one is the root (not in #IF). the parent is always before the child </summary>
+		std::vector<RandomBranch> mListBranch;
+		std::vector<BranchLine> mListBranchLine;
+		ListPool<Object> mListBranchObj;
+
 		/// <summary> The number of total measure of current bms data </summary>
 		uint16_t mMeasureCount;
 		/// <summary> 
@@ -138,6 +269,11 @@ namespace bms {
 		/// </summary>
 		uint16_t mEndNoteVal;
 
+		/// <summary> the least common multiple of the divisions of all object lines. 0 if it is larger than <see cref="MAX_TICK_PER_BEAT"/> </summary>
+		long long mDivisionLcm;
+		/// <summary> false if the tick resolution is limited and ticks are rounded </summary>
+		bool mbExactTick;
+
 		uint32_t mRawTimingCount;
 		uint32_t mBgmCount;
 		uint32_t mNoteCount;
@@ -145,6 +281,20 @@ namespace bms {
 		ListPool<Object> mListRawTiming;
 		/// <summary> a list of data objects (smallest unit), the index is measure number </summary>
 		std::vector<ListPool<Object>> mListObj;
+		/// <summary> working memory of <see cref="bms::ListPool::MergeRuns"/>, reused by all measures and builds </summary>
+		std::vector<Object> mSortBuffer;
+
+		/// <summary> the number of measures whose notes are made </summary>
+		int mBuiltMeasure;
+		/// <summary> the time segment of the last made note </summary>
+		uint32_t mSegIndex;
+		/// <summary> each column's index of the long note start that waits for the end note (SIZE_MAX : none) </summary>
+		size_t mLastIndex[9];
+		/// <summary> RDM type 2 : each column's end notes not made yet. a note of a column without them is never a long note start </summary>
+		uint32_t mPendingEndCount[9];
+		clock_t mNoteListClock;
+		/// <summary> the time spent in <see cref="bms::ListPool::MergeRuns"/> of the current build. clock() is too coarse for a measure </summary>
+		std::chrono::steady_clock::duration mSortTime;
 
 		/// <summary> a list of STOP command data, the index is STOP command number </summary>
 		int* mListStop;
@@ -158,10 +308,19 @@ namespace bms {
 		void Reset(uint16_t measureCount) {
 			mMeasureCount = measureCount;
 			mEndNoteVal = 0;
+			mDivisionLcm = 1;
+			mbExactTick = true;
+			mBuiltMeasure = 0;
+			mSegIndex = 0;
 			mRawTimingCount = 0;
 			mBgmCount = 0;
 			mNoteCount = 0;
 			mListRawTiming.clear();
+			mbBranchParsed = false;
+			mListRandom.clear();
+			mListBranch.assign(1, RandomBranch{0, 0, 0});
+			mListBranchLine.clear();
+			mListBranchObj.clear();
 
 			memset(mListStop, 0, sizeof(int) * MAX_INDEX_LENGTH);
 			memset(mListBpm, 0, sizeof(float) * MAX_INDEX_LENGTH);
@@ -175,6 +334,12 @@ namespace bms {
 			}
 		}
 
+		/// <summary>
+		/// decide <see cref="bms::BMSData::mTickPerBeat"/> with the divisions and the measure lengths, 
+		/// and make the cumulative tick list and the ticks of all objects
+		/// </summary>
+		void MakeTickTimeline();
+
 		/// <summary> parse function to change the value between "00" and "zz" to integer base <paramref name="radix"/> with no error check </summary>
 		inline uint16_t ParseValue(const char* val, const uint16_t radix) noexcept {
 			bool bFirstLoop = false;
@@ -64,6 +64,12 @@ namespace bms {
 		BPM_DEC,
 	};
 
+	/// <summary> specify how the query text of <see cref="bms::SearchIndex"/> is matched with title, artist and genre </summary>
+	enum class SearchMode : uint8_t {
+		SUBSTRING,	// the query appears anywhere in the field
+		PREFIX,		// the field or a word in the field starts with the query
+	};
+
 	/// <summary> specify note type </summary>
 	enum class NoteType : uint8_t {
 		NORMAL,
@@ -4,6 +4,8 @@
 #include "BMSEnums.h"
 #include "Serializer.h"
 
+#include <atomic>
+
 namespace bms {
 	/// <summary>
 	/// Data structure inheriting fraction structure for beat calculation
@@ -24,13 +26,12 @@ namespace bms {
 	/// a data structure that store change timing point include sec, bpm, beats at a certain point
 	/// </summary>
 	struct TimeSegment {
-		TimeSegment() : mCurTime(0), mCurBpm(0) {}
-		TimeSegment(long long time, double bpm, int beatNum, int beatDenum) :
-					mCurTime(time), mCurBpm(bpm), mCurBeat(beatNum, beatDenum) {}
+		TimeSegment() : mCurTime(0), mCurBpm(0), mCurTick(0) {}
+		TimeSegment(long long time, double bpm, long long tick) : mCurTime(time), mCurBpm(bpm), mCurTick(tick) {}
 
 		long long mCurTime;				// the time at which bpm changes (include start point)
 		double mCurBpm;					// the value of beat per minute. if it is stop point, the value is 0
-		BeatFraction mCurBeat;			// the beat at which bpm changes (include start point)
+		long long mCurTick;				// the tick at which bpm changes (include start point). beat = tick / BMSData::mTickPerBeat
 	};
 
 	/// <summary>
@@ -38,14 +39,16 @@ namespace bms {
 	/// smallest unit in this data. music only + note + option
 	/// </summary>
 	struct Object {
-		Object() : mValue(0), mMeasure(0), mChannel(Channel::BGM) {}
+		Object() : mValue(0), mMeasure(0), mChannel(Channel::BGM), mIndex(0), mDivision(1), mTick(0) {}
 		Object(int val, int measure, Channel channel, int fracIndex, int fracDenom) :
-			mValue(val), mMeasure(measure), mChannel(channel), mFraction(fracIndex, fracDenom) {}
+			mValue(val), mMeasure(measure), mChannel(channel), mIndex(static_cast<uint16_t>(fracIndex)), mDivision(static_cast<uint16_t>(fracDenom)), mTick(0) {}
 
 		int mValue;						// the raw value of the BMS object
 		int mMeasure;					// the measure number, starting at 0 (corresponds to `#000`)
 		Channel mChannel;				// value of Channel enum
-		BeatFraction mFraction;			// the beat fraction inside the measure
+		uint16_t mIndex;				// the position inside the measure is mIndex / mDivision
+		uint16_t mDivision;
+		long long mTick;				// the tick from the start of the chart. it is set after all lines are parsed
 	};
 
 
@@ -54,8 +57,8 @@ namespace bms {
 	/// include file info, time, beat, Channel
 	/// </summary>
 	struct Note {
-		Note() : mKey(0), mChannel(Channel::BGM), mTime(0) {}
-		Note(int key, Channel ch, long long time, const BeatFraction& beat) : mKey(key), mChannel(ch), mTime(time), mBeat(beat) {}
+		Note() : mKey(0), mChannel(Channel::BGM), mTick(0), mTime(0) {}
+		Note(int key, Channel ch, long long time, long long tick) : mKey(key), mChannel(ch), mTick(tick), mTime(time) {}
 		Note(const Note&) = default;
 		Note& operator=(const Note&) = default;
 		Note(Note&&) noexcept = default;
@@ -64,29 +67,28 @@ namespace bms {
 		int mKey;
 		//std::string mFilename;
 		Channel mChannel;
-		BeatFraction mBeat;
+		long long mTick;		// beat = tick / BMSData::mTickPerBeat
 		long long mTime;
 	};
 
 	/// <summary>
 	/// a data structure represents an object visible to the player on tracks on the screen
-	/// include base note, end beat(if it is long note), visibility
+	/// include channel and end tick (if it is long note). time, tick, key and type are in <see cref="bms::PlaybackTrack"/> at the same index
 	/// </summary>
-	struct PlayerNote : Note {
+	struct PlayerNote {
 		// ----- constructor, operator overloading -----
 
-		PlayerNote() : Note(), mType(NoteType::NORMAL) {}
-		PlayerNote(int key, Channel ch, long long time, const BeatFraction& beat, NoteType type) : Note(key, ch, time, beat), mType(type) {}
-		PlayerNote(const PlayerNote& other) : 
-			Note(other), mType(other.mType), mEndBeat(other.mEndBeat) {}
+		PlayerNote() : mChannel(Channel::BGM), mEndTick(0) {}
+		PlayerNote(Channel ch) : mChannel(ch), mEndTick(0) {}
+		PlayerNote(const PlayerNote& other) = default;
 		PlayerNote& operator=(const PlayerNote& other) = default;
-		PlayerNote(PlayerNote&& other) : 
-			Note(other), mType(other.mType), mEndBeat(other.mEndBeat) {}
+		PlayerNote(PlayerNote&& other) noexcept = default;
+		PlayerNote& operator=(PlayerNote&&) noexcept = default;
 
-		NoteType mType;			// tells what this note describes
-		BeatFraction mEndBeat;	// if object indicate long note, this variable has non-zero value
+		Channel mChannel;
+		long long mEndTick;		// if object indicate long note, this variable has non-zero value
 
-		inline bool IsLongNote() { return mEndBeat.mNumerator != 0; }
+		inline bool IsLongNote() { return mEndTick != 0; }
 	};
 
 	/// <summary>
@@ -121,6 +123,17 @@ namespace bms {
 		inline void clear() noexcept {
 			mCount = 0;
 		}
+		/// <summary> use the first <paramref name="count"/> elements as they are. they are written through <see cref="data"/> </summary>
+		inline void set_size(uint32_t count) {
+			resize(count);
+			mCount = count;
+		}
+		inline T* data() noexcept {
+			return mList.data();
+		}
+		inline const T* data() const noexcept {
+			return mList.data();
+		}
 
 		T& operator[](const uint32_t pos) {
 			return mList[pos];
@@ -152,57 +165,197 @@ namespace bms {
 		void Sort(const TFunc& func) {
 			std::sort(mList.begin(), mList.begin() + mCount, func);
 		}
+
+		/// <summary>
+		/// stable natural merge sort for the data that is pushed as ascending runs (e.g. one run per channel line).
+		/// the adjacent runs are merged in pairs until one run is left, so it is linear if the data is already sorted and O(n log runs) otherwise.
+		/// <paramref name="buffer"/> is the working memory that can be reused by the next call.
+		/// </summary>
+		template<typename TFunc>
+		void MergeRuns(const TFunc& func, std::vector<T>& buffer) {
+			if (mCount < 2) {
+				return;
+			}
+			buffer.resize(mList.size());
+			while (true) {
+				uint32_t first = 0, runCount = 0;
+				while (first < mCount) {
+					uint32_t middle = first + 1;
+					while (middle < mCount && !func(mList[middle], mList[middle - 1])) {
+						++middle;
+					}
+					uint32_t last = middle == mCount ? middle : middle + 1;
+					while (last < mCount && !func(mList[last], mList[last - 1])) {
+						++last;
+					}
+					if (first == 0 && middle == mCount) {
+						return;		// one run is left
+					}
+					std::merge(std::make_move_iterator(mList.begin() + first), std::make_move_iterator(mList.begin() + middle),
+							   std::make_move_iterator(mList.begin() + middle), std::make_move_iterator(mList.begin() + last),
+							   buffer.begin() + first, func);
+					first = last;
+					++runCount;
+				}
+				mList.swap(buffer);
+				if (runCount == 1) {
+					return;
+				}
+			}
+		}
+	};
+
+	/// <summary>
+	/// A packed structure-of-arrays list of the notes : time, tick, key and type (19 bytes per note).
+	/// The play loop only reads time, key and type, so they are stored in separate contiguous arrays.
+	/// it is the only storage of these fields. the channel and the end tick of the player notes are in <see cref="bms::PlayerNote"/> at the same index.
+	/// It can be filled by one thread while another thread plays it : the producer pushes within the reserved capacity and 
+	/// calls <see cref="Publish"/>, and the consumer reads only the first <see cref="GetReadyCount"/> notes.
+	/// </summary>
+	class PlaybackTrack {
+	public:
+		/// <summary> lane of the notes that are not on the track (BGM) </summary>
+		static constexpr uint8_t BGM_LANE = 0x0F;
+
+		PlaybackTrack() : mReadyCount(0), mbComplete(false) {}
+		DISALLOW_COPY_AND_ASSIGN(PlaybackTrack)
+		PlaybackTrack(PlaybackTrack&& other) noexcept :
+			mTime(std::move(other.mTime)), mTick(std::move(other.mTick)), mKey(std::move(other.mKey)), mFlag(std::move(other.mFlag)),
+			mReadyCount(other.mReadyCount.load()), mbComplete(other.mbComplete.load()) {}
+		PlaybackTrack& operator=(PlaybackTrack&& other) noexcept {
+			mTime = std::move(other.mTime);
+			mTick = std::move(other.mTick);
+			mKey = std::move(other.mKey);
+			mFlag = std::move(other.mFlag);
+			mReadyCount = other.mReadyCount.load();
+			mbComplete = other.mbComplete.load();
+			return *this;
+		}
+
+		/// <summary> remove all notes. the memory is kept for the next chart. it must not be played while clearing </summary>
+		inline void clear() noexcept {
+			mTime.clear();
+			mTick.clear();
+			mKey.clear();
+			mFlag.clear();
+			mReadyCount.store(0, std::memory_order_relaxed);
+			mbComplete.store(false, std::memory_order_relaxed);
+		}
+		inline void reserve(uint32_t capacity) {
+			mTime.reserve(capacity);
+			mTick.reserve(capacity);
+			mKey.reserve(capacity);
+			mFlag.reserve(capacity);
+		}
+		inline uint32_t size() const noexcept {
+			return static_cast<uint32_t>(mTime.size());
+		}
+		/// <summary> the reserved number of notes. it is the final size while the streaming build fills the track </summary>
+		inline uint32_t capacity() const noexcept {
+			return static_cast<uint32_t>(mTime.capacity());
+		}
+
+		inline void push(long long time, long long tick, int key, NoteType type, uint8_t lane) {
+			mTime.push_back(time);
+			mTick.push_back(tick);
+			mKey.push_back(static_cast<uint16_t>(key));
+			mFlag.push_back(static_cast<uint8_t>(static_cast<uint8_t>(type) << 4 | (lane & 0x0F)));
+		}
+		/// <summary> change the type of the note that is not published yet (ex. the start of a long note when its end is found) </summary>
+		inline void SetType(uint32_t pos, NoteType type) {
+			mFlag[pos] = static_cast<uint8_t>(static_cast<uint8_t>(type) << 4 | (mFlag[pos] & 0x0F));
+		}
+
+		inline long long GetTime(uint32_t pos) const {
+			return mTime[pos];
+		}
+		/// <summary> beat = tick / BMSData::mTickPerBeat </summary>
+		inline long long GetTick(uint32_t pos) const {
+			return mTick[pos];
+		}
+		inline uint16_t GetKey(uint32_t pos) const {
+			return mKey[pos];
+		}
+		inline NoteType GetType(uint32_t pos) const {
+			return static_cast<NoteType>(mFlag[pos] >> 4);
+		}
+		/// <summary> return the column of the player note (0 : scratch or key 1 ~), or <see cref="BGM_LANE"/> </summary>
+		inline uint8_t GetLane(uint32_t pos) const {
+			return mFlag[pos] & 0x0F;
+		}
+		/// <summary>
+		/// make the first <paramref name="count"/> pushed notes visible to the consumer. the notes after them can be still changed.
+		/// <paramref name="bComplete"/> is true if no more notes are pushed and <paramref name="count"/> is the size
+		/// </summary>
+		inline void Publish(uint32_t count, bool bComplete) {
+			mReadyCount.store(count, std::memory_order_release);
+			if (bComplete) {
+				mbComplete.store(true, std::memory_order_release);
+			}
+		}
+		/// <summary> return the number of notes that can be read </summary>
+		inline uint32_t GetReadyCount() const {
+			return mReadyCount.load(std::memory_order_acquire);
+		}
+		/// <summary> return true if all notes are published. check this before <see cref="GetReadyCount"/> to get the final count </summary>
+		inline bool IsComplete() const {
+			return mbComplete.load(std::memory_order_acquire);
+		}
+
+		/// <summary> return the bytes used by the notes </summary>
+		inline size_t GetBytes() const {
+			return mTime.size() * (sizeof(long long) * 2 + sizeof(uint16_t) + sizeof(uint8_t));
+		}
+
+		friend void WriteToBinaryImpl(std::ostream& os, const PlaybackTrack& v);
+		friend void ReadFromBinaryImpl(std::istream& is, PlaybackTrack& v);
+
+	private:
+		std::vector<long long> mTime;	// microsecond
+		std::vector<long long> mTick;
+		std::vector<uint16_t> mKey;		// wav index
+		std::vector<uint8_t> mFlag;		// NoteType << 4 | lane
+		std::atomic<uint32_t> mReadyCount;
+		std::atomic<bool> mbComplete;
 	};
 
 	// -- bms struct serializer overriding --
 
-	//inline void WriteToBinaryImpl(std::ostream& os, const bms::BeatFraction& v) {
-	//	if (!os.write(reinterpret_cast<const char*>(&v), sizeof(bms::BeatFraction))) {
-	//		throw std::ios_base::failure(std::string{"writing type 'bms::BeatFraction' failed"});
-	//	}
-	//}
-	//inline void ReadFromBinaryImpl(std::istream& is, bms::BeatFraction& v) {
-	//	if (!is.read(reinterpret_cast<char*>(&v), sizeof(bms::BeatFraction))) {
-	//		throw std::ios_base::failure(std::string{"reading type 'bms::BeatFraction' failed"});
-	//	}
-	//}
-
-	//inline void WriteToBinaryImpl(std::ostream& os, const bms::TimeSegment& v) {
-	//	if (!os.write(reinterpret_cast<const char*>(&v), sizeof(bms::TimeSegment))) {
-	//		throw std::ios_base::failure(std::string{"writing type 'bms::TimeSegment' failed"});
-	//	}
-	//	/*WriteToBinary<long long>(os, v.mCurTime);
-	//	WriteToBinary<double>(os, v.mCurBpm);
-	//	WriteToBinary<bms::BeatFraction>(os, v.mCurBeat);*/
-	//}
-	//inline void ReadFromBinaryImpl(std::istream& is, bms::TimeSegment& v) {
-	//	if (!is.read(reinterpret_cast<char*>(&v), sizeof(bms::TimeSegment))) {
-	//		throw std::ios_base::failure(std::string{"reading type 'bms::TimeSegment' failed"});
-	//	}
-	//	/*v.mCurTime = ReadFromBinary<long long>(is);
-	//	v.mCurBpm = ReadFromBinary<double>(is);
-	//	v.mCurBeat = ReadFromBinary<bms::BeatFraction>(is);*/
-	//}
-
-	//inline void WriteToBinaryImpl(std::ostream& os, const bms::Note& v) {
-	//	if (!os.write(reinterpret_cast<const char*>(&v), sizeof(bms::Note))) {
-	//		throw std::ios_base::failure(std::string{"writing type 'bms::Note' failed"});
-	//	}
-	//}
-	//inline void ReadFromBinaryImpl(std::istream& is, bms::Note& v) {
-	//	if (!is.read(reinterpret_cast<char*>(&v), sizeof(bms::Note))) {
-	//		throw std::ios_base::failure(std::string{"reading type 'bms::Note' failed"});
-	//	}
-	//}
-
-	//inline void WriteToBinaryImpl(std::ostream& os, const bms::PlayerNote& v) {
-	//	if (!os.write(reinterpret_cast<const char*>(&v), sizeof(bms::PlayerNote))) {
-	//		throw std::ios_base::failure(std::string{"writing type 'bms::PlayerNote' failed"});
-	//	}
-	//}
-	//inline void ReadFromBinaryImpl(std::istream& is, bms::PlayerNote& v) {
-	//	if (!is.read(reinterpret_cast<char*>(&v), sizeof(bms::PlayerNote))) {
-	//		throw std::ios_base::failure(std::string{"reading type 'bms::PlayerNote' failed"});
-	//	}
-	//}
+	static_assert(IsBulkSerializable<TimeSegment> && IsBulkSerializable<Note> && IsBulkSerializable<PlayerNote>,
+				  "the objects of the compiled chart are written as raw bytes");
+
+	/// <summary> write the used elements of <paramref name="v"/> at once. the format is the same as std::vector </summary>
+	template<class T>
+	inline void WriteToBinaryImpl(std::ostream& os, const ListPool<T>& v) {
+		static_assert(IsBulkSerializable<T>, "ListPool is written as raw bytes");
+		WriteToBinary<uint32_t>(os, v.size());
+		WriteBulkToBinary(os, v.data(), v.size());
+	}
+	template<class T>
+	inline void ReadFromBinaryImpl(std::istream& is, ListPool<T>& v) {
+		static_assert(IsBulkSerializable<T>, "ListPool is read as raw bytes");
+		uint32_t count = ReadLengthFromBinary(is);
+		v.clear();
+		v.resize(count);
+		ReadBulkFromBinary(is, v.data(), count);
+		v.set_size(count);
+	}
+	/// <summary> write all notes of <paramref name="v"/> array by array </summary>
+	inline void WriteToBinaryImpl(std::ostream& os, const PlaybackTrack& v) {
+		WriteToBinary(os, v.mTime);
+		WriteToBinary(os, v.mTick);
+		WriteToBinary(os, v.mKey);
+		WriteToBinary(os, v.mFlag);
+	}
+	/// <summary> read the notes written by <see cref="WriteToBinaryImpl"/> and publish all of them. it must not be played while reading </summary>
+	inline void ReadFromBinaryImpl(std::istream& is, PlaybackTrack& v) {
+		ReadFromBinary(is, v.mTime);
+		ReadFromBinary(is, v.mTick);
+		ReadFromBinary(is, v.mKey);
+		ReadFromBinary(is, v.mFlag);
+		if (v.mTick.size() != v.mTime.size() || v.mKey.size() != v.mTime.size() || v.mFlag.size() != v.mTime.size()) {
+			throw std::ios_base::failure("playback track arrays have different sizes");
+		}
+		v.Publish(v.size(), true);
+	}
 }
\ No newline at end of file
@@ -1,6 +1,11 @@
 #pragma once
 
+#include "AudioBackend.h"
+#include "PlaybackStats.h"
+#include "SoundLoader.h"
+#if USE_FMOD
 #include "FMODWrapper.h"
+#endif
 
 #include <chrono>
 #include <condition_variable>
@@ -8,6 +13,7 @@
 #include <future>
 #include <unordered_set>
 #include <array>
+#include <memory>
 
 using namespace std::chrono_literals;	// for using std::this_thread::sleep_for() function
 namespace bms {
@@ -22,16 +28,29 @@ namespace bms {
 	/// </summary>
 	constexpr int MAX_ERROR_RANGE = 2000000 / FRAMERATE;
 	/// <summary>
+	/// The time that the sounds are requested ahead when the backend can schedule them (<see cref="AudioBackend::CanSchedule"/>). unit = microseconds
+	/// The backend starts them at the exact sample of its audio clock, so the timing doesn't depend on the frames of the play thread.
+	/// </summary>
+	constexpr int LOOK_AHEAD_TIME = 50000;
+	/// <summary>
+	/// Frequency of refresh time checks when the sounds are scheduled.
+	/// a frame can be late up to <see cref="LOOK_AHEAD_TIME"/> - 1 / framerate (current : 30 milliseconds) without losing the timing
+	/// </summary>
+	constexpr auto SCHEDULE_FRAMERATE = 50;
+	/// <summary>
 	/// Minimum playable time that can be guaranteed when loading music asynchronously. unit = microseconds
 	/// After the loop starts, it guarantees playback until at least this time, even if no music is loaded. = By this time, the music is loaded synchronously.
 	/// </summary>
 	constexpr int ASYNC_READY_TIME = 5000000;
-	/// <summary>
-	/// The number of threads to use when generating the sound. It must not be lower than the minimum value of 1.
-	/// caution : Since there are 2 lists, the thread is created twice. ex) value = 1 -> the number of thread = 2
-	/// TODO : use std::thread::hardware_concurrency()
-	/// </summary>
-	constexpr int THREAD_NUM_FOR_LOADING = 2;
+
+	/// <summary> the default audio backend of the player. FMOD if USE_FMOD is 1, otherwise the sounds are only recorded </summary>
+	inline std::unique_ptr<AudioBackend> CreateAudioBackend() {
+#if USE_FMOD
+		return std::make_unique<FMODWrapper>();
+#else
+		return std::make_unique<RecordingBackend>();
+#endif
+	}
 
 	/// <summary>
 	/// A class that manages threads for playing music
@@ -39,119 +58,114 @@ namespace bms {
 	/// </summary>
 	class PlayThread {
 	public:
-		PlayThread(BMSData& data) : mData(data), mStop(true) {
-			// initialize FMOD library
-			mFMOD.Init();
+		PlayThread(BMSData& data, std::unique_ptr<AudioBackend> audio = CreateAudioBackend()) : mData(data), mStop(true), mbSchedule(false), mAudio(std::move(audio)), mbStatsFinished(true) {
+			// initialize the sound system
+			mAudio->Init();
 		} 
 		~PlayThread() {
 			std::cout << "PlayThread destructor" << std::endl;
 			ForceEnd();
+			WaitForStatsWrite();
 		}
 
 		inline bool IsPlaying() {
 			return !mStop && mPlayThread.joinable();
 		}
 
-		/// <summary>
-		/// Ask the wrapper to generate the sounds in <paramref name="folderPath"/> and put it in <see cref="mDicSound"/> dictionary.
-		/// </summary>
-		void CreateSounds(const std::string& folderPath) {
-			clock_t s = clock();
+		inline AudioBackend& GetAudioBackend() {
+			return *mAudio;
+		}
 
-			// terminate prevthread if it activated
-			ForceEndLoadingThread();
+		/// <summary> the timing records of the current or the last play. it can be read while playing </summary>
+		inline const PlaybackStats& GetStats() const {
+			return mStats;
+		}
 
-			// Up to a certain time, music files are loaded synchronously to ensure playback.
-			std::unordered_set<int> syncSounds;
-			int bgmCount = 0, noteCount = 0;
-			mLoadingChecker.fill({});
-			while (bgmCount < mMaxBgmCount && mData.mListBgm[bgmCount].mTime < ASYNC_READY_TIME)
-				syncSounds.insert(mData.mListBgm[bgmCount++].mKey);
-			while (noteCount < mMaxNoteCount && mData.mListPlayerNote[noteCount].mTime < ASYNC_READY_TIME)
-				syncSounds.insert(mData.mListPlayerNote[noteCount++].mKey);
-
-			for (int key : syncSounds) {
-				std::string dicVal = mData.mListWavName[key];
-				if (dicVal == "") continue;
-				mFMOD.CreateSound(folderPath + dicVal, key);
-				mLoadingChecker[key] = true;
-			}
-			LOG("FMOD sync sound create time(ms) : " << clock() - s)
+		/// <summary>
+		/// the records are written to the csv file of <paramref name="path"/> at the end of each play by another thread, so the play thread doesn't wait for the disk.
+		/// empty means no file. set before <see cref="Play"/>
+		/// </summary>
+		inline void SetStatsCsvPath(const std::wstring& path) {
+			mStatsCsvPath = path;
+		}
 
-			//LOG("mFuture init value : " << mFuture[0].valid())
-			mLoadingController = true;
-			for (int i = 0; i < THREAD_NUM_FOR_LOADING; ++i) {
-				mFuture[i * 2] = std::async(std::launch::async, &PlayThread::AsyncSoundLoad, this, folderPath, true, bgmCount + i);
-				mFuture[i * 2 + 1] = std::async(std::launch::async, &PlayThread::AsyncSoundLoad, this, folderPath, false, noteCount + i);
+		/// <summary> wait until the csv file of the last play is written </summary>
+		inline void WaitForStatsWrite() {
+			if (mStatsWrite.valid()) {
+				mStatsWrite.get();
 			}
-			//LOG("mFuture deferred value : " << mFuture[0].valid())
+		}
 
-			/*for (std::pair<int, std::string> element : dic) {
-				if (syncSounds.count(element.first) == 0) {
-					mFMOD.CreateSoundAsync(folderPath + element.second, element.first);
-				}
-			}*/
+		/// <summary>
+		/// Ask the loader to generate the sounds in <paramref name="folderPath"/> in the order of the first use.
+		/// the sounds before <see cref="ASYNC_READY_TIME"/> are created before it returns, and the rest are created by the loader while playing.
+		/// </summary>
+		void CreateSounds(const std::string& folderPath) {
+			clock_t s = clock();
+			mLoader.Start(*mAudio, mData, folderPath);
+			// Up to a certain time, music files are loaded before playing to ensure playback.
+			mLoader.WaitUntilReady(ASYNC_READY_TIME);
+			LOG("sync sound create time(ms) : " << clock() - s << ", loading threads : " << mLoader.GetThreadCount())
 		}
 
 		/// <summary>
-		/// Function that terminates the loading thread immediately
+		/// Function that stops the loader. the sound being created is finished before it returns
 		/// </summary>
 		void ForceEndLoadingThread() {
-			if (!mLoadingController) {
-				return;
-			}
-
-			mLoadingController = false;
-			for (int i = 0; i < THREAD_NUM_FOR_LOADING * 2; ++i) {
-				try {
-					mFuture[i].get();
-				} catch (const std::exception& e) {
-					std::cout << "future.get() exception : " << e.what() << std::endl;
-				}
-			}
+			mLoader.Cancel();
 		}
 
 		/// <summary>
-		/// function to create a thread and play music by reading <see cref="mData"/> of <see cref="BMS::BMSData"/>
+		/// function to create a thread and play music by reading <see cref="mData"/> of <see cref="BMS::BMSData"/>.
+		/// the playback tracks can be still filled by the streaming build. 
+		/// the time from <paramref name="requestTime"/> to the first sound is logged
 		/// </summary>
-		void Play() {
+		void Play(std::chrono::steady_clock::time_point requestTime = std::chrono::steady_clock::now()) {
 			// terminate if the thread is alive
 			ForceEnd();
 
 			mNoteIndex = 0;
 			mBgmIndex = 0;
-			if (!mFMOD.IsInitialized()) {
-				LOG("FMOD system initialize failed");
+			mRequestTime = requestTime;
+			mbFirstSound = true;
+			if (!mAudio->IsInitialized()) {
+				LOG("audio backend initialize failed");
 				return;
 			}
+			mbSchedule = mAudio->CanSchedule();
 
 			clock_t s = clock();
 			// initialization. preloading sound files
-			std::wstring filePath = mData.mInfo->mFilePath;
+			std::wstring filePath(mData.mInfo->mFilePath);
 			std::string utfPath = Utility::WideToUTF8(filePath.substr(0, filePath.find_last_of(L'/'))) + '/';
-			mMaxBgmCount = static_cast<int>(mData.mListBgm.size());
-			mMaxNoteCount = static_cast<int>(mData.mListPlayerNote.size());
+			mMaxBgmCount = static_cast<int>(mData.mPlayBgm.GetReadyCount());
+			mMaxNoteCount = static_cast<int>(mData.mPlayNote.GetReadyCount());
 			CreateSounds(utfPath);
 
-			LOG("FMOD sound create time(ms) : " << clock() - s)
+			LOG("sound create time(ms) : " << clock() - s)
 
 			mDuration = std::chrono::microseconds(mData.mInfo->mTotalTime + 500000ll);
+			ResetStats(mDuration.count() * (mbSchedule ? SCHEDULE_FRAMERATE : FRAMERATE) / 1000000 + 1);
 			// music start
 			mStop = false;
 			// reference : https://stackoverflow.com/questions/35897617/c-loop-with-fixed-delta-time-on-a-background-thread
 			// if you use member function to thread -> mThread = std::thread(&PlayThread::func, this);
 			mPlayThread = std::thread([&]() {
-				using delta = std::chrono::duration<std::int64_t, std::ratio<1, FRAMERATE>>;
-				auto next = std::chrono::steady_clock::now() + delta{1};
+				// the scheduled sounds are started by the audio clock, so the thread wakes up less often
+				const std::chrono::microseconds delta(1000000 / (mbSchedule ? SCHEDULE_FRAMERATE : FRAMERATE));
+				auto next = std::chrono::steady_clock::now() + delta;
 				std::unique_lock<std::mutex> lock(mMutex);
 				// originally : framerate time , modified : accumulated time
 				//auto prev = std::chrono::steady_clock::now();
 				auto start = std::chrono::steady_clock::now();
+				if (mbSchedule) {
+					mAudio->StartClock();
+				}
 				while (!mStop) {
 					mMutex.unlock();
-					// Do stuff
+					// Do stuff. the time of the play is the audio clock if the sounds are scheduled on it
 					auto now = std::chrono::steady_clock::now();
-					std::chrono::microseconds timeDelta =
+					std::chrono::microseconds timeDelta = mbSchedule ? std::chrono::microseconds(mAudio->GetClockTime()) :
 						std::chrono::duration_cast<std::chrono::microseconds>(now - start);
 
 					/*if (mDuration < timeDelta) {
@@ -159,13 +173,26 @@ namespace bms {
 					}*/
 
 					Update(timeDelta);
+					// the end of the song. the thread keeps running until ForceEnd, but the frames after it are not recorded
+					bool bRecord = !mbStatsFinished;
+					if (bRecord && timeDelta > mDuration) {
+						FinishStats();
+						bRecord = false;
+					}
 
 					//prev = now;
 					//std::cout << "working: actual delta = " << timeDelta.count() << "s\n";
 					// Wait for the next frame
 					mMutex.lock();
+					if (bRecord && std::chrono::steady_clock::now() > next) {
+						mStats.AddOverrun();
+					}
 					mConditionVar.wait_until(lock, next, [] {return false; });
-					next += delta{1};
+					if (bRecord) {
+						mStats.AddWake(std::chrono::duration_cast<std::chrono::microseconds>(next - start).count(),
+									   std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
+					}
+					next += delta;
 				}
 			});
 
@@ -175,12 +202,31 @@ namespace bms {
 		}
 
 		/// <summary>
-		/// function called every 1 / <see cref="FRAMERATE"/> seconds within the thread
+		/// play the tracks without the thread and the sound loading. <see cref="Update"/> is called at each time of <paramref name="frameTimes"/> (microseconds),
+		/// so the triggers are the same in every run. it is used with the backends that don't need sound files (ex. <see cref="bms::RecordingBackend"/>)
+		/// </summary>
+		void PlayOffline(const std::vector<long long>& frameTimes) {
+			ForceEnd();
+			mNoteIndex = 0;
+			mBgmIndex = 0;
+			mbFirstSound = false;
+			mbSchedule = mAudio->CanSchedule();
+			ResetStats(0);
+			for (long long time : frameTimes) {
+				Update(std::chrono::microseconds(time));
+			}
+			FinishStats();
+		}
+
+		/// <summary>
+		/// function called every 1 / <see cref="FRAMERATE"/> seconds within the thread.
+		/// if the sounds are scheduled, it is called every 1 / <see cref="SCHEDULE_FRAMERATE"/> seconds and requests the sounds until <see cref="LOOK_AHEAD_TIME"/> later
 		/// </summary>
 		/// <param name="delta"> The time accumulated to call this function in all cycle. </param>
 		void Update(std::chrono::microseconds cDelta) {
 			long long deltaVal = cDelta.count();
 			long long minTime = deltaVal - MAX_ERROR_RANGE;
+			long long untilTime = mbSchedule ? deltaVal + LOOK_AHEAD_TIME : deltaVal;
 
 			// original versiont
 			//while (mBgmIndex < mMaxBgmIndex && mListBgm[mBgmIndex].mTime < deltaVal) {
@@ -188,30 +234,41 @@ namespace bms {
 			//	//std::cout << "bgm play : " << mBgmIndex << std::endl;
 			//	mBgmIndex++;
 			//}
+			// only the published notes are played. the notes that are published too late are out of the error range
+			const PlaybackTrack& bgm = mData.mPlayBgm;
+			mMaxBgmCount = static_cast<int>(bgm.GetReadyCount());
 			while (mBgmIndex < mMaxBgmCount) {
-				Note& note = mData.mListBgm[mBgmIndex];
-				if (note.mTime >= deltaVal) {
+				long long time = bgm.GetTime(mBgmIndex);
+				if (time >= untilTime) {
 					break;
 				}
 				// music outside the error range is not played.
-				if (note.mTime > minTime) {
-					mFMOD.PlaySingleSound(note.mKey);
+				if (time > minTime) {
+					PlayKeySound(bgm.GetKey(mBgmIndex), time, deltaVal);
+				} else {
+					mStats.AddTrigger(bgm.GetKey(mBgmIndex), time, deltaVal, deltaVal, TriggerStatus::DROPPED);
 				}
 				mBgmIndex++;
 			}
+			const PlaybackTrack& notes = mData.mPlayNote;
+			mMaxNoteCount = static_cast<int>(notes.GetReadyCount());
 			while (mNoteIndex < mMaxNoteCount) {
-				PlayerNote& note = mData.mListPlayerNote[mNoteIndex];
-				if (note.mTime >= deltaVal) {
+				long long time = notes.GetTime(mNoteIndex);
+				if (time >= untilTime) {
 					break;
 				}
 				// play note (landmine doesn't have own sound == mute)
-				if (note.mType != NoteType::LANDMINE && note.mTime > minTime) {
-					mFMOD.PlaySingleSound(note.mKey);
+				if (notes.GetType(mNoteIndex) != NoteType::LANDMINE) {
+					if (time > minTime) {
+						PlayKeySound(notes.GetKey(mNoteIndex), time, deltaVal);
+					} else {
+						mStats.AddTrigger(notes.GetKey(mNoteIndex), time, deltaVal, deltaVal, TriggerStatus::DROPPED);
+					}
 				}
 				mNoteIndex++;
 			}
 
-			mFMOD.Update();
+			mAudio->Update();
 		}
 
 		/// <summary>
@@ -230,8 +287,12 @@ namespace bms {
 				std::lock_guard<std::mutex> lock(mMutex);
 				mStop = true;
 			}
-			mFMOD.ReleaseAllSounds();
 			mPlayThread.join();
+			// release after the join so the play thread never plays a released sound
+			mAudio->ReleaseAllSounds();
+			if (!mbStatsFinished) {
+				FinishStats();
+			}
 		}
 	private:
 		bool mStop;
@@ -240,46 +301,78 @@ namespace bms {
 		std::thread mPlayThread;
 		std::chrono::microseconds mDuration;	// max thread duration
 
-		bool mLoadingController;				// check if loading thread is working. set value to false if you want to terminate loading thread
-		std::array<bool, 1297> mLoadingChecker;	// An array that stores whether a sound file with its index as a key value has been loaded
-		std::mutex mLoadingMutex;
-		std::future<bool> mFuture[THREAD_NUM_FOR_LOADING * 2];
+		SoundLoader mLoader;					// creates the sounds of the play in the order of the first use
 
 		BMSData& mData;
 		int mNoteIndex;							// used for note list looping
 		int mBgmIndex;							// used for bgm list looping
 
-		int mMaxNoteCount;
+		int mMaxNoteCount;						// the number of published notes
 		int mMaxBgmCount;
 
-		FMODWrapper mFMOD;
+		std::chrono::steady_clock::time_point mRequestTime;	// the time when the play is requested
+		bool mbFirstSound;						// true until the first sound is played
+		bool mbSchedule;						// true if the sounds are scheduled on the audio clock of the backend
 
+		std::unique_ptr<AudioBackend> mAudio;
 
+		PlaybackStats mStats;
+		std::wstring mStatsCsvPath;				// the csv file of the stats. empty means no file
+		std::future<void> mStatsWrite;			// writes the csv file of the last play
+		bool mbStatsFinished;					// true if the stats of the play are logged
 
 		/// <summary>
-		/// function that defines a task for loading sound files asynchronously. it is an argument to std::async object
-		/// bIsBgm value is true when loop is BGM, false when loop is player note
+		/// play the sound of <paramref name="key"/>. <paramref name="time"/> is the time of the note in the chart
+		/// and <paramref name="playTime"/> is the current time of the play. the future sound is scheduled, and the late one is played now
 		/// </summary>
-		bool AsyncSoundLoad(const std::string& folderPath, bool bIsBgm, int startPoint) {
-			int max = bIsBgm ? mMaxBgmCount : mMaxNoteCount;
-			while (startPoint < max && mLoadingController) {
-				int key = bIsBgm ? mData.mListBgm[startPoint].mKey : mData.mListPlayerNote[startPoint].mKey;
-				std::string dicVal = mData.mListWavName[key];
-				mLoadingMutex.lock();
-				// already created or no sound object -> skip
-				if (mLoadingChecker[key] || dicVal == "") {
-					startPoint += THREAD_NUM_FOR_LOADING;
-					mLoadingMutex.unlock();
-				} else {
-					mLoadingChecker[key] = true;
-					mLoadingMutex.unlock();
-					mFMOD.CreateSound(folderPath + dicVal, key);
-					startPoint += THREAD_NUM_FOR_LOADING;
+		inline void PlayKeySound(int key, long long time, long long playTime) {
+			// the sound that is not created yet is not heard
+			if (mLoader.IsActive() && !mLoader.IsReady(key) && !mData.mListWavName[key].empty()) {
+				mStats.AddMissing();
+			}
+			if (mbSchedule && time > playTime) {
+				// the start is measured by the audio clock of the backend
+				long long startTime = mAudio->ScheduleSound(key, time, playTime);
+				mStats.AddTrigger(key, time, playTime, startTime, TriggerStatus::SCHEDULED);
+			} else {
+				mAudio->PlaySingleSound(key, time, playTime);
+				mStats.AddTrigger(key, time, playTime, playTime, TriggerStatus::PLAYED);
+			}
+			if (mbFirstSound) {
+				mbFirstSound = false;
+				auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - mRequestTime);
+				if (time > playTime) {
+					elapsed += std::chrono::microseconds(time - playTime);
 				}
+				LOG("time to first sound(ms) : " << elapsed.count() / 1000 << ", note time(ms) : " << time / 1000
+					<< ", startup delay(ms) : " << (elapsed.count() - time) / 1000)
 			}
+		}
+
+		/// <summary> clear the stats for a new play. the triggers of all notes and <paramref name="frameCount"/> frames are reserved </summary>
+		void ResetStats(long long frameCount) {
+			WaitForStatsWrite();
+			mStats.Reset(mData.mPlayBgm.capacity() + mData.mPlayNote.capacity(), static_cast<size_t>(std::max(frameCount, 0ll)));
+			mbStatsFinished = false;
+		}
 
-			printf("terminate %s thread \n", bIsBgm ? "BGM" : "Note");
-			return true;
+		/// <summary>
+		/// log the summary of the stats and start to write the csv file if <see cref="mStatsCsvPath"/> is set.
+		/// the file is written by another thread, and the next <see cref="ResetStats"/> waits for it
+		/// </summary>
+		void FinishStats() {
+			mbStatsFinished = true;
+			PlaybackSummary s = mStats.GetSummary();
+			LOG("played : " << s.mPlayedCount << ", scheduled : " << s.mScheduledCount << ", dropped : " << s.mDroppedCount << ", missing sounds : " << s.mMissingCount << ", overrun frames : " << s.mOverrunCount
+				<< ", lateness p50/p99/max(us) : " << s.mLateness.mP50 << " / " << s.mLateness.mP99 << " / " << s.mLateness.mMax
+				<< ", wake jitter p50/p99/max(us) : " << s.mWakeJitter.mP50 << " / " << s.mWakeJitter.mP99 << " / " << s.mWakeJitter.mMax)
+			if (!mStatsCsvPath.empty()) {
+				mStatsWrite = std::async(std::launch::async, [this, path = mStatsCsvPath]() {
+					if (!mStats.WriteCsv(path)) {
+						LOG("playback stats write failed : " << Utility::WideToUTF8(path))
+					}
+				});
+			}
 		}
 	};
 }
\ No newline at end of file
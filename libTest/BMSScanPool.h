@@ -0,0 +1,146 @@
+#pragma once
+
+#include "BMSDecryptor.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace bms {
+	/// <summary>
+	/// The number of threads to build <see cref="bms::BMSInfoData"/> when scanning the library.
+	/// zero means std::thread::hardware_concurrency()
+	/// </summary>
+	constexpr unsigned SCAN_THREAD_NUM = 0;
+
+	/// <summary>
+	/// a job that builds one <see cref="bms::BMSInfoData"/>. the result is written to <see cref="mInfo"/> directly,
+	/// so the owner can place the object in the final container before the job is done.
+	/// </summary>
+	struct ScanJob {
+		BMSInfoData* mInfo;
+		std::wstring mPath;
+	};
+
+	/// <summary>
+	/// A work-stealing thread pool that calls <see cref="bms::BMSDecryptor::BuildInfoData"/>.
+	/// Jobs are pushed by one thread (directory enumeration) in round robin, each worker pops from the front of its own queue
+	/// and steals from the back of other queues when it is empty. Each worker has its own decryptor state.
+	/// Text fields of the built objects are stored in <paramref name="stringPool"/> shared by all workers.
+	/// </summary>
+	class ScanPool {
+	public:
+		ScanPool(Utility::StringPool& stringPool, unsigned threadCount = SCAN_THREAD_NUM) :
+			mStringPool(stringPool), mClosed(false), mQueued(0), mNext(0) {
+			if (threadCount == 0) {
+				threadCount = std::max(1u, std::thread::hardware_concurrency());
+			}
+			mWorkers.reserve(threadCount);
+			for (unsigned i = 0; i < threadCount; ++i) {
+				mWorkers.emplace_back(std::make_unique<Worker>());
+			}
+			for (unsigned i = 0; i < threadCount; ++i) {
+				mWorkers[i]->mThread = std::thread(&ScanPool::Work, this, i);
+			}
+		}
+		~ScanPool() {
+			Wait();
+		}
+		DISALLOW_COPY_AND_ASSIGN(ScanPool)
+
+		inline size_t GetThreadCount() const {
+			return mWorkers.size();
+		}
+
+		/// <summary> add a job that fills <paramref name="info"/> with the file of <paramref name="path"/> </summary>
+		void Push(BMSInfoData* info, const std::wstring& path) {
+			Worker& worker = *mWorkers[mNext++ % mWorkers.size()];
+			{
+				std::lock_guard<std::mutex> lock(worker.mMutex);
+				worker.mJobs.push_back(ScanJob{info, path});
+			}
+			// increase in the wait mutex so that an idle worker does not miss the notification
+			{
+				std::lock_guard<std::mutex> lock(mWaitMutex);
+				++mQueued;
+			}
+			mCondition.notify_one();
+		}
+
+		/// <summary> close the pool and wait until all pushed jobs are done. no job can be pushed after this call. </summary>
+		void Wait() {
+			{
+				std::lock_guard<std::mutex> lock(mWaitMutex);
+				mClosed = true;
+			}
+			mCondition.notify_all();
+			for (auto& worker : mWorkers) {
+				if (worker->mThread.joinable()) {
+					worker->mThread.join();
+				}
+			}
+		}
+
+	private:
+		struct Worker {
+			Worker() : mDecryptor(mData) {}
+
+			std::mutex mMutex;				// guards mJobs
+			std::deque<ScanJob> mJobs;
+			BMSData mData;					// dummy data for the decryptor. BuildInfoData doesn't use it
+			BMSDecryptor mDecryptor;
+			std::thread mThread;
+		};
+
+		Utility::StringPool& mStringPool;
+		bool mClosed;						// true if no more job is pushed
+		std::atomic<int> mQueued;			// the number of jobs in all queues
+		size_t mNext;						// the worker index that receives the next job
+		std::mutex mWaitMutex;
+		std::condition_variable mCondition;
+		std::vector<std::unique_ptr<Worker>> mWorkers;
+
+		/// <summary> pop a job from own queue, or steal one from the back of other queues </summary>
+		bool Pop(size_t index, ScanJob& job) {
+			size_t count = mWorkers.size();
+			for (size_t i = 0; i < count; ++i) {
+				Worker& worker = *mWorkers[(index + i) % count];
+				std::lock_guard<std::mutex> lock(worker.mMutex);
+				if (worker.mJobs.empty()) {
+					continue;
+				}
+				if (i == 0) {
+					job = std::move(worker.mJobs.front());
+					worker.mJobs.pop_front();
+				} else {
+					job = std::move(worker.mJobs.back());
+					worker.mJobs.pop_back();
+				}
+				--mQueued;
+				return true;
+			}
+			return false;
+		}
+
+		/// <summary> loop of worker thread of <paramref name="index"/> </summary>
+		void Work(size_t index) {
+			Worker& worker = *mWorkers[index];
+			ScanJob job;
+			while (true) {
+				if (Pop(index, job)) {
+					worker.mDecryptor.BuildInfoData(job.mInfo, job.mPath.c_str(), mStringPool);
+					continue;
+				}
+
+				std::unique_lock<std::mutex> lock(mWaitMutex);
+				mCondition.wait(lock, [this] { return mClosed || mQueued > 0; });
+				if (mClosed && mQueued == 0) {
+					break;
+				}
+			}
+		}
+	};
+}
\ No newline at end of file
@@ -0,0 +1,560 @@
+#pragma once
+
+#include "BMSData.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <unordered_map>
+
+namespace bms {
+	constexpr auto SEARCH_FILE_NAME = "bmssearch.bin";
+	constexpr uint32_t SEARCH_VERSION = 1;
+
+	/// <summary> conditions of the facets of <see cref="bms::SearchIndex::Search"/>. default values match all charts </summary>
+	struct SearchFilter {
+		uint8_t mMinLevel;
+		uint8_t mMaxLevel;
+		uint8_t mDifficultyMask;		// bit n means difficulty n (0 : undefined ~ 5 : insane)
+		uint8_t mKeyTypeMask;			// bit n means KeyType n
+		double mMinBpm;
+		double mMaxBpm;
+
+		SearchFilter() : mMinLevel(0), mMaxLevel(UINT8_MAX), mDifficultyMask(UINT8_MAX), mKeyTypeMask(UINT8_MAX), mMinBpm(0), mMaxBpm(DBL_MAX) {}
+
+		inline bool IsDefault() const {
+			return mMinLevel == 0 && mMaxLevel == UINT8_MAX && mDifficultyMask == UINT8_MAX && mKeyTypeMask == UINT8_MAX &&
+				   mMinBpm <= 0 && mMaxBpm == DBL_MAX;
+		}
+	};
+
+	/// <summary> a fixed-size bit set of document ids </summary>
+	struct SearchBitmap {
+		std::vector<uint64_t> mWords;
+
+		inline void Resize(size_t count) {
+			mWords.resize((count + 63) / 64, 0);
+		}
+		inline void Set(uint32_t index) {
+			if (index / 64 >= mWords.size()) {
+				mWords.resize(index / 64 + 1, 0);
+			}
+			mWords[index / 64] |= 1ull << (index % 64);
+		}
+		inline bool Test(uint32_t index) const {
+			return index / 64 < mWords.size() && (mWords[index / 64] >> (index % 64) & 1);
+		}
+		inline void Or(const SearchBitmap& other) {
+			if (mWords.size() < other.mWords.size()) {
+				mWords.resize(other.mWords.size(), 0);
+			}
+			for (size_t i = 0; i < other.mWords.size(); ++i) {
+				mWords[i] |= other.mWords[i];
+			}
+		}
+		inline void And(const SearchBitmap& other) {
+			for (size_t i = 0; i < mWords.size(); ++i) {
+				mWords[i] &= i < other.mWords.size() ? other.mWords[i] : 0;
+			}
+		}
+	};
+
+	/// <summary>
+	/// An in-memory search index of title, artist and genre of <see cref="bms::BMSInfoData"/> objects.
+	/// Text is converted to UTF-8 and normalized (lower case, full-width ASCII, katakana -> hiragana, spaces),
+	/// then every code point trigram of each field is indexed. Each field is padded with two null code points,
+	/// so a query of one or two code points is a range of trigram keys. Candidates are verified with the normalized text.
+	/// Level, difficulty, key type and bpm range are filtered with bitmaps.
+	/// The index is a sorted table (key -> postings) and documents added after building are kept in a small hash map
+	/// until the table is built again.
+	/// </summary>
+	class SearchIndex {
+		static constexpr size_t FIELD_COUNT = 3;		// title, artist, genre
+		static constexpr size_t DIFFICULTY_COUNT = 8;
+		static constexpr size_t KEY_TYPE_COUNT = 6;
+		static constexpr size_t COMPACT_MIN_COUNT = 4096;	// the minimum document count in the hash map to build the table again
+		static constexpr double BPM_BUCKETS[] = {90, 120, 150, 180, 210, 240};	// upper bound of each bpm bucket except the last one
+		static constexpr size_t BPM_BUCKET_COUNT = sizeof(BPM_BUCKETS) / sizeof(double) + 1;
+
+	public:
+		SearchIndex() = default;
+		DISALLOW_COPY_AND_ASSIGN(SearchIndex)
+
+		inline size_t GetCount() const {
+			return mListInfo.size();
+		}
+
+		/// <summary> remove all documents </summary>
+		void Clear() {
+			mListInfo.clear();
+			mText.clear();
+			mTextOffset.assign(1, 0);
+			mGramKey.clear();
+			mGramOffset.assign(1, 0);
+			mPosting.clear();
+			mDeltaPosting.clear();
+			mIndexedCount = 0;
+			mLevelBitmap.clear();
+			for (auto& bitmap : mDifficultyBitmap) bitmap.mWords.clear();
+			for (auto& bitmap : mKeyTypeBitmap) bitmap.mWords.clear();
+			for (auto& bitmap : mBpmBitmap) bitmap.mWords.clear();
+		}
+
+		/// <summary> build the index of <paramref name="list"/> at once </summary>
+		void Build(const std::vector<BMSInfoData*>& list) {
+			Clear();
+			mListInfo.reserve(list.size());
+			for (BMSInfoData* info : list) {
+				AddDocument(info);
+			}
+			BuildTable();
+		}
+
+		/// <summary> add <paramref name="info"/> to the index. the table is built again if many documents are added </summary>
+		void Add(BMSInfoData* info) {
+			uint32_t doc = AddDocument(info);
+			std::vector<uint64_t> grams;
+			GetGrams(doc, grams);
+			for (uint64_t key : grams) {
+				mDeltaPosting[key].emplace_back(doc);
+			}
+
+			size_t deltaCount = mListInfo.size() - mIndexedCount;
+			if (deltaCount >= COMPACT_MIN_COUNT && deltaCount >= mIndexedCount / 2) {
+				BuildTable();
+			}
+		}
+
+		/// <summary>
+		/// return the charts whose title, artist or genre matches <paramref name="query"/> (UTF-8) and <paramref name="filter"/>.
+		/// an empty query matches all charts. the result is in the order of addition and has <paramref name="maxCount"/> charts at most (0 : no limit)
+		/// </summary>
+		std::vector<BMSInfoData*> Search(std::string_view query, const SearchFilter& filter = SearchFilter(),
+										 SearchMode mode = SearchMode::SUBSTRING, size_t maxCount = 0) const {
+			std::vector<BMSInfoData*> result;
+			std::string text;
+			std::vector<uint32_t> codes;
+			Normalize(query, text, codes);
+
+			bool bFilter = !filter.IsDefault();
+			SearchBitmap facet;
+			if (bFilter) {
+				GetFacetBitmap(filter, facet);
+			}
+			auto accept = [&](uint32_t doc) {
+				if (bFilter) {
+					if (!facet.Test(doc)) {
+						return false;
+					}
+					double bpm = mListInfo[doc]->mBpm;
+					if (bpm < filter.mMinBpm || bpm > filter.mMaxBpm) {
+						return false;
+					}
+				}
+				return codes.empty() || Match(doc, text, mode);
+			};
+			auto push = [&](uint32_t doc) {
+				if (accept(doc)) {
+					result.emplace_back(mListInfo[doc]);
+				}
+				return maxCount == 0 || result.size() < maxCount;
+			};
+
+			uint32_t docCount = static_cast<uint32_t>(mListInfo.size());
+			if (codes.empty()) {
+				for (uint32_t doc = 0; doc < docCount && push(doc); ++doc) {}
+				return result;
+			}
+
+			if (codes.size() >= 3) {
+				// candidates are the postings of the rarest trigram of the query
+				const uint32_t* first = nullptr, *last = nullptr;
+				const std::vector<uint32_t>* delta = nullptr;
+				size_t minCount = SIZE_MAX;
+				for (size_t i = 0; i + 2 < codes.size(); ++i) {
+					uint64_t key = MakeKey(codes[i], codes[i + 1], codes[i + 2]);
+					const uint32_t* f, *l;
+					FindPosting(key, f, l);
+					auto iter = mDeltaPosting.find(key);
+					const std::vector<uint32_t>* d = iter == mDeltaPosting.end() ? nullptr : &iter->second;
+					size_t count = (l - f) + (d ? d->size() : 0);
+					if (count < minCount) {
+						minCount = count;
+						first = f, last = l, delta = d;
+					}
+					if (count == 0) {
+						return result;
+					}
+				}
+				for (; first != last; ++first) {
+					if (!push(*first)) return result;
+				}
+				if (delta) {
+					for (uint32_t doc : *delta) {
+						if (!push(doc)) return result;
+					}
+				}
+				return result;
+			}
+
+			// one or two code points : union of the trigram keys that start with the query
+			uint64_t low = codes.size() == 1 ? MakeKey(codes[0], 0, 0) : MakeKey(codes[0], codes[1], 0);
+			uint64_t high = low | (codes.size() == 1 ? (1ull << 42) - 1 : (1ull << 21) - 1);
+			SearchBitmap candidate;
+			candidate.Resize(docCount);
+			auto lower = std::lower_bound(mGramKey.begin(), mGramKey.end(), low);
+			for (auto iter = lower; iter != mGramKey.end() && *iter <= high; ++iter) {
+				size_t index = iter - mGramKey.begin();
+				for (uint32_t i = mGramOffset[index]; i < mGramOffset[index + 1]; ++i) {
+					candidate.Set(mPosting[i]);
+				}
+			}
+			for (const auto& e : mDeltaPosting) {
+				if (e.first >= low && e.first <= high) {
+					for (uint32_t doc : e.second) {
+						candidate.Set(doc);
+					}
+				}
+			}
+			for (uint32_t doc = 0; doc < docCount; ++doc) {
+				if (candidate.Test(doc) && !push(doc)) {
+					break;
+				}
+			}
+			return result;
+		}
+
+		/// <summary> write the index to <paramref name="path"/>. documents are saved as file paths </summary>
+		bool Save(const char* path) {
+			if (mIndexedCount != mListInfo.size()) {
+				BuildTable();
+			}
+			std::ofstream os(path, std::ios::binary);
+			if (!os.is_open()) {
+				return false;
+			}
+			try {
+				WriteToBinary(os, SEARCH_VERSION);
+				WriteToBinary(os, static_cast<uint32_t>(mListInfo.size()));
+				for (const BMSInfoData* info : mListInfo) {
+					WriteToBinary(os, info->mFilePath);
+				}
+				WriteToBinary(os, mText);
+				WriteToBinary(os, mTextOffset);
+				WriteToBinary(os, mGramKey);
+				WriteToBinary(os, mGramOffset);
+				WriteToBinary(os, mPosting);
+			} catch (const std::exception& e) {
+				LOG("search index write failed : " << e.what())
+				return false;
+			}
+			return true;
+		}
+
+		/// <summary>
+		/// read the index from <paramref name="path"/>. documents are found by file path in <paramref name="dicInfo"/>.
+		/// return false if the file is invalid or does not match <paramref name="dicInfo"/>. the index is empty in that case
+		/// </summary>
+		bool Load(const char* path, const std::unordered_map<std::wstring_view, BMSInfoData*>& dicInfo) {
+			Clear();
+			std::ifstream is(path, std::ios::binary);
+			if (!is.is_open()) {
+				return false;
+			}
+			try {
+				if (ReadFromBinary<uint32_t>(is) != SEARCH_VERSION) {
+					return false;
+				}
+				uint32_t count = ReadFromBinary<uint32_t>(is);
+				if (count != dicInfo.size()) {
+					return false;
+				}
+				mListInfo.reserve(count);
+				std::wstring filePath;
+				for (uint32_t i = 0; i < count; ++i) {
+					ReadFromBinary(is, filePath);
+					auto iter = dicInfo.find(filePath);
+					if (iter == dicInfo.end()) {
+						Clear();
+						return false;
+					}
+					mListInfo.emplace_back(iter->second);
+				}
+				ReadFromBinary(is, mText);
+				ReadFromBinary(is, mTextOffset);
+				ReadFromBinary(is, mGramKey);
+				ReadFromBinary(is, mGramOffset);
+				ReadFromBinary(is, mPosting);
+			} catch (const std::exception& e) {
+				LOG("search index read failed : " << e.what())
+				Clear();
+				return false;
+			}
+
+			// check the table is consistent before it is used
+			if (mTextOffset.size() != mListInfo.size() * FIELD_COUNT + 1 || mTextOffset.back() != mText.size() ||
+				mGramOffset.size() != mGramKey.size() + 1 || mGramOffset.back() != mPosting.size() ||
+				std::any_of(mPosting.begin(), mPosting.end(), [this](uint32_t doc) { return doc >= mListInfo.size(); })) {
+				Clear();
+				return false;
+			}
+			mIndexedCount = mListInfo.size();
+			for (uint32_t doc = 0; doc < mListInfo.size(); ++doc) {
+				AddFacet(doc);
+			}
+			return true;
+		}
+
+		/// <summary>
+		/// convert <paramref name="s"/> (UTF-8) to the search form. <paramref name="text"/> is the normalized UTF-8 string
+		/// and <paramref name="codes"/> is its code points. invalid bytes are treated as Latin-1 characters
+		/// </summary>
+		static void Normalize(std::string_view s, std::string& text, std::vector<uint32_t>& codes) {
+			text.clear();
+			codes.clear();
+			bool bSpace = false;
+			for (size_t i = 0; i < s.size();) {
+				uint32_t cp = DecodeUTF8(s, i);
+				// fold characters that users type in different forms
+				if (cp >= 0xFF01 && cp <= 0xFF5E) {				// full-width ASCII
+					cp -= 0xFEE0;
+				} else if (cp >= 0x30A1 && cp <= 0x30F6) {		// katakana -> hiragana
+					cp -= 0x60;
+				} else if (cp == 0x3000) {						// ideographic space
+					cp = ' ';
+				}
+				if ((cp >= 'A' && cp <= 'Z') || (cp >= 0xC0 && cp <= 0xDE && cp != 0xD7)) {
+					cp += 0x20;
+				}
+				// collapse spaces and control characters
+				if (cp <= ' ') {
+					bSpace = !codes.empty();
+					continue;
+				}
+				if (bSpace) {
+					codes.emplace_back(' ');
+					text.push_back(' ');
+					bSpace = false;
+				}
+				codes.emplace_back(cp);
+				EncodeUTF8(cp, text);
+			}
+		}
+
+	private:
+		std::vector<BMSInfoData*> mListInfo;			// document id -> chart
+		std::string mText;								// normalized fields of all documents
+		std::vector<uint32_t> mTextOffset{0};			// field i of all documents is [mTextOffset[i], mTextOffset[i + 1])
+
+		// -- trigram table of the documents [0, mIndexedCount)
+		std::vector<uint64_t> mGramKey;					// sorted trigram keys
+		std::vector<uint32_t> mGramOffset{0};			// postings of mGramKey[i] are [mGramOffset[i], mGramOffset[i + 1]) of mPosting
+		std::vector<uint32_t> mPosting;					// document ids in ascending order for each key
+		size_t mIndexedCount = 0;
+		/// <summary> postings of the documents added after the table is built </summary>
+		std::unordered_map<uint64_t, std::vector<uint32_t>> mDeltaPosting;
+
+		// -- facet bitmaps
+		std::vector<SearchBitmap> mLevelBitmap;
+		SearchBitmap mDifficultyBitmap[DIFFICULTY_COUNT];
+		SearchBitmap mKeyTypeBitmap[KEY_TYPE_COUNT];
+		SearchBitmap mBpmBitmap[BPM_BUCKET_COUNT];
+
+		/// <summary> make a trigram key. a code point has 21 bits </summary>
+		static constexpr uint64_t MakeKey(uint32_t a, uint32_t b, uint32_t c) {
+			return (static_cast<uint64_t>(a) << 42) | (static_cast<uint64_t>(b) << 21) | c;
+		}
+
+		static uint32_t DecodeUTF8(std::string_view s, size_t& i) {
+			uint8_t c = static_cast<uint8_t>(s[i]);
+			int length = c < 0x80 ? 1 : (c >> 5) == 0x6 ? 2 : (c >> 4) == 0xE ? 3 : (c >> 3) == 0x1E ? 4 : 0;
+			if (length <= 1 || i + length > s.size()) {
+				++i;
+				return c;
+			}
+			uint32_t cp = c & (0x7F >> length);
+			for (int k = 1; k < length; ++k) {
+				uint8_t next = static_cast<uint8_t>(s[i + k]);
+				if ((next & 0xC0) != 0x80) {
+					++i;
+					return c;
+				}
+				cp = (cp << 6) | (next & 0x3F);
+			}
+			i += length;
+			return cp > 0x10FFFF ? 0xFFFD : cp;
+		}
+		static void EncodeUTF8(uint32_t cp, std::string& out) {
+			if (cp < 0x80) {
+				out.push_back(static_cast<char>(cp));
+			} else if (cp < 0x800) {
+				out.push_back(static_cast<char>(0xC0 | (cp >> 6)));
+				out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+			} else if (cp < 0x10000) {
+				out.push_back(static_cast<char>(0xE0 | (cp >> 12)));
+				out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+				out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+			} else {
+				out.push_back(static_cast<char>(0xF0 | (cp >> 18)));
+				out.push_back(static_cast<char>(0x80 | ((cp >> 12) & 0x3F)));
+				out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+				out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+			}
+		}
+
+		/// <summary> convert a text field of <paramref name="info"/> to UTF-8 by the encoding of the file </summary>
+		static std::string ToUTF8(std::string_view s, EncodingType type) {
+			std::string result;
+			if (type == EncodingType::SHIFT_JIS) {
+				Utility::CP932ToUTF8(s, result);
+			} else if (type == EncodingType::EUC_KR) {
+				Utility::CP949ToUTF8(s, result);
+			} else {
+				result.assign(s);
+			}
+			return result;
+		}
+
+		inline std::string_view GetField(uint32_t doc, size_t field) const {
+			size_t index = doc * FIELD_COUNT + field;
+			return std::string_view(mText.data() + mTextOffset[index], mTextOffset[index + 1] - mTextOffset[index]);
+		}
+
+		/// <summary> add the normalized text and the facets of <paramref name="info"/>. return the document id </summary>
+		uint32_t AddDocument(BMSInfoData* info) {
+			uint32_t doc = static_cast<uint32_t>(mListInfo.size());
+			mListInfo.emplace_back(info);
+			std::string text;
+			std::vector<uint32_t> codes;
+			for (std::string_view field : {info->mTitle, info->mArtist, info->mGenre}) {
+				Normalize(ToUTF8(field, info->mFileType), text, codes);
+				mText.append(text);
+				mTextOffset.emplace_back(static_cast<uint32_t>(mText.size()));
+			}
+			AddFacet(doc);
+			return doc;
+		}
+
+		void AddFacet(uint32_t doc) {
+			const BMSInfoData* info = mListInfo[doc];
+			if (mLevelBitmap.size() <= info->mLevel) {
+				mLevelBitmap.resize(info->mLevel + 1);
+			}
+			mLevelBitmap[info->mLevel].Set(doc);
+			mDifficultyBitmap[std::min<size_t>(info->mDifficulty, DIFFICULTY_COUNT - 1)].Set(doc);
+			mKeyTypeBitmap[std::min<size_t>(static_cast<size_t>(info->mKeyType), KEY_TYPE_COUNT - 1)].Set(doc);
+			mBpmBitmap[GetBpmBucket(info->mBpm)].Set(doc);
+		}
+
+		static size_t GetBpmBucket(double bpm) {
+			return std::upper_bound(std::begin(BPM_BUCKETS), std::end(BPM_BUCKETS), bpm) - std::begin(BPM_BUCKETS);
+		}
+
+		/// <summary> fill <paramref name="grams"/> with the unique trigram keys of <paramref name="doc"/> </summary>
+		void GetGrams(uint32_t doc, std::vector<uint64_t>& grams) const {
+			grams.clear();
+			std::string text;
+			std::vector<uint32_t> codes;
+			for (size_t field = 0; field < FIELD_COUNT; ++field) {
+				std::string_view s = GetField(doc, field);
+				codes.clear();
+				for (size_t i = 0; i < s.size();) {
+					codes.emplace_back(DecodeUTF8(s, i));
+				}
+				if (codes.empty()) {
+					continue;
+				}
+				codes.emplace_back(0);
+				codes.emplace_back(0);
+				for (size_t i = 0; i + 2 < codes.size(); ++i) {
+					grams.emplace_back(MakeKey(codes[i], codes[i + 1], codes[i + 2]));
+				}
+			}
+			std::sort(grams.begin(), grams.end());
+			grams.erase(std::unique(grams.begin(), grams.end()), grams.end());
+		}
+
+		/// <summary> build the trigram table of all documents and clear the hash map </summary>
+		void BuildTable() {
+			std::vector<std::pair<uint64_t, uint32_t>> pairs;
+			std::vector<uint64_t> grams;
+			for (uint32_t doc = 0; doc < mListInfo.size(); ++doc) {
+				GetGrams(doc, grams);
+				for (uint64_t key : grams) {
+					pairs.emplace_back(key, doc);
+				}
+			}
+			std::sort(pairs.begin(), pairs.end());
+
+			mGramKey.clear();
+			mGramOffset.assign(1, 0);
+			mPosting.resize(pairs.size());
+			for (size_t i = 0; i < pairs.size(); ++i) {
+				if (mGramKey.empty() || mGramKey.back() != pairs[i].first) {
+					if (!mGramKey.empty()) {
+						mGramOffset.emplace_back(static_cast<uint32_t>(i));
+					}
+					mGramKey.emplace_back(pairs[i].first);
+				}
+				mPosting[i] = pairs[i].second;
+			}
+			if (!mGramKey.empty()) {
+				mGramOffset.emplace_back(static_cast<uint32_t>(pairs.size()));
+			}
+			mDeltaPosting.clear();
+			mIndexedCount = mListInfo.size();
+		}
+
+		inline void FindPosting(uint64_t key, const uint32_t*& first, const uint32_t*& last) const {
+			auto iter = std::lower_bound(mGramKey.begin(), mGramKey.end(), key);
+			if (iter == mGramKey.end() || *iter != key) {
+				first = last = nullptr;
+				return;
+			}
+			size_t index = iter - mGramKey.begin();
+			first = mPosting.data() + mGramOffset[index];
+			last = mPosting.data() + mGramOffset[index + 1];
+		}
+
+		/// <summary> check a field of <paramref name="doc"/> matches the normalized query <paramref name="text"/> </summary>
+		bool Match(uint32_t doc, std::string_view text, SearchMode mode) const {
+			for (size_t field = 0; field < FIELD_COUNT; ++field) {
+				std::string_view s = GetField(doc, field);
+				for (size_t pos = s.find(text); pos != std::string_view::npos; pos = s.find(text, pos + 1)) {
+					if (mode == SearchMode::SUBSTRING || pos == 0 || s[pos - 1] == ' ') {
+						return true;
+					}
+				}
+			}
+			return false;
+		}
+
+		/// <summary> fill <paramref name="result"/> with the documents that match all facets of <paramref name="filter"/> </summary>
+		void GetFacetBitmap(const SearchFilter& filter, SearchBitmap& result) const {
+			SearchBitmap bitmap;
+			for (size_t level = filter.mMinLevel; level <= filter.mMaxLevel && level < mLevelBitmap.size(); ++level) {
+				result.Or(mLevelBitmap[level]);
+			}
+			for (size_t i = 0; i < DIFFICULTY_COUNT; ++i) {
+				if (filter.mDifficultyMask >> i & 1) {
+					bitmap.Or(mDifficultyBitmap[i]);
+				}
+			}
+			result.And(bitmap);
+
+			bitmap.mWords.clear();
+			for (size_t i = 0; i < KEY_TYPE_COUNT; ++i) {
+				if (filter.mKeyTypeMask >> i & 1) {
+					bitmap.Or(mKeyTypeBitmap[i]);
+				}
+			}
+			result.And(bitmap);
+
+			// buckets that overlap the range. the exact bpm is checked for each candidate
+			bitmap.mWords.clear();
+			for (size_t i = GetBpmBucket(filter.mMinBpm); i <= GetBpmBucket(filter.mMaxBpm) && i < BPM_BUCKET_COUNT; ++i) {
+				bitmap.Or(mBpmBitmap[i]);
+			}
+			result.And(bitmap);
+		}
+	};
+}
\ No newline at end of file
@@ -1,24 +1,185 @@
 #pragma once
 
 #include "dirent.h"
-#include <functional>
+#include "BMSScanPool.h"
+#include "BMSCache.h"
+#include "BMSArena.h"
+#include "BMSSearch.h"
+
+#include <numeric>
 
 namespace bms {
 	constexpr auto ROOT_PATH = L"StreamingAssets";
 	//constexpr auto ROOT_PATH = L"E:/";
-	constexpr auto CACHE_FILE_NAME = "test.bin";
+	constexpr auto CACHE_FILE_NAME = L"bmscache.bin";
+	constexpr auto LEGACY_CACHE_FILE_NAME = "test.bin";	// stream format cache file used before <see cref="bms::CACHE_VERSION"/> 1
+
+	/// <summary> the number of sort keys. *_DEC options of <see cref="bms::SortOption"/> use the reversed order of *_ASC options </summary>
+	constexpr size_t SORT_KEY_COUNT = 6;
+
+	/// <summary> return the index of the sort key (permutation) of <paramref name="opt"/> </summary>
+	constexpr size_t GetSortKeyIndex(SortOption opt) {
+		return static_cast<size_t>(opt) % SORT_KEY_COUNT;
+	}
+	/// <summary> return true if <paramref name="opt"/> is a descending order </summary>
+	constexpr bool IsDescending(SortOption opt) {
+		return static_cast<size_t>(opt) >= SORT_KEY_COUNT;
+	}
 
 	/// <summary>
 	/// A structure that stores a group of bms files for one song (has variable pattern)
 	/// </summary>
 	struct BMSNode {
 		std::wstring mFolderName;
-		std::vector<BMSInfoData*> mListData;
+		std::vector<BMSInfoData*> mListData;	// in the order of file system search. use <see cref="GetPattern"/> for sorted access
+		/// <summary>
+		/// permutations of <see cref="mListData"/> for each sort key. [key * size, (key + 1) * size) is the order of the key.
+		/// built by <see cref="bms::BMSTree"/> after the patterns are changed.
+		/// </summary>
+		std::vector<uint8_t> mPatternOrder;
 
-		/// <summary> used to reduce the string comparison overhead by saving the folder that has been checked when performing file system search. </summary>
+		/// <summary> 
+		/// true if the folder is not changed since the cache was saved (same modification time).
+		/// confirmed folder is trusted without enumerating files when performing file system search.
+		/// </summary>
 		bool mConfirmed;
+		/// <summary> last modification time of the folder. changed when a file is added, removed or renamed in the folder </summary>
+		uint64_t mFolderTime;
 
-		BMSNode(const std::wstring& name, const std::vector<BMSInfoData*>& list) : mFolderName(name), mListData(list) {};
+		BMSNode(const std::wstring& name, const std::vector<BMSInfoData*>& list) : 
+			mFolderName(name), mListData(list), mConfirmed(false), mFolderTime(0) {};
+
+		/// <summary> return the <paramref name="index"/>th pattern in the order of <paramref name="opt"/> </summary>
+		inline BMSInfoData* GetPattern(SortOption opt, size_t index) const {
+			size_t size = mListData.size();
+			if (mPatternOrder.size() != size * SORT_KEY_COUNT) {	// the order is not built yet
+				return mListData[index];
+			}
+			const uint8_t* order = mPatternOrder.data() + GetSortKeyIndex(opt) * size;
+			return mListData[order[IsDescending(opt) ? size - 1 - index : index]];
+		}
+	};
+
+	/// <summary>
+	/// sort keys extracted from <see cref="bms::BMSInfoData"/> to build permutations without pointer chasing.
+	/// text keys hold the first 8 bytes as a big-endian integer (collation prefix), so most comparisons end without reading the strings.
+	/// </summary>
+	struct SortKey {
+		uint64_t mTitle;
+		uint64_t mGenre;
+		uint64_t mArtist;
+		double mBpm;
+		uint8_t mLevel;
+		uint8_t mDifficulty;
+		const BMSInfoData* mInfo;		// used when the prefixes are the same
+		std::wstring_view mPath;		// folder name for music, file path for pattern
+
+		SortKey(const BMSInfoData* info, std::wstring_view path) :
+			mTitle(GetPrefix(info->mTitle)), mGenre(GetPrefix(info->mGenre)), mArtist(GetPrefix(info->mArtist)),
+			mBpm(info->mBpm), mLevel(info->mLevel), mDifficulty(info->mDifficulty), mInfo(info), mPath(path) {}
+
+		/// <summary> return the first 8 bytes of <paramref name="s"/> as a big-endian integer. the order is the same as the string comparison </summary>
+		static inline uint64_t GetPrefix(std::string_view s) {
+			uint64_t result = 0;
+			for (size_t i = 0; i < 8; ++i) {
+				result = (result << 8) | (i < s.size() ? static_cast<uint8_t>(s[i]) : 0);
+			}
+			return result;
+		}
+
+		/// <summary> return true if <paramref name="lhs"/> is before <paramref name="rhs"/> in ascending order of sort key <paramref name="key"/> </summary>
+		static bool Less(const SortKey& lhs, const SortKey& rhs, size_t key) {
+			switch (key) {
+			case GetSortKeyIndex(SortOption::LEVEL_ASC):
+				if (lhs.mLevel != rhs.mLevel) {
+					return lhs.mLevel < rhs.mLevel;
+				}
+				if (lhs.mDifficulty != rhs.mDifficulty) {
+					return lhs.mDifficulty < rhs.mDifficulty;
+				}
+				break;
+			case GetSortKeyIndex(SortOption::TITLE_ASC):
+				if (lhs.mTitle != rhs.mTitle) {
+					return lhs.mTitle < rhs.mTitle;
+				}
+				if (lhs.mInfo->mTitle != rhs.mInfo->mTitle) {
+					return lhs.mInfo->mTitle < rhs.mInfo->mTitle;
+				}
+				break;
+			case GetSortKeyIndex(SortOption::GENRE_ASC):
+				if (lhs.mGenre != rhs.mGenre) {
+					return lhs.mGenre < rhs.mGenre;
+				}
+				if (lhs.mInfo->mGenre != rhs.mInfo->mGenre) {
+					return lhs.mInfo->mGenre < rhs.mInfo->mGenre;
+				}
+				break;
+			case GetSortKeyIndex(SortOption::ARTIST_ASC):
+				if (lhs.mArtist != rhs.mArtist) {
+					return lhs.mArtist < rhs.mArtist;
+				}
+				if (lhs.mInfo->mArtist != rhs.mInfo->mArtist) {
+					return lhs.mInfo->mArtist < rhs.mInfo->mArtist;
+				}
+				break;
+			case GetSortKeyIndex(SortOption::BPM_ASC):
+				if (lhs.mBpm != rhs.mBpm) {
+					return lhs.mBpm < rhs.mBpm;
+				}
+				break;
+			}
+			// PATH_ASC and tie-break of other keys
+			return lhs.mPath < rhs.mPath;
+		}
+
+		/// <summary> fill <paramref name="order"/> with the permutations of <paramref name="keys"/> for all sort keys </summary>
+		template<class T>
+		static void BuildOrder(const std::vector<SortKey>& keys, std::vector<T>& order) {
+			size_t size = keys.size();
+			order.resize(size * SORT_KEY_COUNT);
+			for (size_t key = 0; key < SORT_KEY_COUNT; ++key) {
+				T* first = order.data() + key * size;
+				std::iota(first, first + size, T(0));
+				std::sort(first, first + size, [&keys, key](T lhs, T rhs) { return Less(keys[lhs], keys[rhs], key); });
+			}
+		}
+	};
+
+	/// <summary>
+	/// A read-only view of the music list of a folder in the sort order of <see cref="bms::BMSTree"/>.
+	/// It is valid until the folder is updated or the sort option is changed.
+	/// </summary>
+	class MusicListView {
+	public:
+		MusicListView(const std::vector<BMSNode>& list, const std::vector<uint32_t>& order, SortOption musicOpt, SortOption patternOpt) :
+			mList(&list), mOrder(&order), mMusicOpt(musicOpt), mPatternOpt(patternOpt) {}
+
+		inline size_t size() const {
+			return mList->size();
+		}
+		inline bool empty() const {
+			return mList->empty();
+		}
+
+		/// <summary> return the <paramref name="index"/>th music in the music sort order </summary>
+		inline const BMSNode& operator[](size_t index) const {
+			size_t size = mList->size();
+			if (mOrder->size() != size * SORT_KEY_COUNT) {	// the order is not built yet
+				return (*mList)[index];
+			}
+			const uint32_t* order = mOrder->data() + GetSortKeyIndex(mMusicOpt) * size;
+			return (*mList)[order[IsDescending(mMusicOpt) ? size - 1 - index : index]];
+		}
+		/// <summary> return the <paramref name="patternIndex"/>th pattern of <paramref name="musicIndex"/>th music in the pattern sort order </summary>
+		inline BMSInfoData* GetPattern(size_t musicIndex, size_t patternIndex) const {
+			return (*this)[musicIndex].GetPattern(mPatternOpt, patternIndex);
+		}
+
+	private:
+		const std::vector<BMSNode>* mList;
+		const std::vector<uint32_t>* mOrder;
+		SortOption mMusicOpt;
+		SortOption mPatternOpt;
 	};
 
 	/// <summary>
@@ -75,23 +236,8 @@ namespace bms {
 		};
 
 	public:
-		BMSTree(BMSDecryptor& decryptor) : mDecryptor(decryptor), mMusicSortOpt(SortOption::PATH_ASC), 
-																  mPatternSortOpt(SortOption::LEVEL_ASC) {
-			mMusicSortFunc = GetMusicSortFunc(mMusicSortOpt);
-			mPatternSortFunc = GetPatternSortFunc(mPatternSortOpt);
-		};
+		BMSTree() : mMusicSortOpt(SortOption::PATH_ASC), mPatternSortOpt(SortOption::LEVEL_ASC) {};
 		DISALLOW_COPY_AND_ASSIGN(BMSTree)
-		BMSTree(BMSTree&&) noexcept = default;
-		BMSTree& operator=(BMSTree&&) noexcept = default;
-		~BMSTree() {
-			for (const auto& e : mDicBms) {
-				for (const auto& node : e.second) {
-					for (auto data : node.mListData) {
-						delete data;
-					}
-				}
-			}
-		}
 
 		/// <summary> return all list of bms folder name </summary>
 		inline const std::vector<std::string> GetFolderList() {
@@ -103,8 +249,8 @@ namespace bms {
 			return vec;
 		}
 
-		/// <summary> return proper list of bms music folder </summary>
-		inline const std::vector<BMSNode>& GetMusicList(uint16_t index) {
+		/// <summary> return proper list of bms music folder in the current sort order </summary>
+		inline MusicListView GetMusicList(uint16_t index) {
 			if (index >= mListFolder.size()) {
 				throw std::out_of_range("mListFolder index is out of range");
 			}
@@ -116,75 +262,78 @@ namespace bms {
 				folder.second = true;
 				std::cout << "subdirectory load time(ms) : " << std::to_string(clock() - s) << '\n';
 			}
-			// if iter == mDicBms.end(), this is an error that should not happen because it is set once above.
-			auto iter = mDicBms.find(mListFolder[index].first);
-			return iter->second;
+			// no music folder is found in this folder
+			static const std::vector<BMSNode> emptyList;
+			static const std::vector<uint32_t> emptyOrder;
+			auto iter = mDicBms.find(folder.first);
+			if (iter == mDicBms.end()) {
+				return MusicListView(emptyList, emptyOrder, mMusicSortOpt, mPatternSortOpt);
+			}
+			return MusicListView(iter->second, mDicMusicOrder[folder.first], mMusicSortOpt, mPatternSortOpt);
 		}
 
 		/// <summary> return path of bms pattern </summary>
 		BMSInfoData* GetPattern(uint16_t folderIndex, uint16_t musicIndex, uint8_t patternIndex) {
-			const std::vector<BMSNode>& music = GetMusicList(folderIndex);
+			MusicListView music = GetMusicList(folderIndex);
 			if (musicIndex >= music.size()) {
 				return nullptr;
 			}
-
-			const std::vector<BMSInfoData*>& pattern = music[musicIndex].mListData;
-			if (patternIndex >= pattern.size()) {
+			if (patternIndex >= music[musicIndex].mListData.size()) {
 				return nullptr;
 			}
 
-			return pattern[patternIndex];
+			return music.GetPattern(musicIndex, patternIndex);
 		}
 
-		/// <summary> change the sorting option of all bms music folder lists to <paramref name="opt"/> </summary>
-		void ChangeMusicSortOpt(SortOption opt) {
+		/// <summary> change the sorting option of all bms music folder lists to <paramref name="opt"/>. the orders are already built, so nothing is sorted </summary>
+		inline void ChangeMusicSortOpt(SortOption opt) {
 			mMusicSortOpt = opt;
-			mMusicSortFunc = GetMusicSortFunc(mMusicSortOpt);
-			for (auto& e : mDicBms) {
-				auto& listMusic = e.second;
-				std::sort(listMusic.begin(), listMusic.end(), mMusicSortFunc);
-			}
 		}
-		/// <summary> change the sorting option of all music pattern lists to <paramref name="opt"/> </summary>
-		void ChangePatternSortOpt(SortOption opt) {
+		/// <summary> change the sorting option of all music pattern lists to <paramref name="opt"/>. the orders are already built, so nothing is sorted </summary>
+		inline void ChangePatternSortOpt(SortOption opt) {
 			mPatternSortOpt = opt;
-			mPatternSortFunc = GetPatternSortFunc(mPatternSortOpt);
-			for (auto& e : mDicBms) {
-				auto& vec = e.second;
-				for (auto& v : vec) {
-					auto& listPattern = v.mListData;
-					std::sort(listPattern.begin(), listPattern.end(), mPatternSortFunc);
-				}
-			}
 		}
 
-		/// <summary> save all <see cref="mDicFolderName"/> elements to binary file </summary>
+		/// <summary>
+		/// return the charts of all loaded folders whose title, artist or genre matches <paramref name="utf8Query"/> and <paramref name="filter"/>.
+		/// folders that have not been opened yet are searched by the cached data
+		/// </summary>
+		inline std::vector<BMSInfoData*> Search(std::string_view utf8Query, const SearchFilter& filter = SearchFilter(),
+												SearchMode mode = SearchMode::SUBSTRING, size_t maxCount = 0) const {
+			return mSearchIndex.Search(utf8Query, filter, mode, maxCount);
+		}
+
+		/// <summary> save all <see cref="mDicBms"/> elements to binary cache file (<see cref="bms::BMSCache.h"/>) </summary>
 		void Save() {
 			if (!mChangeSave) {
 				std::cout << "nothing changed" << std::endl;
 				return;
 			}
 			clock_t s = clock();
-			std::ofstream os(CACHE_FILE_NAME, std::ios::binary);
-			// save bms container
+			CacheWriter writer;
 			for (const auto& e : mDicBms) {
 				for (const auto& node : e.second) {
-					std::string uPath = Utility::WideToUTF8(PathAppend(e.first, node.mFolderName));
-					uint8_t size = static_cast<uint8_t>(node.mListData.size());
-					WriteToBinary(os, uPath);
-					WriteToBinary(os, size);
-					for (auto& info : node.mListData) {
-						os << *info;
-					}
+					writer.AddFolder(PathAppend(e.first, node.mFolderName), node.mFolderTime, node.mListData);
 				}
 			}
-			os.close();
+			// the mapped cache file is replaced by the new one
+			DetachCache();
+			if (!writer.Write(CACHE_FILE_NAME)) {
+				std::cout << "failed to write cache file" << '\n';
+				return;
+			}
+			// the legacy cache file is migrated to the new format
+			std::remove(LEGACY_CACHE_FILE_NAME);
+			if (!mSearchIndex.Save(SEARCH_FILE_NAME)) {
+				std::cout << "failed to write search index file" << '\n';
+			}
 			std::cout << "BMSInfoData save time(ms) : " << std::to_string(clock() - s) << '\n';
 		}
 
 		/// <summary>
 		/// check file paths and load <see cref="bms::BMSInfoData"/> list from cache file
-		/// If the file does not exist or the path is changed, the object is created again to update the list.
+		/// If the file does not exist, the object is removed. If the modification time or size of the file is changed, the object is created again.
+		/// If there is no cache file of current format, the legacy stream cache file (<see cref="LEGACY_CACHE_FILE_NAME"/>) is read and saved in current format.
 		/// </summary>
 		void Load() {
 			mChangeSave = false;
@@ -233,39 +382,33 @@ namespace bms {
 
 			// load cache data
 			s = clock();
-			std::wstring indexedFolderName;
-			std::ifstream is(CACHE_FILE_NAME, std::ios::binary);
-			if (is.is_open()) {
-				std::wstring wPath;
-				uint8_t size;
-				while (is.peek() != std::ifstream::traits_type::eof()) {
-					wPath = Utility::UTF8ToWide(ReadFromBinary<std::string>(is));
-					size = ReadFromBinary<uint8_t>(is);
-					if (!IsExistFile(wPath)) {
-						// folder is not found -> discard
-						BMSInfoData temp;
-						for (uint8_t i = 0; i < size; ++i) {
-							is >> temp;
-						}
-						continue;
-					}
+			{
+				// modified files are built again in this pool while the cache is read
+				ScanPool pool(mStringPool);
+				bool bReparse = false;
+				if (!LoadCache(pool, bReparse)) {
+					LoadLegacyCache(pool, bReparse);
+				}
+				pool.Wait();
 
-					std::vector<BMSInfoData*> vec; vec.reserve(size);
-					for (uint8_t i = 0; i < size; ++i) {
-						BMSInfoData* temp = new BMSInfoData();
-						is >> *temp;
-						if (!IsExistFile(temp->mFilePath)) {
-							delete temp;
-						} else {
-							vec.emplace_back(temp);
-						}
-					}
-					AddMusic(wPath, std::move(vec));
+				if (bReparse) {
+					mChangeSave = true;
 				}
 			}
-			is.close();
+			// build the orders of all folders read from the cache once
+			for (const auto& e : mDicBms) {
+				BuildSortOrder(e.first);
+			}
 			std::cout << "cache load time(ms) : " << std::to_string(clock() - s) << '\n';
 
+			// the search index file is valid only if it has the same charts with the cache
+			s = clock();
+			if (mChangeSave || !LoadSearchIndex()) {
+				BuildSearchIndex();
+				mChangeSave = true;
+			}
+			std::cout << "search index load time(ms) : " << std::to_string(clock() - s) << '\n';
+
 			s = clock();
 			// check first subdirectory and create added bms files or folder.
 			SetMusicList(mListFolder[0].first);
@@ -274,14 +417,10 @@ namespace bms {
 		}
 
 	private:
-		BMSDecryptor& mDecryptor;
-
 		/// <summary> variable to check for changes when loading cache files </summary>
 		bool mChangeSave;
 		SortOption mMusicSortOpt;		// sorting option of bms music list
 		SortOption mPatternSortOpt;		// sorting option of pattern list in single <see cref="bms::BMSNode"/>
-		std::function<bool(const BMSNode&, const BMSNode&)> mMusicSortFunc;				// sort function of bms music list
-		std::function<bool(BMSInfoData* const&, BMSInfoData* const&)> mPatternSortFunc;	// sort function of pattern list
 
 		/// <summary>
 		/// A list that indicate the parent folder path. Used for search bms data list.
@@ -295,6 +434,20 @@ namespace bms {
 		/// hierarchy : parent folders -> music folders -> patterns
 		/// </summary>
 		std::unordered_map<std::wstring, std::vector<BMSNode>> mDicBms;
+		/// <summary>
+		/// permutations of the music list in <see cref="mDicBms"/> with the same key for each sort key.
+		/// [key * size, (key + 1) * size) is the order of the key. the music list itself is not sorted.
+		/// </summary>
+		std::unordered_map<std::wstring, std::vector<uint32_t>> mDicMusicOrder;
+
+		/// <summary> storage of all <see cref="bms::BMSInfoData"/> objects in <see cref="mDicBms"/>. released at once with the tree </summary>
+		InfoArena mInfoArena;
+		/// <summary> storage of text fields of all <see cref="bms::BMSInfoData"/> objects. the same genre or artist is stored once </summary>
+		Utility::StringPool mStringPool;
+		/// <summary> the mapped cache file. text fields of the objects read from the cache are the views of it until <see cref="DetachCache"/> </summary>
+		CacheReader mCache;
+		/// <summary> text and facet index of all <see cref="bms::BMSInfoData"/> objects in <see cref="mDicBms"/> </summary>
+		SearchIndex mSearchIndex;
 
 		/// <summary> simple path append for new wstring object </summary>
 		inline std::wstring PathAppend(const std::wstring& p1, const std::wstring& p2) {
@@ -311,12 +464,6 @@ namespace bms {
 			return path.substr(0, path.find_last_of(L'/'));
 		}
 
-		/// <summary> check that the <paramref name="path"/> is a valid file / folder path </summary>
-		inline bool IsExistFile(const std::wstring& path) {
-			struct stat buffer;
-			return _wstat(path.data(), (struct _stat64i32*)&buffer) == 0;
-		}
-
 		/// <summary> check whether <param name="name"/> is bms file </summary>
 		inline bool IsBmsFile(const wchar_t* name) {
 			// bms file extension : .bms, .bme, .bml
@@ -369,21 +516,191 @@ namespace bms {
 			return FolderType::NONE;
 		}
 
-		/// <summary> add <see cref="bms::BMSNode"/> object into dictionary </summary>
-		inline void AddMusic(const std::wstring& path, std::vector<BMSInfoData*>&& patterns) {
-			std::wstring key = GetDirectory(path);
-			if (mDicBms.count(key) == 0) {
-				std::vector<BMSNode> vec;
-				vec.emplace_back(GetFileName(path), std::move(patterns));
-				mDicBms.emplace(key, std::move(vec));
-			} else {
-				std::vector<BMSNode>& vec = mDicBms[key];
-				vec.emplace_back(GetFileName(path), std::move(patterns));
+		/// <summary> add <see cref="bms::BMSNode"/> object into dictionary and return the added object </summary>
+		inline BMSNode& AddMusic(const std::wstring& path, std::vector<BMSInfoData*>&& patterns) {
+			std::vector<BMSNode>& vec = mDicBms[GetDirectory(path)];
+			vec.emplace_back(GetFileName(path), std::move(patterns));
+			return vec.back();
+		}
+
+		/// <summary>
+		/// add a music folder of <paramref name="path"/> read from cache file after checking the file system.
+		/// removed patterns are deleted and modified patterns are pushed to <paramref name="pool"/> to be built again.
+		/// </summary>
+		void AddCachedMusic(const std::wstring& path, uint64_t folderTime, std::vector<BMSInfoData*>&& patterns, ScanPool& pool, bool& bReparse) {
+			uint64_t curFolderTime, time, fileSize;
+			if (!Utility::GetFileStat(path.c_str(), curFolderTime, fileSize)) {
+				// folder is not found -> discard
+				for (auto data : patterns) {
+					mInfoArena.Destroy(data);
+				}
+				mChangeSave = true;
+				return;
 			}
+
+			std::vector<BMSInfoData*> vec; vec.reserve(patterns.size());
+			for (auto data : patterns) {
+				if (!Utility::GetFileStat(data->mFilePath.data(), time, fileSize)) {
+					mInfoArena.Destroy(data);
+					mChangeSave = true;
+					continue;
+				}
+				// the file is modified -> build again
+				if (time != data->mFileTime || fileSize != data->mFileSize) {
+					std::wstring filePath(data->mFilePath);
+					std::string_view extension = data->mSoundExtension;
+					*data = BMSInfoData();
+					data->mSoundExtension = extension;
+					pool.Push(data, filePath);
+					bReparse = true;
+				}
+				vec.emplace_back(data);
+			}
+			if (vec.empty()) {
+				mChangeSave = true;
+				return;
+			}
+			BMSNode& node = AddMusic(path, std::move(vec));
+			node.mFolderTime = curFolderTime;
+			node.mConfirmed = curFolderTime == folderTime;
+		}
+
+		/// <summary>
+		/// load music folders from the mapped cache file. return false if there is no valid cache file.
+		/// the file stays mapped, and the text fields of the objects are the views of it (no string is copied while loading)
+		/// </summary>
+		bool LoadCache(ScanPool& pool, bool& bReparse) {
+			DetachCache();
+			if (!mCache.Open(CACHE_FILE_NAME)) {
+				return false;
+			}
+
+			// objects are filled from the mapped record table directly
+			uint32_t folderCount = mCache.GetFolderCount();
+			for (uint32_t i = 0; i < folderCount; ++i) {
+				const CacheFolder& folder = mCache.GetFolder(i);
+				std::vector<BMSInfoData*> vec(folder.mRecordCount);
+				for (uint32_t j = 0; j < folder.mRecordCount; ++j) {
+					vec[j] = mInfoArena.Create();
+					mCache.ReadInfo(folder.mFirstRecord + j, *vec[j]);
+				}
+				std::wstring path = Utility::UTF8ToWide(std::string(mCache.GetString(folder.mPath)));
+				AddCachedMusic(path, folder.mFolderTime, std::move(vec), pool, bReparse);
+			}
+			return true;
+		}
+
+		/// <summary> copy the text fields that are the views of the mapped cache file to <see cref="mStringPool"/> and unmap the file </summary>
+		void DetachCache() {
+			if (!mCache.IsOpen()) {
+				return;
+			}
+			for (auto& e : mDicBms) {
+				for (auto& node : e.second) {
+					for (auto data : node.mListData) {
+						if (mCache.Contains(data->mFilePath.data())) data->mFilePath = mStringPool.Intern(data->mFilePath);
+						if (mCache.Contains(data->mTitle.data())) data->mTitle = mStringPool.Intern(data->mTitle);
+						if (mCache.Contains(data->mArtist.data())) data->mArtist = mStringPool.Intern(data->mArtist);
+						if (mCache.Contains(data->mGenre.data())) data->mGenre = mStringPool.Intern(data->mGenre);
+						if (mCache.Contains(data->mSoundExtension.data())) data->mSoundExtension = mStringPool.Intern(data->mSoundExtension);
+					}
+				}
+			}
+			mCache.Close();
+		}
+
+		/// <summary>
+		/// load music folders from the legacy stream cache file and mark it to be saved in current format.
+		/// layout : { folder path (UTF-8), pattern count (uint8_t), records (<see cref="bms::BMSInfoData::Deserialize"/>) } * folder count.
+		/// the legacy file has no fingerprint, so the files are checked now, and the folders are checked again when they are opened
+		/// </summary>
+		void LoadLegacyCache(ScanPool& pool, bool& bReparse) {
+			std::ifstream is(LEGACY_CACHE_FILE_NAME, std::ios::binary);
+			if (!is.is_open()) {
+				return;
+			}
+			std::cout << "migrate legacy cache file : " << LEGACY_CACHE_FILE_NAME << '\n';
+			mChangeSave = true;
+
+			std::vector<BMSInfoData*> vec;
+			try {
+				while (is.peek() != std::ifstream::traits_type::eof()) {
+					std::wstring wPath = Utility::UTF8ToWide(ReadFromBinary<std::string>(is));
+					uint8_t size = ReadFromBinary<uint8_t>(is);
+					vec.reserve(size);
+					for (uint8_t i = 0; i < size; ++i) {
+						vec.emplace_back(mInfoArena.Create());
+						BMSInfoData* data = vec.back();
+						data->Deserialize(is, mStringPool);
+						// a missing file keeps the empty fingerprint and is removed by AddCachedMusic
+						Utility::GetFileStat(data->mFilePath.data(), data->mFileTime, data->mFileSize);
+					}
+					AddCachedMusic(wPath, 0, std::move(vec), pool, bReparse);
+					vec.clear();
+				}
+			} catch (const std::exception& e) {
+				// broken or old format cache file -> the rest is created again when performing file system search
+				std::cout << "cache file is broken : " << e.what() << '\n';
+				for (auto data : vec) {
+					mInfoArena.Destroy(data);
+				}
+			}
+		}
+
+		/// <summary> build the pattern orders of all music and the music order of <paramref name="folderPath"/> folder </summary>
+		void BuildSortOrder(const std::wstring& folderPath) {
+			auto iter = mDicBms.find(folderPath);
+			if (iter == mDicBms.end()) {
+				return;
+			}
+			std::vector<BMSNode>& listMusic = iter->second;
+			std::vector<SortKey> keys;
+			for (auto& node : listMusic) {
+				keys.clear();
+				for (auto data : node.mListData) {
+					keys.emplace_back(data, data->mFilePath);
+				}
+				SortKey::BuildOrder(keys, node.mPatternOrder);
+			}
+			// music is sorted by the easiest pattern (the first pattern in LEVEL_ASC order)
+			keys.clear();
+			keys.reserve(listMusic.size());
+			for (auto& node : listMusic) {
+				keys.emplace_back(node.GetPattern(SortOption::LEVEL_ASC, 0), node.mFolderName);
+			}
+			SortKey::BuildOrder(keys, mDicMusicOrder[folderPath]);
+		}
+
+		/// <summary> build <see cref="mSearchIndex"/> of all <see cref="bms::BMSInfoData"/> objects in <see cref="mDicBms"/> </summary>
+		void BuildSearchIndex() {
+			std::vector<BMSInfoData*> list;
+			list.reserve(mInfoArena.GetCount());
+			for (const auto& e : mDicBms) {
+				for (const auto& node : e.second) {
+					list.insert(list.end(), node.mListData.begin(), node.mListData.end());
+				}
+			}
+			mSearchIndex.Build(list);
+		}
+
+		/// <summary> read <see cref="mSearchIndex"/> from <see cref="SEARCH_FILE_NAME"/>. return false if the file doesn't match <see cref="mDicBms"/> </summary>
+		bool LoadSearchIndex() {
+			std::unordered_map<std::wstring_view, BMSInfoData*> dicInfo;
+			dicInfo.reserve(mInfoArena.GetCount());
+			for (const auto& e : mDicBms) {
+				for (const auto& node : e.second) {
+					for (auto data : node.mListData) {
+						dicInfo.emplace(data->mFilePath, data);
+					}
+				}
+			}
+			return mSearchIndex.Load(SEARCH_FILE_NAME, dicInfo);
 		}
 
 		/// <summary>
 		/// find bms file and store in dictionary. if new pattern is found, create new <see cref="bms::BMSInfoData"/> object
+		/// The folders are enumerated in this thread and new objects are built in <see cref="bms::ScanPool"/>.
+		/// Objects are placed in the list before they are built, so the order of the result doesn't depend on the threads.
 		/// </summary>
 		void SetMusicList(const std::wstring& folderPath) {
 			std::vector<BMSNode> dummyList;
@@ -415,6 +732,9 @@ namespace bms {
 			bool* folderChecker = new bool[initMusicNum] {};	// used to reduce the string comparison overhead by saving the folder 
 																// that has been checked when performing file system search.
 			bool bIncMusicNum = false;							// variable to check if more than one music is added
+			bool bIncPatternNum = false;						// variable to check if more than one pattern is added
+			std::vector<BMSInfoData*> listAdded;				// new objects to be added to the search index after they are built
+			ScanPool pool(mStringPool);
 			wchar_t* name;
 			DirLoop loop(folderPath);
 			while (name = loop.Read()) {
@@ -422,13 +742,21 @@ namespace bms {
 					continue;
 				} 
 
+				// music folder that is not changed since the cache was saved -> trust it without enumerating
+				int musicIndex = findMusicNameIndex(musicList, name, folderChecker);
+				if (musicIndex != -1 && musicList[musicIndex].mConfirmed) {
+					continue;
+				}
+
 				// bms file check ready
 				bool bCheckSoundExt = false;
-				std::string extension;
+				std::string_view extension;
 				patternPathList.clear();
 
 				// subloop to find bms files + confirm sound extension
 				std::wstring subPath = PathAppend(folderPath, name);
+				uint64_t folderTime = 0, folderSize;
+				Utility::GetFileStat(subPath.c_str(), folderTime, folderSize);
 				wchar_t* subName;
 				DirLoop subloop(subPath);
 				while (subName = subloop.Read()) {
@@ -442,7 +770,7 @@ namespace bms {
 					} else if (!bCheckSoundExt && IsSoundFile(subName)) {
 						// sound file extension check
 						std::wstring ext = &(subName[wcslen(subName) - 3]);
-						extension.assign(ext.begin(), ext.end());
+						extension = mStringPool.Intern(std::string(ext.begin(), ext.end()));
 						bCheckSoundExt = true;
 					}
 				}
@@ -454,168 +782,56 @@ namespace bms {
 				}
 
 				// music folder is not found -> add music to dictionary
-				int musicIndex = findMusicNameIndex(musicList, name, folderChecker);
 				if (musicIndex == -1) {
 					// has no cache == create new BMSNode object
 					std::vector<BMSInfoData*> vec(musicCount);
 					for (uint8_t i = 0; i < musicCount; ++i) {
-						BMSInfoData* temp = new BMSInfoData();
+						BMSInfoData* temp = mInfoArena.Create();
 						temp->mSoundExtension = extension;
-						mDecryptor.BuildInfoData(temp, patternPathList[i].c_str());
+						pool.Push(temp, patternPathList[i]);
 						vec[i] = temp;
+						listAdded.emplace_back(temp);
 					}
-					// sort pattern list and add in dictionary
-					std::sort(vec.begin(), vec.end(), mPatternSortFunc);
-					AddMusic(subPath, std::move(vec));
+					// add in dictionary. pattern list is sorted after all jobs are done
+					AddMusic(subPath, std::move(vec)).mFolderTime = folderTime;
 					bIncMusicNum = true;
 					continue;
 				}
 
 				// both parent folder and music folder is exist -> check pattern and add if it is new
-				std::vector<BMSInfoData*>& vec = musicList[musicIndex].mListData;
+				BMSNode& node = musicList[musicIndex];
+				if (node.mFolderTime != folderTime) {
+					node.mFolderTime = folderTime;
+					mChangeSave = true;
+				}
+				std::vector<BMSInfoData*>& vec = node.mListData;
 				bool* patternChecker = new bool[vec.size()]{};
-				bool bIncPatternNum = false;					// variable to check if more than one pattern is added
 				for (uint8_t i = 0; i < musicCount; ++i) {
 					if (!checkPatternExist(vec, patternPathList[i], patternChecker)) { // new pattren is found
-						BMSInfoData* temp = new BMSInfoData();
-						mDecryptor.BuildInfoData(temp, patternPathList[i].c_str());
+						BMSInfoData* temp = mInfoArena.Create();
+						pool.Push(temp, patternPathList[i]);
 						vec.emplace_back(temp);
+						listAdded.emplace_back(temp);
 						bIncPatternNum = true;
 					}
 					vec[i]->mSoundExtension = extension;
 				}
-				// sort pattern list if more than one pattern has been added
-				if (bIncPatternNum) {
-					std::sort(vec.begin(), vec.end(), mPatternSortFunc);
-					mChangeSave = true;
-				}
 				delete[] patternChecker;
 			}
-
-			// sort music list if more than one music has been added
-			if (bIncMusicNum) {
-				auto& vec = mDicBms[folderPath];
-				std::sort(vec.begin(), vec.end(), mMusicSortFunc);
-				mChangeSave = true;
-			}
 			delete[] folderChecker;
-		}
 
-		/// <summary> returns the appropriate music sort lambda function for the <paramref name="opt"/> parameter </summary>
-		std::function<bool(const BMSNode&, const BMSNode&)> GetMusicSortFunc(SortOption opt) {
-			if (opt == SortOption::PATH_ASC) {
-				return [](const BMSNode& lhs, const BMSNode& rhs)->bool {
-					return lhs.mFolderName < rhs.mFolderName;
-				};
-			} else if (opt == SortOption::LEVEL_ASC) {
-				return [](const BMSNode& lhs, const BMSNode& rhs)->bool {
-					if (lhs.mListData[0]->mLevel != rhs.mListData[0]->mLevel) {
-						return lhs.mListData[0]->mLevel < rhs.mListData[0]->mLevel;
-					}
-					return lhs.mFolderName < rhs.mFolderName;
-				};
-			} else if (opt == SortOption::TITLE_ASC) {
-				return [](const BMSNode& lhs, const BMSNode& rhs)->bool {
-					return lhs.mListData[0]->mTitle < rhs.mListData[0]->mTitle;
-				};
-			} else if (opt == SortOption::GENRE_ASC) {
-				return [](const BMSNode& lhs, const BMSNode& rhs)->bool {
-					return lhs.mListData[0]->mGenre < rhs.mListData[0]->mGenre;
-				};
-			} else if (opt == SortOption::ARTIST_ASC) {
-				return [](const BMSNode& lhs, const BMSNode& rhs)->bool {
-					return lhs.mListData[0]->mArtist < rhs.mListData[0]->mArtist;
-				};
-			} else if (opt == SortOption::BPM_ASC) {
-				return [](const BMSNode& lhs, const BMSNode& rhs)->bool {
-					return lhs.mListData[0]->mBpm < rhs.mListData[0]->mBpm;
-				};
-			} else if (opt == SortOption::PATH_DEC) {
-				return [](const BMSNode& lhs, const BMSNode& rhs)->bool {
-					return lhs.mFolderName > rhs.mFolderName;
-				};
-			} else if (opt == SortOption::LEVEL_DEC) {
-				return [](const BMSNode& lhs, const BMSNode& rhs)->bool {
-					if (lhs.mListData[0]->mLevel != rhs.mListData[0]->mLevel) {
-						return lhs.mListData[0]->mLevel > rhs.mListData[0]->mLevel;
-					}
-					return lhs.mFolderName > rhs.mFolderName;
-				};
-			} else if (opt == SortOption::TITLE_DEC) {
-				return [](const BMSNode& lhs, const BMSNode& rhs)->bool {
-					return lhs.mListData[0]->mTitle > rhs.mListData[0]->mTitle;
-				};
-			} else if (opt == SortOption::GENRE_DEC) {
-				return [](const BMSNode& lhs, const BMSNode& rhs)->bool {
-					return lhs.mListData[0]->mGenre > rhs.mListData[0]->mGenre;
-				};
-			} else if (opt == SortOption::ARTIST_DEC) {
-				return [](const BMSNode& lhs, const BMSNode& rhs)->bool {
-					return lhs.mListData[0]->mArtist > rhs.mListData[0]->mArtist;
-				};
-			} else if (opt == SortOption::BPM_DEC) {
-				return [](const BMSNode& lhs, const BMSNode& rhs)->bool {
-					return lhs.mListData[0]->mBpm > rhs.mListData[0]->mBpm;
-				};
-			}
-		}
-		/// <summary> returns the appropriate pattern sort lambda function for the <paramref name="opt"/> parameter </summary>
-		std::function<bool(BMSInfoData* const&, BMSInfoData* const&)> GetPatternSortFunc(SortOption opt) {
-			if (opt == SortOption::PATH_ASC) {
-				return [](BMSInfoData* const& lhs, BMSInfoData* const& rhs)->bool {
-					return lhs->mFilePath < rhs->mFilePath;
-				};
-			} else if (opt == SortOption::LEVEL_ASC) {
-				return [](BMSInfoData* const&lhs, BMSInfoData* const& rhs)->bool {
-					if (lhs->mLevel != rhs->mLevel) {
-						return lhs->mLevel < rhs->mLevel;
-					}
-					return lhs->mDifficulty < rhs->mDifficulty;
-				};
-			} else if (opt == SortOption::TITLE_ASC) {
-				return [](BMSInfoData* const& lhs, BMSInfoData* const& rhs)->bool {
-					return lhs->mTitle < rhs->mTitle;
-				};
-			} else if (opt == SortOption::GENRE_ASC) {
-				return [](BMSInfoData* const& lhs, BMSInfoData* const& rhs)->bool {
-					return lhs->mGenre < rhs->mGenre;
-				};
-			} else if (opt == SortOption::ARTIST_ASC) {
-				return [](BMSInfoData* const& lhs, BMSInfoData* const& rhs)->bool {
-					return lhs->mArtist < rhs->mArtist;
-				};
-			} else if (opt == SortOption::BPM_ASC) {
-				return [](BMSInfoData* const& lhs, BMSInfoData* const& rhs)->bool {
-					return lhs->mBpm < rhs->mBpm;
-				};
-			} else if (opt == SortOption::PATH_DEC) {
-				return [](BMSInfoData* const& lhs, BMSInfoData* const& rhs)->bool {
-					return lhs->mFilePath > rhs->mFilePath;
-				};
-			} else if (opt == SortOption::LEVEL_DEC) {
-				return [](BMSInfoData* const&lhs, BMSInfoData* const& rhs)->bool {
-					if (lhs->mLevel != rhs->mLevel) {
-						return lhs->mLevel > rhs->mLevel;
-					}
-					return lhs->mDifficulty > rhs->mDifficulty;
-				};
-			} else if (opt == SortOption::TITLE_DEC) {
-				return [](BMSInfoData* const& lhs, BMSInfoData* const& rhs)->bool {
-					return lhs->mTitle > rhs->mTitle;
-				};
-			} else if (opt == SortOption::GENRE_DEC) {
-				return [](BMSInfoData* const& lhs, BMSInfoData* const& rhs)->bool {
-					return lhs->mGenre > rhs->mGenre;
-				};
-			} else if (opt == SortOption::ARTIST_DEC) {
-				return [](BMSInfoData* const& lhs, BMSInfoData* const& rhs)->bool {
-					return lhs->mArtist > rhs->mArtist;
-				};
-			} else if (opt == SortOption::BPM_DEC) {
-				return [](BMSInfoData* const& lhs, BMSInfoData* const& rhs)->bool {
-					return lhs->mBpm > rhs->mBpm;
-				};
+			// wait for all BMSInfoData objects to be built before sorting
+			pool.Wait();
+
+			if (!bIncMusicNum && !bIncPatternNum) {
+				return;
+			}
+			for (auto data : listAdded) {
+				mSearchIndex.Add(data);
 			}
+			// build the orders again if more than one pattern or music has been added
+			BuildSortOrder(folderPath);
+			mChangeSave = true;
 		}
 	};
 }
\ No newline at end of file
@@ -1,6 +1,11 @@
 #pragma once
 
 #include "BMSData.h"
+#include "MappedFile.h"
+#include "LineScanner.h"
+
+#include <cstring>
+#include <string_view>
 
 namespace bms {
 	/// <summary> Max internal buffer size when read BMS file </summary>
@@ -10,17 +15,24 @@ namespace bms {
 
 	class BMSifstream {
 	public:
-		BMSifstream(const wchar_t* path) {
-			Open(path);
+		/// <param name="bMapped"> if it is true, map the file to memory and read lines without copying (UTF-16 is converted once) </param>
+		BMSifstream(const wchar_t* path, bool bMapped = false) {
+			Open(path, bMapped);
 		};
 		~BMSifstream() = default;
 		DISALLOW_COPY_AND_ASSIGN(BMSifstream)
 
 		/// <summary> Open ifstream and set the information according to the type of encoding read. </summary>
-		bool Open(const wchar_t* path) {
+		bool Open(const wchar_t* path, bool bMapped = false) {
 			if (file.is_open()) {
 				file.close();
 			}
+			mMap.Close();
+			mMapped = false;
+
+			if (bMapped && OpenMapped(path)) {
+				return true;
+			}
 
 			file.open(path, std::ios_base::binary);
 			if (!file.is_open()) {
@@ -61,13 +73,34 @@ namespace bms {
 		}
 
 		inline bool IsOpen() {
-			return file.is_open();
+			return mMapped || file.is_open();
 		}
 
 		inline EncodingType GetEncodeType() {
 			return mType;
 		}
 
+		/// <summary> check if lines are read from the memory mapped file (or converted buffer of UTF-16 file) </summary>
+		inline bool IsMapped() {
+			return mMapped;
+		}
+
+		/// <summary> 
+		/// return the unread part of the mapped file and move to the end of the file.
+		/// The result directly follows the last line read, so both make one contiguous range.
+		/// caution : only valid in mapped mode. 
+		/// </summary>
+		std::string_view ReadToEnd() {
+			if (!mMapped || bEof) {
+				return std::string_view();
+			}
+			std::string_view rest(mCursor, mEnd - mCursor);
+			mCursor = mEnd;
+			bEof = true;
+
+			return rest;
+		}
+
 		/// <summary> 
 		/// Read a line from the file stream and fill it with <paramref name="line"/> parameters.
 		/// caution : In case of EncodingType::UTF_16 BE or LE, it is automatically converted to UTF-8.
@@ -88,6 +121,54 @@ namespace bms {
 
 			return bSuccess;
 		}
+		/// <summary> 
+		/// Read a line and fill it with <paramref name="line"/> parameters without copying when the file is mapped.
+		/// caution : <paramref name="line"/> is not null-terminated and is valid until the next call or the file is closed.
+		/// In case of EncodingType::UTF_16 BE or LE, it is automatically converted to UTF-8.
+		/// </summary>
+		/// <param name="bSkipEmpty"> if it is true, ignore blank lines and read again </param>
+		bool GetLine(std::string_view& line, bool bSkipEmpty = true) {
+			if (!mMapped) {
+				bool bSuccess = GetLine(mLine, bSkipEmpty);
+				line = mLine;
+				return bSuccess;
+			}
+			if (bEof) return false;
+
+			do {
+				getLineMapped(line);
+			} while (bSkipEmpty && !bEof && line.empty());
+
+			// called when the last sentence of the file is empty.
+			if (bSkipEmpty && line.empty()) return false;
+
+			return true;
+		}
+		/// <summary> 
+		/// Read the next line that starts with '#' (= BMS command line) and fill it with <paramref name="line"/> parameters.
+		/// In mapped mode, the other lines are skipped by block scan without being read line by line.
+		/// caution : <paramref name="line"/> has the same lifetime as <see cref="GetLine(std::string_view&, bool)"/>.
+		/// </summary>
+		bool GetCommandLine(std::string_view& line) {
+			if (!mMapped) {
+				while (GetLine(line, true)) {
+					if (line[0] == '#') {
+						return true;
+					}
+				}
+				return false;
+			}
+			if (bEof) return false;
+
+			mCursor = Utility::FindCommandLine(mCursor, mEnd);
+			if (mCursor == mEnd) {
+				bEof = true;
+				return false;
+			}
+			getLineMapped(line);
+
+			return true;
+		}
 	private:
 		bool bEof;
 		EncodingType mType;
@@ -99,6 +180,86 @@ namespace bms {
 		char bufInternal[BUFFER_SIZE];
 		char bufRead[READ_BUFFER_SIZE];
 
+		// -- memory mapped mode
+
+		bool mMapped;					// true if lines are read from <see cref="mMap"/> instead of <see cref="file"/>
+		Utility::MappedFile mMap;
+		const char* mCursor;			// the first byte of the next line in the mapped file
+		const char* mEnd;				// the end of the mapped file
+		std::string mLine;				// line buffer used when string_view is requested in non-mapped mode
+		std::string mDecoded;			// UTF-8 converted content of the UTF-16 file in mapped mode
+
+		/// <summary> 
+		/// map the file and set the information according to the type of encoding read. 
+		/// UTF-16 files are converted to UTF-8 at once into <see cref="mDecoded"/> and the mapping is released.
+		/// </summary>
+		bool OpenMapped(const wchar_t* path) {
+			if (!mMap.Open(path)) {
+				return false;
+			}
+
+			const char* data = mMap.Data();
+			size_t size = mMap.Size();
+			uint8_t first = size > 0 ? data[0] : 0;
+			uint8_t second = size > 1 ? data[1] : 0;
+
+			mCursor = data;
+			mEnd = data + size;
+			if ((first == 254 && second == 255) || (first == 255 && second == 254)) {
+				mType = first == 254 ? EncodingType::UTF_16BE : EncodingType::UTF_16LE;
+				mDecoded.clear();
+				mDecoded.reserve(size);
+				Utility::UTF16ToUTF8(data + 2, data + size, mType == EncodingType::UTF_16BE, mDecoded);
+				mMap.Close();
+				mCursor = mDecoded.data();
+				mEnd = mCursor + mDecoded.size();
+			} else if (first == 239 && second == 187) {	// skip third character because there is no need to inspect
+				mType = EncodingType::UTF_8BOM;
+				mCursor += std::min<size_t>(3, size);
+			} else {
+				mType = EncodingType::UNKNOWN;
+			}
+			getLine = &bms::BMSifstream::getLineFromMapped;
+
+			bEof = false;
+			mMapped = true;
+			return true;
+		}
+
+		/// <summary> 
+		/// get string view from the mapped file. CRLF is stripped like <see cref="getLineDefault"/>.
+		/// <see cref="bEof"/> is set when there is no more line after the <paramref name="result"/>.
+		/// </summary>
+		void getLineMapped(std::string_view& result) {
+			const char* first = mCursor;
+			if (first == mEnd) {
+				bEof = true;
+				result = std::string_view();
+				return;
+			}
+
+			const char* last = Utility::FindNewLine(first, mEnd);
+			if (last == mEnd) {
+				mCursor = mEnd;
+				bEof = true;
+			} else {
+				mCursor = last + 1;
+			}
+			if (last != first && *(last - 1) == '\r') {
+				--last;
+			}
+
+			result = std::string_view(first, last - first);
+		}
+		/// <summary> copy the line of the mapped file to <paramref name="result"/>. used by <see cref="GetLine(std::string&)"/> </summary>
+		bool getLineFromMapped(std::string& result) {
+			std::string_view view;
+			getLineMapped(view);
+			result.append(view.data(), view.size());
+
+			return true;
+		}
+
 		/// <summary>
 		/// get string from <see cref="bufRead"/>.
 		/// When the buffer is finished, <see cref="std::ifstream::read"/> function is called.
@@ -136,67 +297,55 @@ namespace bms {
 		}
 
 		/// <summary> 
-		/// parse buffer char to UTF8 and save in <paramref name="str"/>.
+		/// convert <paramref name="length"/> code units of buffer to UTF8 and append it to <paramref name="str"/>.
 		/// only use for UTF-16 file decrypting.
 		/// </summary>
-		/// <param name="bIncludedWide"> check if the string needs to be converted. </param>
-		void fillStringByUTF8(std::string& str, uint16_t firstIndex, uint16_t length, bool bBigEndian, bool bIncludedWide) {
-			if (bIncludedWide) {
-				wchar_t* temp = new wchar_t[length];
-				if (bBigEndian) {
-					for (uint16_t i = 0; i < length; ++i) {
-						temp[i] = (bufRead[firstIndex + i * 2] << 4) + bufRead[firstIndex + i * 2 + 1];
-					}
-				} else {
-					for (uint16_t i = 0; i < length; ++i) {
-						temp[i] = (bufRead[firstIndex + i * 2 + 1] << 4) + bufRead[firstIndex + i * 2];
-					}
+		inline void fillStringByUTF8(std::string& str, uint16_t firstIndex, uint16_t length, bool bBigEndian) {
+			Utility::UTF16ToUTF8(&bufRead[firstIndex], &bufRead[firstIndex + length * 2], bBigEndian, str);
+		}
+		/// <summary>
+		/// convert the code units of the buffer from <paramref name="firstIndex"/> to UTF8 and read the next block of the file.
+		/// a high surrogate at the end of the block is carried over to the start of the next block, so the pair split by the block is combined.
+		/// return false if there is nothing more to read
+		/// </summary>
+		bool refillUTF16(std::string& result, uint16_t firstIndex, bool bBigEndian) {
+			uint16_t units = static_cast<uint16_t>((readIndex - firstIndex) / 2);
+			uint16_t carry = 0;
+			if (units > 0) {
+				const uint8_t* last = reinterpret_cast<const uint8_t*>(&bufRead[firstIndex + (units - 1) * 2]);
+				uint16_t unit = bBigEndian ? (last[0] << 8) | last[1] : last[0] | (last[1] << 8);
+				if (unit >= 0xD800 && unit <= 0xDBFF) {
+					carry = 2;
+					--units;
 				}
-
-				str.append(Utility::WideToUTF8(temp));
-				/*int utfLen = WideCharToMultiByte(CP_UTF8, 0, temp, static_cast<int>(length), NULL, 0, NULL, NULL);
-				uint16_t originLen = static_cast<uint16_t>(str.size());
-				str.resize(originLen + utfLen);
-				WideCharToMultiByte(CP_UTF8, 0, temp, static_cast<int>(length), &str[originLen], utfLen, NULL, NULL);*/
-				delete[] temp;
-			} else {
-				char* temp = new char[length];
-				if (bBigEndian) {
-					for (uint16_t i = 0; i < length; ++i) {
-						temp[i] = bufRead[firstIndex + i * 2 + 1];
-					}
-				} else {
-					for (uint16_t i = 0; i < length; ++i) {
-						temp[i] = bufRead[firstIndex + i * 2];
-					}
+				fillStringByUTF8(result, firstIndex, units, bBigEndian);
+				if (carry != 0) {
+					memmove(bufRead, last, carry);
 				}
-				str.append(temp, length);
-				delete[] temp;
 			}
+
+			file.read(bufRead + carry, READ_BUFFER_SIZE - carry);
+			uint16_t count = static_cast<uint16_t>(file.gcount());
+			if (count == 0 && carry != 0) {
+				fillStringByUTF8(result, 0, 1, bBigEndian);	// unpaired at the end of the file
+			}
+			readCount = count == 0 ? 0 : count + carry;
+			readIndex = count == 0 ? 0 : carry;
+			return count != 0;
 		}
 		/// <summary> same as <see cref="getLineDefault"/> function, but use for UTF-16BE. </summary>
 		bool getLineUTF16BE(std::string& result) {
 			uint16_t firstIndex = readIndex;
-			bool bIncludedWide = false;
 			char ch;
 			do {
 				if (readIndex == readCount) {
-					if (readIndex != firstIndex) {
-						fillStringByUTF8(result, firstIndex, static_cast<uint16_t>((readIndex - firstIndex) * .5), true, bIncludedWide);
-						bIncludedWide = false;
-					}
-
-					file.read(bufRead, READ_BUFFER_SIZE);
-					readCount = static_cast<uint16_t>(file.gcount());
-					readIndex = 0;
+					bEof = !refillUTF16(result, firstIndex, true);
 					firstIndex = 0;
-
-					if (bEof = readCount == 0) {
+					if (bEof) {
 						break;
 					}
 				}
 
-				bIncludedWide |= bufRead[readIndex] != '\0';
 				ch = bufRead[(++readIndex)++];
 			} while (ch != '\n');
 
@@ -207,7 +356,7 @@ namespace bms {
 			} else {
 				uint8_t skip = bufRead[readIndex - 3] == '\r' ? 4 : 2;
 				if ((readIndex - skip) != firstIndex) {
-					fillStringByUTF8(result, firstIndex, static_cast<uint16_t>((readIndex - firstIndex - skip) * .5), true, bIncludedWide);
+					fillStringByUTF8(result, firstIndex, static_cast<uint16_t>((readIndex - firstIndex - skip) * .5), true);
 				}
 			}
 
@@ -216,27 +365,18 @@ namespace bms {
 		/// <summary> same as <see cref="getLineDefault"/> function, but use for UTF-16LE. </summary>
 		bool getLineUTF16LE(std::string& result) {
 			uint16_t firstIndex = readIndex;
-			bool bIncludedWide = false;
 			char ch;
 			do {
 				if (readIndex == readCount) {
-					if (readIndex != firstIndex) {
-						fillStringByUTF8(result, firstIndex, static_cast<uint16_t>((readIndex - firstIndex) * .5), false, bIncludedWide);
-						bIncludedWide = false;
-					}
-
-					file.read(bufRead, READ_BUFFER_SIZE);
-					readCount = static_cast<uint16_t>(file.gcount());
-					readIndex = 0;
+					bEof = !refillUTF16(result, firstIndex, false);
 					firstIndex = 0;
-
-					if (bEof = readCount == 0) {
+					if (bEof) {
 						break;
 					}
 				}
 
 				ch = bufRead[readIndex];
-				bIncludedWide |= bufRead[(++readIndex)++] != '\0';
+				readIndex += 2;
 			} while (ch != '\n');
 
 			if (readIndex <= 2) {
@@ -246,7 +386,7 @@ namespace bms {
 			} else {
 				uint8_t skip = bufRead[readIndex - 4] == '\r' ? 4 : 2;
 				if ((readIndex - skip) != firstIndex) {
-					fillStringByUTF8(result, firstIndex, static_cast<uint16_t>((readIndex - firstIndex - skip) * .5), false, bIncludedWide);
+					fillStringByUTF8(result, firstIndex, static_cast<uint16_t>((readIndex - firstIndex - skip) * .5), false);
 				}
 			}
 
@@ -0,0 +1,175 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+// reference : https://docs.microsoft.com/en-us/windows/win32/intl/code-page-identifiers
+//			   https://en.wikipedia.org/wiki/Unified_Hangul_Code
+namespace Utility {
+	constexpr size_t CP932_LEAD_COUNT = 60;		// 0x81-0x9F, 0xE0-0xFC
+	constexpr size_t CP932_TRAIL_COUNT = 188;	// 0x40-0x7E, 0x80-0xFC
+	constexpr size_t KS_X_1001_SIZE = 94;		// 0xA1-0xFE
+	/// <summary> the maximum bytes of UTF-8 for one byte of CP932 or CP949 (half-width katakana : 1 byte -> 3 bytes) </summary>
+	constexpr size_t CODE_PAGE_UTF8_RATIO = 3;
+
+	extern const uint16_t CP932_TABLE[CP932_LEAD_COUNT * CP932_TRAIL_COUNT];
+	extern const uint16_t CP949_KS_TABLE[KS_X_1001_SIZE * KS_X_1001_SIZE];
+
+	/// <summary> decoders of one character. return the code point (0 if it is not assigned) and the number of used bytes in <paramref name="length"/> </summary>
+	namespace codepage {
+		constexpr uint16_t HANGUL_FIRST = 0xAC00;
+		constexpr uint16_t HANGUL_LAST = 0xD7A3;
+		constexpr size_t KS_HANGUL_ROW = 0xB0 - 0xA1;	// 2350 hangul syllables of KS X 1001 are in the rows 0xB0-0xC8 in ascending order
+		constexpr size_t KS_HANGUL_COUNT = 2350;
+
+		inline uint16_t DecodeCP932(const uint8_t* p, const uint8_t* last, size_t& length) noexcept {
+			uint8_t lead = *p;
+			length = 1;
+			if (lead >= 0xA1 && lead <= 0xDF) {
+				return static_cast<uint16_t>(0xFF61 + lead - 0xA1);	// half-width katakana
+			}
+			if (!((lead >= 0x81 && lead <= 0x9F) || (lead >= 0xE0 && lead <= 0xFC)) || p + 1 == last) {
+				return 0;
+			}
+			uint8_t trail = p[1];
+			if (trail < 0x40 || trail == 0x7F || trail > 0xFC) {
+				return 0;
+			}
+			length = 2;
+			size_t row = lead < 0xA0 ? lead - 0x81 : lead - 0xE0 + 0x1F;
+			size_t col = trail < 0x7F ? trail - 0x40 : trail - 0x41;
+			return CP932_TABLE[row * CP932_TRAIL_COUNT + col];
+		}
+
+		/// <summary>
+		/// return the <paramref name="index"/>-th hangul syllable that is not in KS X 1001. CP949 assigns them to the extended area in order,
+		/// so it is found by the binary search of KS X 1001 hangul syllables without another table.
+		/// </summary>
+		inline uint16_t GetExtendedHangul(size_t index) noexcept {
+			const uint16_t* ks = CP949_KS_TABLE + KS_HANGUL_ROW * KS_X_1001_SIZE;
+			// the number of KS X 1001 syllables before the result (= ks[k] - HANGUL_FIRST - k <= index)
+			size_t low = 0, high = KS_HANGUL_COUNT;
+			while (low < high) {
+				size_t mid = (low + high) / 2;
+				if (ks[mid] - HANGUL_FIRST - mid <= index) {
+					low = mid + 1;
+				} else {
+					high = mid;
+				}
+			}
+			size_t cp = HANGUL_FIRST + index + low;
+			return cp <= HANGUL_LAST ? static_cast<uint16_t>(cp) : 0;
+		}
+
+		inline uint16_t DecodeCP949(const uint8_t* p, const uint8_t* last, size_t& length) noexcept {
+			uint8_t lead = *p;
+			length = 1;
+			if (lead < 0x81 || lead > 0xFE || p + 1 == last) {
+				return 0;
+			}
+			uint8_t trail = p[1];
+			if (lead >= 0xA1 && trail >= 0xA1 && trail <= 0xFE) {
+				length = 2;
+				return CP949_KS_TABLE[(lead - 0xA1) * KS_X_1001_SIZE + (trail - 0xA1)];
+			}
+			// extended hangul : lead 0x81-0xA0 (trail 0x41-0x5A, 0x61-0x7A, 0x81-0xFE), lead 0xA1-0xC6 (trail 0x41-0x5A, 0x61-0x7A, 0x81-0xA0)
+			size_t col;
+			if (trail >= 0x41 && trail <= 0x5A) {
+				col = trail - 0x41;
+			} else if (trail >= 0x61 && trail <= 0x7A) {
+				col = trail - 0x61 + 26;
+			} else if (trail >= 0x81 && trail <= 0xFE) {
+				col = trail - 0x81 + 52;
+			} else {
+				return 0;
+			}
+			if (lead > 0xC6) {
+				return 0;
+			}
+			length = 2;
+			size_t index = lead <= 0xA0 ? (lead - 0x81) * 178 + col : 32 * 178 + (lead - 0xA1) * 84 + col;
+			return GetExtendedHangul(index);
+		}
+
+		/// <summary> write <paramref name="cp"/> (BMP) in UTF-8 and return the next position </summary>
+		inline char* EncodeUTF8(uint16_t cp, char* out) noexcept {
+			if (cp < 0x80) {
+				*out++ = static_cast<char>(cp);
+			} else if (cp < 0x800) {
+				*out++ = static_cast<char>(0xC0 | (cp >> 6));
+				*out++ = static_cast<char>(0x80 | (cp & 0x3F));
+			} else {
+				*out++ = static_cast<char>(0xE0 | (cp >> 12));
+				*out++ = static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+				*out++ = static_cast<char>(0x80 | (cp & 0x3F));
+			}
+			return out;
+		}
+
+		/// <summary> convert [<paramref name="first"/>, <paramref name="last"/>) with <paramref name="decode"/>. runs of ASCII are copied 8 bytes at a time </summary>
+		template<typename Decoder>
+		inline size_t ToUTF8(const char* first, const char* last, char* out, Decoder decode, size_t* pInvalidCount) noexcept {
+			const uint8_t* p = reinterpret_cast<const uint8_t*>(first);
+			const uint8_t* end = reinterpret_cast<const uint8_t*>(last);
+			char* o = out;
+			size_t invalid = 0;
+			while (p != end) {
+				if (end - p >= 8) {
+					uint64_t block;
+					memcpy(&block, p, 8);
+					if ((block & 0x8080808080808080ull) == 0) {
+						memcpy(o, p, 8);
+						p += 8, o += 8;
+						continue;
+					}
+				}
+				if (*p < 0x80) {
+					*o++ = static_cast<char>(*p++);
+					continue;
+				}
+				size_t length;
+				uint16_t cp = decode(p, end, length);
+				if (cp == 0) {
+					cp = 0xFFFD;	// not assigned or broken -> replacement character
+					++invalid;
+				}
+				o = EncodeUTF8(cp, o);
+				p += length;
+			}
+			if (pInvalidCount) {
+				*pInvalidCount = invalid;
+			}
+			return o - out;
+		}
+	}
+
+	/// <summary>
+	/// convert CP932 (Shift-JIS) bytes in [<paramref name="first"/>, <paramref name="last"/>) to UTF-8 and write it to <paramref name="out"/>.
+	/// <paramref name="out"/> must have <see cref="CODE_PAGE_UTF8_RATIO"/> * (last - first) bytes. invalid characters are replaced with U+FFFD.
+	/// return the number of written bytes. no locale and no allocation are used
+	/// </summary>
+	inline size_t CP932ToUTF8(const char* first, const char* last, char* out, size_t* pInvalidCount = nullptr) noexcept {
+		return codepage::ToUTF8(first, last, out, codepage::DecodeCP932, pInvalidCount);
+	}
+	/// <summary> convert CP949 (EUC-KR, Unified Hangul Code) bytes to UTF-8. same as <see cref="CP932ToUTF8"/> </summary>
+	inline size_t CP949ToUTF8(const char* first, const char* last, char* out, size_t* pInvalidCount = nullptr) noexcept {
+		return codepage::ToUTF8(first, last, out, codepage::DecodeCP949, pInvalidCount);
+	}
+
+	/// <summary> replace <paramref name="out"/> with UTF-8 of CP932 string <paramref name="s"/>. return false if there is an invalid character </summary>
+	inline bool CP932ToUTF8(std::string_view s, std::string& out) {
+		out.resize(s.size() * CODE_PAGE_UTF8_RATIO);
+		size_t invalid;
+		out.resize(CP932ToUTF8(s.data(), s.data() + s.size(), &out[0], &invalid));
+		return invalid == 0;
+	}
+	/// <summary> replace <paramref name="out"/> with UTF-8 of CP949 string <paramref name="s"/>. return false if there is an invalid character </summary>
+	inline bool CP949ToUTF8(std::string_view s, std::string& out) {
+		out.resize(s.size() * CODE_PAGE_UTF8_RATIO);
+		size_t invalid;
+		out.resize(CP949ToUTF8(s.data(), s.data() + s.size(), &out[0], &invalid));
+		return invalid == 0;
+	}
+}
\ No newline at end of file
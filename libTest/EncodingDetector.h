@@ -0,0 +1,268 @@
+#pragma once
+
+#include "Utility.h"
+#include "BMSEnums.h"
+
+#include <array>
+
+// reference : https://encoding.spec.whatwg.org/ (shift_jis, euc-kr decoders)
+//			   https://www.unicode.org/versions/Unicode13.0.0/ch03.pdf (Table 3-7. Well-Formed UTF-8 Byte Sequences)
+namespace bms {
+	/// <summary> byte tables of <see cref="bms::EncodingDetector"/> </summary>
+	namespace encoding {
+		enum class ByteClass : uint8_t {
+			ASCII,
+			SINGLE,			// single byte character (Shift-JIS half-width katakana)
+			LEAD,			// lead byte of double-byte character
+			INVALID,
+		};
+
+		/// <summary> byte class of Shift-JIS : lead 0x81-0x9F, 0xE0-0xFC, half-width katakana 0xA1-0xDF </summary>
+		constexpr ByteClass GetSjisClass(uint8_t b) {
+			return b < 0x80 ? ByteClass::ASCII : (b >= 0xA1 && b <= 0xDF) ? ByteClass::SINGLE :
+				   ((b >= 0x81 && b <= 0x9F) || (b >= 0xE0 && b <= 0xFC)) ? ByteClass::LEAD : ByteClass::INVALID;
+		}
+		/// <summary> byte class of CP949 : lead 0x81-0xFE </summary>
+		constexpr ByteClass GetCp949Class(uint8_t b) {
+			return b < 0x80 ? ByteClass::ASCII : (b >= 0x81 && b <= 0xFE) ? ByteClass::LEAD : ByteClass::INVALID;
+		}
+
+		/// <summary> score of a Shift-JIS character by lead byte. kana and level 1 kanji are common in Japanese text </summary>
+		constexpr int8_t GetSjisWeight(uint8_t lead) {
+			return (lead == 0x82 || lead == 0x83) ? 3 :					// hiragana, katakana, full-width alphanumeric
+				   (lead >= 0x88 && lead <= 0x98) ? 2 :					// JIS level 1 kanji
+				   (lead == 0x81 || lead == 0x84) ? 1 :					// symbols, greek, cyrillic
+				   ((lead >= 0x99 && lead <= 0x9F) || (lead >= 0xE0 && lead <= 0xEA)) ? 1 :	// JIS level 2 kanji
+				   (lead == 0x87 || lead == 0xED || lead == 0xEE || (lead >= 0xFA && lead <= 0xFC)) ? 0 :	// NEC, IBM extensions
+				   (lead >= 0xA1 && lead <= 0xDF) ? 1 : -1;				// half-width katakana, unassigned or user-defined
+		}
+		/// <summary> score of a KS X 1001 character (0xA1-0xFE trail byte) by lead byte. hangul syllables are common in Korean text </summary>
+		constexpr int8_t GetKsWeight(uint8_t lead) {
+			return (lead >= 0xB0 && lead <= 0xC8) ? 3 :					// hangul syllables
+				   (lead == 0xAA || lead == 0xAB) ? 2 :					// hiragana, katakana
+				   (lead >= 0xA1 && lead <= 0xAC) ? 1 :					// symbols, jamo, alphabets
+				   (lead >= 0xCA && lead <= 0xFD) ? 1 : -1;				// hanja, unassigned or user-defined
+		}
+
+		template<typename T, typename F>
+		constexpr std::array<T, 256> MakeTable(F func) {
+			std::array<T, 256> table = {};
+			for (int i = 0; i < 256; ++i) {
+				table[i] = func(static_cast<uint8_t>(i));
+			}
+			return table;
+		}
+
+		inline constexpr std::array<ByteClass, 256> SJIS_CLASS = MakeTable<ByteClass>(GetSjisClass);
+		inline constexpr std::array<ByteClass, 256> CP949_CLASS = MakeTable<ByteClass>(GetCp949Class);
+		inline constexpr std::array<int8_t, 256> SJIS_WEIGHT = MakeTable<int8_t>(GetSjisWeight);
+		inline constexpr std::array<int8_t, 256> KS_WEIGHT = MakeTable<int8_t>(GetKsWeight);
+	}
+
+	/// <summary>
+	/// A single pass classifier of UTF-8, Shift-JIS (CP932) and EUC-KR (CP949) text.
+	/// All bytes are checked by the three decoders at the same time without conversion.
+	/// The legacy encodings are scored by the kind of each double-byte character (hangul, kana, kanji...) using tables of lead bytes,
+	/// because most EUC-KR text is also valid Shift-JIS and vice versa.
+	/// Text is fed field by field with <see cref="Feed"/>, and the rest is skipped once the encoding is confirmed.
+	/// </summary>
+	class EncodingDetector {
+		static constexpr uint32_t CONFIRM_UTF8_COUNT = 16;	// well-formed multi-byte sequences to confirm UTF-8
+		static constexpr uint32_t CONFIRM_CHAR_COUNT = 8;	// double-byte characters to confirm the only valid legacy encoding
+		static constexpr int CONFIRM_SCORE = 48;			// score difference to confirm one of the legacy encodings
+
+	public:
+		EncodingDetector() { Reset(); }
+
+		void Reset() {
+			mResult = EncodingType::UNKNOWN;
+			mbUtf8 = mbSjis = mbCp949 = true;
+			mUtf8Need = 0;
+			mUtf8Low = 0x80, mUtf8High = 0xBF;
+			mSjisLead = mCp949Lead = 0;
+			mUtf8Count = mSjisCount = mCp949Count = 0;
+			mSjisScore = mCp949Score = 0;
+		}
+
+		/// <summary> return true if the encoding is confirmed and the next text doesn't need to be fed </summary>
+		inline bool IsConfirmed() const {
+			return mResult != EncodingType::UNKNOWN;
+		}
+
+		/// <summary>
+		/// check the bytes of <paramref name="text"/>. each call is a separate field, so an incomplete character at the end is ignored.
+		/// </summary>
+		void Feed(std::string_view text) {
+			if (IsConfirmed()) {
+				return;
+			}
+			const uint8_t* p = reinterpret_cast<const uint8_t*>(text.data());
+			const uint8_t* last = p + text.size();
+			for (; p != last; ++p) {
+				uint8_t b = *p;
+				// ASCII outside of a character is the same in all encodings
+				if (b < 0x80 && (mUtf8Need | mSjisLead | mCp949Lead) == 0) {
+					continue;
+				}
+				if (mbUtf8) FeedUtf8(b);
+				if (mbSjis) FeedSjis(b);
+				if (mbCp949) FeedCp949(b);
+				if ((mUtf8Need | mSjisLead | mCp949Lead) == 0 && CheckConfirmed()) {
+					return;
+				}
+			}
+			// the field is over. the incomplete character is not joined with the next field
+			mUtf8Need = 0;
+			mUtf8Low = 0x80, mUtf8High = 0xBF;
+			mSjisLead = mCp949Lead = 0;
+		}
+
+		/// <summary>
+		/// return the encoding of all fed text.
+		/// check order : UTF-8 (include english only) -> the only valid legacy encoding -> the higher score (Shift-JIS if same)
+		/// </summary>
+		EncodingType GetResult() const {
+			if (IsConfirmed()) {
+				return mResult;
+			}
+			if (mbUtf8) {
+				return EncodingType::UTF_8;
+			}
+			if (mbSjis != mbCp949) {
+				return mbSjis ? EncodingType::SHIFT_JIS : EncodingType::EUC_KR;
+			}
+			if (mbSjis) {
+				return mCp949Score > mSjisScore ? EncodingType::EUC_KR : EncodingType::SHIFT_JIS;
+			}
+			// broken text in all encodings
+			return mSjisScore > mCp949Score ? EncodingType::SHIFT_JIS : EncodingType::EUC_KR;
+		}
+
+		/// <summary> return the encoding of <paramref name="text"/> </summary>
+		static EncodingType Detect(std::string_view text) {
+			EncodingDetector detector;
+			detector.Feed(text);
+			return detector.GetResult();
+		}
+
+	private:
+		EncodingType mResult;
+		bool mbUtf8, mbSjis, mbCp949;		// false if an invalid sequence is found in the encoding
+		uint8_t mUtf8Need;					// the number of remaining continuation bytes
+		uint8_t mUtf8Low, mUtf8High;		// range of the next continuation byte (excludes overlong forms and surrogates)
+		uint8_t mSjisLead, mCp949Lead;		// lead byte waiting for the trail byte (0 : none)
+		uint32_t mUtf8Count, mSjisCount, mCp949Count;	// the number of multi-byte characters
+		int mSjisScore, mCp949Score;
+
+		inline void FeedUtf8(uint8_t b) {
+			if (mUtf8Need > 0) {
+				if (b < mUtf8Low || b > mUtf8High) {
+					mbUtf8 = false;
+					mUtf8Need = 0;
+					return;
+				}
+				mUtf8Low = 0x80, mUtf8High = 0xBF;
+				if (--mUtf8Need == 0) {
+					++mUtf8Count;
+				}
+				return;
+			}
+			if (b < 0x80) {
+				return;
+			} else if (b >= 0xC2 && b <= 0xDF) {
+				mUtf8Need = 1;
+			} else if (b >= 0xE0 && b <= 0xEF) {
+				mUtf8Need = 2;
+				if (b == 0xE0) mUtf8Low = 0xA0;
+				else if (b == 0xED) mUtf8High = 0x9F;
+			} else if (b >= 0xF0 && b <= 0xF4) {
+				mUtf8Need = 3;
+				if (b == 0xF0) mUtf8Low = 0x90;
+				else if (b == 0xF4) mUtf8High = 0x8F;
+			} else {
+				mbUtf8 = false;
+			}
+		}
+
+		inline void FeedSjis(uint8_t b) {
+			if (mSjisLead != 0) {
+				uint8_t lead = mSjisLead;
+				mSjisLead = 0;
+				if (b < 0x40 || b == 0x7F || b > 0xFC) {
+					mbSjis = false;
+					return;
+				}
+				mSjisScore += encoding::SJIS_WEIGHT[lead];
+				++mSjisCount;
+				return;
+			}
+			switch (encoding::SJIS_CLASS[b]) {
+			case encoding::ByteClass::ASCII:
+				break;
+			case encoding::ByteClass::SINGLE:
+				mSjisScore += encoding::SJIS_WEIGHT[b];
+				break;
+			case encoding::ByteClass::LEAD:
+				mSjisLead = b;
+				break;
+			default:
+				mbSjis = false;
+				break;
+			}
+		}
+
+		inline void FeedCp949(uint8_t b) {
+			if (mCp949Lead != 0) {
+				uint8_t lead = mCp949Lead;
+				mCp949Lead = 0;
+				if (lead >= 0xA1 && b >= 0xA1 && b <= 0xFE) {
+					// KS X 1001 (EUC-KR)
+					mCp949Score += encoding::KS_WEIGHT[lead];
+				} else if (lead > 0xC6 || !((b >= 0x41 && b <= 0x5A) || (b >= 0x61 && b <= 0x7A) || (b >= 0x81 && b <= 0xFE))) {
+					// not a hangul syllable extended by CP949 either. extended syllables are valid but rarely used, so no score
+					mbCp949 = false;
+					return;
+				}
+				++mCp949Count;
+				return;
+			}
+			switch (encoding::CP949_CLASS[b]) {
+			case encoding::ByteClass::ASCII:
+				break;
+			case encoding::ByteClass::LEAD:
+				mCp949Lead = b;
+				break;
+			default:
+				mbCp949 = false;
+				break;
+			}
+		}
+
+		/// <summary> set <see cref="mResult"/> if only one encoding is possible. return true if it is set </summary>
+		inline bool CheckConfirmed() {
+			if (mbUtf8) {
+				if (mUtf8Count >= CONFIRM_UTF8_COUNT) {
+					mResult = EncodingType::UTF_8;
+				}
+			} else if (mbSjis && !mbCp949) {
+				if (mSjisCount >= CONFIRM_CHAR_COUNT) {
+					mResult = EncodingType::SHIFT_JIS;
+				}
+			} else if (mbCp949 && !mbSjis) {
+				if (mCp949Count >= CONFIRM_CHAR_COUNT) {
+					mResult = EncodingType::EUC_KR;
+				}
+			} else if (mbSjis && mbCp949) {
+				if (mSjisScore - mCp949Score >= CONFIRM_SCORE) {
+					mResult = EncodingType::SHIFT_JIS;
+				} else if (mCp949Score - mSjisScore >= CONFIRM_SCORE) {
+					mResult = EncodingType::EUC_KR;
+				}
+			} else {
+				// broken text in all encodings. the scores don't change anymore
+				mResult = GetResult();
+			}
+			return IsConfirmed();
+		}
+	};
+}
\ No newline at end of file
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "AudioBackend.h"
 #include "fmod.hpp"
 #include <iostream>
 #include <unordered_map>
@@ -11,11 +12,11 @@ namespace bms {
 	/// information : https://documentation.help/FMOD-API/introduction.html
 	///				  https://www.fmod.com/resources/documentation-api?version=2.0&page=core-api-system.html
 	/// </summary>
-	class FMODWrapper {
+	class FMODWrapper : public AudioBackend {
 	public: 
 		int sLoadedMusicNum;		// The number of music currently loaded
 
-		FMODWrapper() = default;
+		FMODWrapper() : mInitialized(false), mMaster(nullptr), mStartClock(0), mSampleRate(0) {}
 		~FMODWrapper() {
 			if (mInitialized) {
 				ReleaseAllSounds();
@@ -29,12 +30,12 @@ namespace bms {
 		FMODWrapper(FMODWrapper&& others) noexcept = default;
 		FMODWrapper& operator=(FMODWrapper&&) noexcept = default;
 
-		inline bool IsInitialized() {
+		inline bool IsInitialized() const override {
 			return mInitialized;
 		}
 
 		/// <summary> Function to initialize local variables needed for FMOD system </summary>
-		bool Init() {
+		bool Init() override {
 			mInitialized = false;
 			result = FMOD::System_Create(&system);
 			if (IsJobFailed("System_Create failed")) return false;
@@ -50,6 +51,12 @@ namespace bms {
 			result = system->init(1024, FMOD_INIT_NORMAL, extradriverdata);
 			if (IsJobFailed("system->init failed")) return false;
 
+			// the DSP clock of the master channel group is the audio clock of the scheduled sounds
+			result = system->getMasterChannelGroup(&mMaster);
+			if (IsJobFailed("system->getMasterChannelGroup failed")) return false;
+			result = system->getSoftwareFormat(&mSampleRate, 0, 0);
+			if (IsJobFailed("system->getSoftwareFormat failed")) return false;
+
 			sLoadedMusicNum = 0;
 			mInitialized = true;
 
@@ -57,7 +64,7 @@ namespace bms {
 		}
 
 		/// <summary> Function to periodically update the FMOD system </summary>
-		void Update() {
+		void Update() override {
 			if (!mInitialized) {
 				return;
 			}
@@ -76,7 +83,7 @@ namespace bms {
 		/// <summary>
 		/// create <see cref="FMOD::Sound"/> files and put it in the <paramref name="key"/> value of <see cref="mDicSound"/> dictionary.
 		/// </summary>
-		void CreateSound(const std::string& filePath, int key) {
+		void CreateSound(const std::string& filePath, int key) override {
 			// sound option reference : https://documentation.help/FMOD-API/FMOD_MODE.html
 			FMOD::Sound* sound;
 			result = system->createSound(filePath.c_str(), FMOD_LOOP_OFF | FMOD_LOWMEM, 0, &sound);
@@ -131,7 +138,8 @@ namespace bms {
 		/// <summary>
 		/// release all <see cref="FMOD::Sound"/> file memories in <paramref name="folderPath"/> and clear dictionary.
 		/// </summary>
-		void ReleaseAllSounds() {
+		void ReleaseAllSounds() override {
+			std::lock_guard<std::mutex> guard{mMutex};
 			for (std::pair<int, FMOD::Sound*> element : mDicSound) {
 				element.second->release();
 				if (!IsJobFailed("FMOD::Sound->release failed")) {
@@ -142,12 +150,45 @@ namespace bms {
 		}
 
 		/// <summary>
-		/// play sound file in <paramref name="folderPath"/> dictionary.
+		/// play sound file in <paramref name="folderPath"/> dictionary. the sound is played immediately, so the times are not used.
 		/// </summary>
-		inline void PlaySingleSound(int key) {
-			FMOD::Sound* sound = mDicSound[key];
+		inline void PlaySingleSound(int key, long long /*noteTime*/, long long /*playTime*/) override {
+			FMOD::Sound* sound = FindSound(key);
+			if (sound == nullptr) return;
 			result = system->playSound(sound, 0, false, &channel);
-			IsJobFailed("PlaySound failed : " + key);
+			IsJobFailed("PlaySound failed : " + std::to_string(key));
+		}
+
+		inline bool CanSchedule() const override {
+			return mInitialized && mSampleRate > 0;
+		}
+
+		void StartClock() override {
+			mMaster->getDSPClock(&mStartClock, 0);
+		}
+
+		/// <summary> the samples mixed from <see cref="StartClock"/> in microseconds. it advances by the mixer blocks </summary>
+		long long GetClockTime() const override {
+			unsigned long long clock = 0;
+			mMaster->getDSPClock(&clock, 0);
+			return static_cast<long long>((clock - mStartClock) * 1000000 / mSampleRate);
+		}
+
+		/// <summary>
+		/// play the sound paused and set the delay of the channel to the DSP clock of <paramref name="noteTime"/>, so it starts at the exact sample.
+		/// the clock that is already passed starts it immediately, so the start is the later of the delay and the current DSP clock
+		/// </summary>
+		long long ScheduleSound(int key, long long noteTime, long long playTime) override {
+			FMOD::Sound* sound = FindSound(key);
+			if (sound == nullptr) return playTime;
+			result = system->playSound(sound, 0, true, &channel);
+			if (IsJobFailed("PlaySound failed")) return playTime;
+			unsigned long long startClock = mStartClock + static_cast<unsigned long long>(noteTime) * mSampleRate / 1000000;
+			channel->setDelay(startClock, 0, false);
+			channel->setPaused(false);
+			unsigned long long clock = 0;
+			mMaster->getDSPClock(&clock, 0);
+			return static_cast<long long>((std::max(startClock, clock) - mStartClock) * 1000000 / mSampleRate);
 		}
 
 	private:
@@ -159,9 +200,20 @@ namespace bms {
 		unsigned int version;
 		void* extradriverdata = 0;
 
+		FMOD::ChannelGroup* mMaster;
+		unsigned long long mStartClock;			// the DSP clock at the start of the play
+		int mSampleRate;						// the sample rate of the DSP clock
+
 		std::mutex mMutex;
 		std::unordered_map<int, FMOD::Sound*, Utility::Bypass> mDicSound;
 
+		/// <summary> return the sound of <paramref name="key"/>, or nullptr if it is not created yet. the sounds are created by the loading threads at the same time </summary>
+		FMOD::Sound* FindSound(int key) {
+			std::lock_guard<std::mutex> guard{mMutex};
+			auto iter = mDicSound.find(key);
+			return iter == mDicSound.end() ? nullptr : iter->second;
+		}
+
 		/// <summary> check if last processed job was successful. if failed, write <paramref name="output"/> to console </summary>
 		bool IsJobFailed(const std::string& output = "") {
 			bool bFailed = result != FMOD_OK;
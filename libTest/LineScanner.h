@@ -0,0 +1,109 @@
+#pragma once
+
+#include <cstdint>
+
+// select the widest instruction set enabled by the compiler. (MSVC : /arch:AVX2, x64 always has SSE2)
+#if defined(__AVX2__)
+#define SCANNER_AVX2 1
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SCANNER_SSE2 1
+#include <emmintrin.h>
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// reference : https://github.com/simdjson/simdjson (block scan with compare + movemask)
+namespace Utility {
+	/// <summary> return the index of the lowest set bit. <paramref name="mask"/> must not be zero </summary>
+	inline uint32_t CountTrailingZero(uint32_t mask) noexcept {
+#ifdef _MSC_VER
+		unsigned long index;
+		_BitScanForward(&index, mask);
+		return index;
+#else
+		return __builtin_ctz(mask);
+#endif
+	}
+
+	/// <summary>
+	/// find the first '\n' in [<paramref name="first"/>, <paramref name="last"/>) by 32 or 16 bytes at a time.
+	/// return <paramref name="last"/> if there is no new line.
+	/// </summary>
+	inline const char* FindNewLine(const char* first, const char* last) noexcept {
+		const char* p = first;
+#if SCANNER_AVX2
+		const __m256i nl = _mm256_set1_epi8('\n');
+		for (; last - p >= 32; p += 32) {
+			__m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+			uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, nl)));
+			if (mask != 0) {
+				return p + CountTrailingZero(mask);
+			}
+		}
+#elif SCANNER_SSE2
+		const __m128i nl = _mm_set1_epi8('\n');
+		for (; last - p >= 16; p += 16) {
+			__m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+			uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(block, nl)));
+			if (mask != 0) {
+				return p + CountTrailingZero(mask);
+			}
+		}
+#endif
+		// scalar fallback + remaining bytes
+		for (; p < last; ++p) {
+			if (*p == '\n') {
+				return p;
+			}
+		}
+		return last;
+	}
+
+	/// <summary>
+	/// find the first line that starts with '#' in [<paramref name="first"/>, <paramref name="last"/>).
+	/// <paramref name="first"/> must be the start of a line. only '\n' + '#' pairs are searched, so other lines are skipped without reading by line.
+	/// return <paramref name="last"/> if there is no command line.
+	/// </summary>
+	inline const char* FindCommandLine(const char* first, const char* last) noexcept {
+		if (first < last && *first == '#') {
+			return first;
+		}
+
+		// compare two overlapped blocks : p[i] == '\n' && p[i + 1] == '#'
+		const char* p = first;
+#if SCANNER_AVX2
+		const __m256i nl = _mm256_set1_epi8('\n');
+		const __m256i sharp = _mm256_set1_epi8('#');
+		for (; last - p > 32; p += 32) {
+			__m256i cur = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+			__m256i next = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 1));
+			__m256i pair = _mm256_and_si256(_mm256_cmpeq_epi8(cur, nl), _mm256_cmpeq_epi8(next, sharp));
+			uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(pair));
+			if (mask != 0) {
+				return p + CountTrailingZero(mask) + 1;
+			}
+		}
+#elif SCANNER_SSE2
+		const __m128i nl = _mm_set1_epi8('\n');
+		const __m128i sharp = _mm_set1_epi8('#');
+		for (; last - p > 16; p += 16) {
+			__m128i cur = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+			__m128i next = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 1));
+			__m128i pair = _mm_and_si128(_mm_cmpeq_epi8(cur, nl), _mm_cmpeq_epi8(next, sharp));
+			uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(pair));
+			if (mask != 0) {
+				return p + CountTrailingZero(mask) + 1;
+			}
+		}
+#endif
+		// scalar fallback + remaining bytes
+		for (; last - p > 1; ++p) {
+			if (*p == '\n' && *(p + 1) == '#') {
+				return p + 1;
+			}
+		}
+		return last;
+	}
+}
\ No newline at end of file
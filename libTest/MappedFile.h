@@ -0,0 +1,135 @@
+#pragma once
+
+#include "Utility.h"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX			// prevent windows.h from defining min, max macro (std::min, max are used)
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace Utility {
+	/// <summary>
+	/// A class that maps the whole file to memory as read-only.
+	/// Used to read a file without copying it to the internal buffer of the stream.
+	/// </summary>
+	class MappedFile {
+	public:
+		MappedFile() : mOpen(false), mData(nullptr), mSize(0) {}
+		MappedFile(const wchar_t* path) : MappedFile() {
+			Open(path);
+		}
+		~MappedFile() {
+			Close();
+		}
+		DISALLOW_COPY_AND_ASSIGN(MappedFile)
+
+		/// <summary> map the file of <paramref name="path"/> to memory. an empty file is opened with no data. </summary>
+		bool Open(const wchar_t* path) {
+			Close();
+#ifdef _WIN32
+			mFile = CreateFileW(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+			if (mFile == INVALID_HANDLE_VALUE) {
+				return false;
+			}
+			LARGE_INTEGER size;
+			if (!GetFileSizeEx(mFile, &size)) {
+				CloseHandle(mFile);
+				return false;
+			}
+			mSize = static_cast<size_t>(size.QuadPart);
+			mMapping = NULL;
+			// caution : CreateFileMapping fails if the file size is zero.
+			if (mSize != 0) {
+				mMapping = CreateFileMappingW(mFile, NULL, PAGE_READONLY, 0, 0, NULL);
+				if (mMapping == NULL) {
+					CloseHandle(mFile);
+					return false;
+				}
+				mData = static_cast<const char*>(MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0));
+				if (mData == nullptr) {
+					CloseHandle(mMapping);
+					CloseHandle(mFile);
+					return false;
+				}
+			}
+#else
+			mFd = open(WideToUTF8(path).c_str(), O_RDONLY);
+			if (mFd == -1) {
+				return false;
+			}
+			struct stat buffer;
+			if (fstat(mFd, &buffer) != 0) {
+				close(mFd);
+				return false;
+			}
+			mSize = static_cast<size_t>(buffer.st_size);
+			// caution : mmap fails if the file size is zero.
+			if (mSize != 0) {
+				void* p = mmap(nullptr, mSize, PROT_READ, MAP_PRIVATE, mFd, 0);
+				if (p == MAP_FAILED) {
+					close(mFd);
+					return false;
+				}
+				madvise(p, mSize, MADV_SEQUENTIAL);
+				mData = static_cast<const char*>(p);
+			}
+#endif
+			mOpen = true;
+			return true;
+		}
+
+		/// <summary> unmap the file and release all handles </summary>
+		void Close() {
+			if (!mOpen) {
+				return;
+			}
+#ifdef _WIN32
+			if (mData != nullptr) {
+				UnmapViewOfFile(mData);
+				CloseHandle(mMapping);
+			}
+			CloseHandle(mFile);
+#else
+			if (mData != nullptr) {
+				munmap(const_cast<char*>(mData), mSize);
+			}
+			close(mFd);
+#endif
+			mOpen = false;
+			mData = nullptr;
+			mSize = 0;
+		}
+
+		inline bool IsOpen() const {
+			return mOpen;
+		}
+		/// <summary> return the first byte of the mapped file. nullptr if the file is empty. </summary>
+		inline const char* Data() const {
+			return mData;
+		}
+		inline size_t Size() const {
+			return mSize;
+		}
+
+	private:
+		bool mOpen;
+		const char* mData;
+		size_t mSize;
+#ifdef _WIN32
+		HANDLE mFile;
+		HANDLE mMapping;
+#else
+		int mFd;
+#endif
+	};
+}
\ No newline at end of file
@@ -0,0 +1,202 @@
+#pragma once
+
+#include "Utility.h"
+
+#include <algorithm>
+#include <fstream>
+#include <mutex>
+#include <vector>
+
+namespace bms {
+	/// <summary> what happened to a note of the playback tracks </summary>
+	enum class TriggerStatus : uint8_t {
+		PLAYED,			// played when the play thread reached it
+		SCHEDULED,		// requested ahead. the start is the audio clock reported by the backend, later than the note time if the clock passed it
+		DROPPED			// out of MAX_ERROR_RANGE when the play thread reached it, not played
+	};
+
+	/// <summary> the distribution of a timing. unit = microseconds </summary>
+	struct TimingPercentile {
+		size_t mCount;
+		long long mP50;
+		long long mP99;
+		long long mMax;
+	};
+
+	/// <summary> the result of <see cref="bms::PlaybackStats"/> at a time </summary>
+	struct PlaybackSummary {
+		size_t mPlayedCount;
+		size_t mScheduledCount;
+		size_t mDroppedCount;
+		size_t mOverrunCount;			// the frames that finished after the next wake-up time
+		size_t mMissingCount;			// the played and scheduled notes whose sound was not created yet
+		TimingPercentile mLateness;		// the start of the sound - the note time, of the played and scheduled notes
+		TimingPercentile mWakeJitter;	// the wake-up of the play thread - the requested wake-up time
+	};
+
+	/// <summary>
+	/// The timing records of a play of <see cref="bms::PlayThread"/> : each trigger (the note time, when it is requested and when it starts),
+	/// the dropped notes, and the wake-up jitter and overruns of the frames.
+	/// it is written by the play thread and can be read by the others at the same time. all times are microseconds from the start of the play
+	/// </summary>
+	class PlaybackStats {
+	public:
+		PlaybackStats() : mOverrunCount(0), mMissingCount(0) {}
+		DISALLOW_COPY_AND_ASSIGN(PlaybackStats)
+
+		/// <summary> clear the records. <paramref name="noteCount"/> triggers and <paramref name="frameCount"/> frames are reserved, so the play thread doesn't allocate while playing </summary>
+		void Reset(size_t noteCount, size_t frameCount) {
+			std::lock_guard<std::mutex> guard{mMutex};
+			mListTrigger.clear();
+			mListTrigger.reserve(noteCount);
+			mListWake.clear();
+			mListWake.reserve(frameCount);
+			mOverrunCount = 0;
+			mMissingCount = 0;
+		}
+
+		/// <summary> the sound of <paramref name="key"/> at <paramref name="noteTime"/> is requested at <paramref name="requestTime"/> and starts at <paramref name="startTime"/> </summary>
+		inline void AddTrigger(int key, long long noteTime, long long requestTime, long long startTime, TriggerStatus status) {
+			std::lock_guard<std::mutex> guard{mMutex};
+			mListTrigger.push_back(Trigger{noteTime, requestTime, startTime, static_cast<uint16_t>(key), status});
+		}
+
+		/// <summary>
+		/// the frame requested to wake up at <paramref name="deadline"/> woke up at <paramref name="wakeTime"/>.
+		/// the frames after the reserved count are not recorded, so the play thread doesn't allocate
+		/// </summary>
+		inline void AddWake(long long deadline, long long wakeTime) {
+			std::lock_guard<std::mutex> guard{mMutex};
+			if (mListWake.size() < mListWake.capacity()) {
+				mListWake.push_back(Wake{deadline, wakeTime});
+			}
+		}
+
+		inline void AddOverrun() {
+			std::lock_guard<std::mutex> guard{mMutex};
+			++mOverrunCount;
+		}
+
+		inline void AddMissing() {
+			std::lock_guard<std::mutex> guard{mMutex};
+			++mMissingCount;
+		}
+
+		PlaybackSummary GetSummary() const {
+			PlaybackSummary summary = {};
+			std::vector<long long> lateness, jitter;
+			{
+				std::lock_guard<std::mutex> guard{mMutex};
+				lateness.reserve(mListTrigger.size());
+				for (const Trigger& t : mListTrigger) {
+					if (t.mStatus == TriggerStatus::DROPPED) {
+						++summary.mDroppedCount;
+						continue;
+					}
+					++(t.mStatus == TriggerStatus::SCHEDULED ? summary.mScheduledCount : summary.mPlayedCount);
+					lateness.push_back(t.mStartTime - t.mNoteTime);
+				}
+				jitter.reserve(mListWake.size());
+				for (const Wake& w : mListWake) {
+					jitter.push_back(w.mWakeTime - w.mDeadline);
+				}
+				summary.mOverrunCount = mOverrunCount;
+				summary.mMissingCount = mMissingCount;
+			}
+			summary.mLateness = MakePercentile(lateness);
+			summary.mWakeJitter = MakePercentile(jitter);
+			return summary;
+		}
+
+		/// <summary>
+		/// the number of the lateness (or the wake-up jitter if <paramref name="bJitter"/> is true) in each bucket of <paramref name="bucketWidth"/> microseconds from 0.
+		/// the values before the first bucket are counted in the first bucket, and the values after the last one are counted in the last bucket
+		/// </summary>
+		std::vector<uint32_t> GetHistogram(bool bJitter, long long bucketWidth, size_t bucketCount) const {
+			std::vector<uint32_t> buckets(std::max<size_t>(bucketCount, 1), 0);
+			auto add = [&](long long value) {
+				long long index = std::min<long long>(std::max(value, 0ll) / std::max(bucketWidth, 1ll), buckets.size() - 1);
+				++buckets[static_cast<size_t>(index)];
+			};
+			std::lock_guard<std::mutex> guard{mMutex};
+			if (bJitter) {
+				for (const Wake& w : mListWake) {
+					add(w.mWakeTime - w.mDeadline);
+				}
+			} else {
+				for (const Trigger& t : mListTrigger) {
+					if (t.mStatus != TriggerStatus::DROPPED) {
+						add(t.mStartTime - t.mNoteTime);
+					}
+				}
+			}
+			return buckets;
+		}
+
+		/// <summary>
+		/// write all records to the csv file of <paramref name="path"/>. columns : event, key, target, request, actual, late.
+		/// played, scheduled and dropped : target = the note time, request = the time when it is requested, actual = the start of the sound (empty if dropped).
+		/// wake : target and request = the requested wake-up time, actual = the wake-up time
+		/// </summary>
+		bool WriteCsv(const std::wstring& path) const {
+			std::ofstream os(path.c_str());
+			if (!os.is_open()) {
+				return false;
+			}
+			static const char* names[] = {"played", "scheduled", "dropped"};
+			std::lock_guard<std::mutex> guard{mMutex};
+			os << "event,key,target_us,request_us,actual_us,late_us\n";
+			for (const Trigger& t : mListTrigger) {
+				os << names[static_cast<int>(t.mStatus)] << ',' << t.mKey << ',' << t.mNoteTime << ',' << t.mRequestTime << ',';
+				if (t.mStatus != TriggerStatus::DROPPED) {
+					os << t.mStartTime << ',' << t.mStartTime - t.mNoteTime;
+				} else {
+					os << ',';
+				}
+				os << '\n';
+			}
+			for (const Wake& w : mListWake) {
+				os << "wake,," << w.mDeadline << ',' << w.mDeadline << ',' << w.mWakeTime << ',' << w.mWakeTime - w.mDeadline << '\n';
+			}
+			return static_cast<bool>(os);
+		}
+
+	private:
+		struct Trigger {
+			long long mNoteTime;
+			long long mRequestTime;
+			long long mStartTime;
+			uint16_t mKey;
+			TriggerStatus mStatus;
+		};
+
+		struct Wake {
+			long long mDeadline;
+			long long mWakeTime;
+		};
+
+		mutable std::mutex mMutex;
+		std::vector<Trigger> mListTrigger;
+		std::vector<Wake> mListWake;
+		size_t mOverrunCount;
+		size_t mMissingCount;
+
+		/// <summary> nearest-rank percentiles of <paramref name="values"/> </summary>
+		static TimingPercentile MakePercentile(std::vector<long long>& values) {
+			TimingPercentile result = {};
+			result.mCount = values.size();
+			if (values.empty()) {
+				return result;
+			}
+			auto at = [&values](size_t percent) {
+				auto iter = values.begin() + (values.size() - 1) * percent / 100;
+				std::nth_element(values.begin(), iter, values.end());
+				return *iter;
+			};
+			result.mP50 = at(50);
+			result.mP99 = at(99);
+			result.mMax = *std::max_element(values.begin(), values.end());
+			return result;
+		}
+	};
+}
\ No newline at end of file
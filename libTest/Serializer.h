@@ -1,7 +1,10 @@
 #pragma once
 
 #include <iostream>
+#include <type_traits>
+#include <typeinfo>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <unordered_map>
 
@@ -15,6 +18,42 @@ namespace bms {
 	/// <summary> deserialize the <see also="T"/> type into a binary stream and return value </summary>
 	template<class T> inline T ReadFromBinary(std::istream& is);
 
+	/// <summary>
+	/// the maximum element count of a container read from a binary stream.
+	/// a larger count means the stream is corrupted, so it is rejected before the container is allocated.
+	/// </summary>
+	constexpr uint32_t SERIALIZE_MAX_LENGTH = 0x1000000;
+
+	/// <summary>
+	/// true if the elements of a container of <see also="T"/> type can be written and read at once as raw bytes.
+	/// bool is excluded because std::vector&lt;bool&gt; is not contiguous.
+	/// </summary>
+	template<class T>
+	constexpr bool IsBulkSerializable = std::is_trivially_copyable<T>::value && !std::is_same<T, bool>::value;
+
+	/// <summary> write <paramref name="count"/> elements of <paramref name="data"/> with a single stream call </summary>
+	template<class T>
+	inline void WriteBulkToBinary(std::ostream& os, const T* data, size_t count) {
+		if (count > 0 && !os.write(reinterpret_cast<const char*>(data), count * sizeof(T))) {
+			throw std::ios_base::failure(std::string{"writing array of type '"} + typeid(T).name() + "' failed");
+		}
+	}
+	/// <summary> read <paramref name="count"/> elements to <paramref name="data"/> with a single stream call </summary>
+	template<class T>
+	inline void ReadBulkFromBinary(std::istream& is, T* data, size_t count) {
+		if (count > 0 && !is.read(reinterpret_cast<char*>(data), count * sizeof(T))) {
+			throw std::ios_base::failure(std::string{"reading array of type '"} + typeid(T).name() + "' failed");
+		}
+	}
+	/// <summary> read the element count of a container and check it against <see cref="SERIALIZE_MAX_LENGTH"/> </summary>
+	inline uint32_t ReadLengthFromBinary(std::istream& is) {
+		uint32_t len = ReadFromBinary<uint32_t>(is);
+		if (len > SERIALIZE_MAX_LENGTH) {
+			throw std::ios_base::failure("container length " + std::to_string(len) + " exceeds the limit");
+		}
+		return len;
+	}
+
 
 	// reference : https://bab2min.tistory.com/613
 	// Type SFINAE
@@ -31,17 +70,25 @@ namespace bms {
 	inline void WriteToBinaryImpl(std::ostream& os, const typename std::vector<T>& v) {
 		// store count of vector element
 		WriteToBinary<uint32_t>(os, static_cast<uint32_t>(v.size()));
-		for (auto& e : v) {
-			WriteToBinary(os, e);
+		if constexpr (IsBulkSerializable<T>) {
+			WriteBulkToBinary(os, v.data(), v.size());
+		} else {
+			for (auto& e : v) {
+				WriteToBinary(os, e);
+			}
 		}
 	}
 	template<class T>
 	inline void WriteToBinaryImpl(std::ostream& os, const typename std::basic_string<T>& v) {
 		// store count of char
 		WriteToBinary<uint32_t>(os, static_cast<uint32_t>(v.size()));
-		for (auto& e : v) {
-			WriteToBinary(os, e);
-		}
+		WriteBulkToBinary(os, v.data(), v.size());
+	}
+	template<class T>
+	inline void WriteToBinaryImpl(std::ostream& os, const typename std::basic_string_view<T>& v) {
+		// same format as basic_string. read it as basic_string
+		WriteToBinary<uint32_t>(os, static_cast<uint32_t>(v.size()));
+		WriteBulkToBinary(os, v.data(), v.size());
 	}
 	template<class T1, class T2>
 	inline void WriteToBinaryImpl(std::ostream& os, const typename std::pair<T1, T2>& v) {
@@ -68,18 +115,20 @@ namespace bms {
 	template<class T>
 	inline void ReadFromBinaryImpl(std::istream& is, typename std::vector<T>& v) {
 		// resize by vector size
-		v.resize(ReadFromBinary<uint32_t>(is));
-		for (auto& e : v) {
-			ReadFromBinary(is, e);
+		v.resize(ReadLengthFromBinary(is));
+		if constexpr (IsBulkSerializable<T>) {
+			ReadBulkFromBinary(is, v.data(), v.size());
+		} else {
+			for (auto& e : v) {
+				ReadFromBinary(is, e);
+			}
 		}
 	}
 	template<class T>
 	inline void ReadFromBinaryImpl(std::istream& is, typename std::basic_string<T>& v) {
 		// resize by basic_string size
-		v.resize(ReadFromBinary<uint32_t>(is));
-		for (auto& e : v) {
-			ReadFromBinary(is, e);
-		}
+		v.resize(ReadLengthFromBinary(is));
+		ReadBulkFromBinary(is, &v[0], v.size());
 	}
 	template<class T1, class T2>
 	inline void ReadFromBinaryImpl(std::istream& is, typename std::pair<T1, T2>& v) {
@@ -88,8 +137,9 @@ namespace bms {
 	}
 	template<class T1, class T2>
 	inline void ReadFromBinaryImpl(std::istream& is, typename std::unordered_map<T1, T2>& v) {
-		uint32_t len = ReadFromBinary<uint32_t>(is);
+		uint32_t len = ReadLengthFromBinary(is);
 		v.clear();
+		v.reserve(len);
 		for (size_t i = 0; i < len; ++i) {
 			v.emplace(ReadFromBinary<std::pair<T1, T2>>(is));
 		}
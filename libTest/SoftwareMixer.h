@@ -0,0 +1,189 @@
+#pragma once
+
+#include "BMSData.h"
+#include "WavFile.h"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+namespace bms {
+	/// <summary> the sample rate of the rendered audio </summary>
+	constexpr uint32_t MIXER_SAMPLE_RATE = 44100;
+	/// <summary> the number of frames mixed by one job of the mixing threads </summary>
+	constexpr uint32_t MIXER_BLOCK_FRAMES = 16384;
+
+	/// <summary>
+	/// An offline renderer that mixes the keysounds of a built <see cref="bms::BMSData"/> to interleaved stereo float samples faster than real time.
+	/// the keysounds are decoded by all threads, and the output is divided into blocks of <see cref="MIXER_BLOCK_FRAMES"/> mixed by all threads.
+	/// each block is mixed by one thread in the order of the notes, so the result is the same regardless of the number of threads.
+	/// the notes are the same as <see cref="bms::PlayThread"/> plays : all BGM and the player notes except landmines.
+	/// </summary>
+	class SoftwareMixer {
+	public:
+		/// <param name="threadCount"> zero means std::thread::hardware_concurrency() </param>
+		SoftwareMixer(uint32_t sampleRate = MIXER_SAMPLE_RATE, unsigned threadCount = 0) : mSampleRate(sampleRate), mListSound(MAX_INDEX_LENGTH) {
+			mThreadCount = threadCount == 0 ? std::max(1u, std::thread::hardware_concurrency()) : threadCount;
+		}
+		DISALLOW_COPY_AND_ASSIGN(SoftwareMixer)
+
+		inline uint32_t GetSampleRate() const {
+			return mSampleRate;
+		}
+
+		/// <summary>
+		/// decode all keysounds in <see cref="bms::BMSData::mListWavName"/> of <paramref name="data"/> in the folder of the bms file.
+		/// the previous sounds are released. return the number of decoded sounds
+		/// </summary>
+		uint32_t LoadSounds(const BMSData& data) {
+			clock_t s = clock();
+			std::wstring filePath(data.mInfo->mFilePath);
+			std::wstring folderPath = filePath.substr(0, filePath.find_last_of(L'/') + 1);
+			std::vector<uint16_t> keys;
+			for (uint16_t key = 0; key < MAX_INDEX_LENGTH; ++key) {
+				mListSound[key].clear();
+				if (!data.mListWavName[key].empty()) {
+					keys.push_back(key);
+				}
+			}
+
+			std::atomic<uint32_t> loaded(0);
+			ParallelFor(keys.size(), [&](size_t i) {
+				uint16_t key = keys[i];
+				std::wstring path = folderPath + Utility::UTF8ToWide(data.mListWavName[key]);
+				if (Utility::ReadWavFile(path.c_str(), mSampleRate, mListSound[key])) {
+					++loaded;
+				} else {
+					TRACE("sound decode failed : " << data.mListWavName[key]);
+				}
+			});
+			LOG("mixer sound decode time(ms) : " << clock() - s << ", sounds : " << loaded << " / " << keys.size())
+			return loaded;
+		}
+
+		/// <summary> set the sound of <paramref name="key"/> to interleaved stereo samples of <see cref="GetSampleRate"/> </summary>
+		void SetSound(uint16_t key, std::vector<float> samples) {
+			mListSound[key] = std::move(samples);
+		}
+
+		/// <summary>
+		/// mix the notes of <paramref name="data"/> in [<paramref name="beginTime"/>, <paramref name="endTime"/>) (microseconds) to <paramref name="out"/>.
+		/// if <paramref name="endTime"/> is negative, it is the end of the last sound
+		/// </summary>
+		void Render(const BMSData& data, std::vector<float>& out, long long beginTime = 0, long long endTime = -1) {
+			// 1) the start frames of the notes in ascending order. both lists are sorted by time
+			std::vector<MixEvent> bgm, notes;
+			const PlaybackTrack& bgmTrack = data.mPlayBgm;
+			const PlaybackTrack& noteTrack = data.mPlayNote;
+			bgm.reserve(bgmTrack.size());
+			notes.reserve(noteTrack.size());
+			for (uint32_t i = 0; i < bgmTrack.size(); ++i) {
+				AddEvent(bgm, bgmTrack.GetKey(i), bgmTrack.GetTime(i));
+			}
+			for (uint32_t i = 0; i < noteTrack.size(); ++i) {
+				if (noteTrack.GetType(i) != NoteType::LANDMINE) {
+					AddEvent(notes, noteTrack.GetKey(i), noteTrack.GetTime(i));
+				}
+			}
+			std::vector<MixEvent> events(bgm.size() + notes.size());
+			std::merge(bgm.begin(), bgm.end(), notes.begin(), notes.end(), events.begin(),
+					   [](const MixEvent& lhs, const MixEvent& rhs) { return lhs.mFrame < rhs.mFrame; });
+
+			long long maxLength = 0, lastFrame = 0;
+			for (const MixEvent& e : events) {
+				maxLength = std::max(maxLength, e.mLength);
+				lastFrame = std::max(lastFrame, e.mFrame + e.mLength);
+			}
+			// the range is empty if it starts after the end (or no sound is decoded, so the last frame is 0)
+			const long long first = ToFrame(beginTime);
+			const long long last = endTime < 0 ? lastFrame : ToFrame(endTime);
+			const long long frames = std::max(last - first, 0ll);
+			out.assign(static_cast<size_t>(frames) * 2, 0.0f);
+			if (frames == 0) {
+				return;
+			}
+
+			// 2) mix by blocks. a block is mixed with the sounds that start in (block start - the longest sound, block end)
+			const size_t blockCount = static_cast<size_t>((frames + MIXER_BLOCK_FRAMES - 1) / MIXER_BLOCK_FRAMES);
+			ParallelFor(blockCount, [&](size_t b) {
+				long long blockFirst = first + static_cast<long long>(b) * MIXER_BLOCK_FRAMES;
+				long long blockLast = std::min(blockFirst + MIXER_BLOCK_FRAMES, last);
+				auto iter = std::lower_bound(events.begin(), events.end(), blockFirst - maxLength,
+											 [](const MixEvent& e, long long frame) { return e.mFrame < frame; });
+				for (; iter != events.end() && iter->mFrame < blockLast; ++iter) {
+					long long mixFirst = std::max(blockFirst, iter->mFrame);
+					long long mixLast = std::min(blockLast, iter->mFrame + iter->mLength);
+					if (mixFirst < mixLast) {
+						MixAdd(&out[(mixFirst - first) * 2], &mListSound[iter->mKey][(mixFirst - iter->mFrame) * 2], static_cast<size_t>(mixLast - mixFirst) * 2);
+					}
+				}
+			});
+		}
+
+		/// <summary> <see cref="Render"/> and write the result to 16-bit wav file of <paramref name="path"/> </summary>
+		bool RenderToFile(const BMSData& data, const wchar_t* path, long long beginTime = 0, long long endTime = -1) {
+			std::vector<float> samples;
+			Render(data, samples, beginTime, endTime);
+			return Utility::WriteWavFile(path, samples.data(), samples.size() / 2, mSampleRate);
+		}
+
+		/// <summary> <paramref name="dst"/>[i] += <paramref name="src"/>[i] by 8 or 4 floats at a time </summary>
+		static void MixAdd(float* dst, const float* src, size_t count) {
+			size_t i = 0;
+#if SCANNER_AVX2
+			for (; i + 8 <= count; i += 8) {
+				_mm256_storeu_ps(dst + i, _mm256_add_ps(_mm256_loadu_ps(dst + i), _mm256_loadu_ps(src + i)));
+			}
+#elif SCANNER_SSE2
+			for (; i + 4 <= count; i += 4) {
+				_mm_storeu_ps(dst + i, _mm_add_ps(_mm_loadu_ps(dst + i), _mm_loadu_ps(src + i)));
+			}
+#endif
+			for (; i < count; ++i) {
+				dst[i] += src[i];
+			}
+		}
+
+	private:
+		struct MixEvent {
+			long long mFrame;			// the start frame of the sound
+			long long mLength;			// the number of frames of the sound
+			uint16_t mKey;
+		};
+
+		uint32_t mSampleRate;
+		unsigned mThreadCount;
+		/// <summary> interleaved stereo samples of each key. empty if the sound is not decoded </summary>
+		std::vector<std::vector<float>> mListSound;
+
+		inline long long ToFrame(long long time) const {
+			return (time * mSampleRate + 500000) / 1000000;
+		}
+
+		inline void AddEvent(std::vector<MixEvent>& events, int key, long long time) {
+			if (key < 0 || key >= MAX_INDEX_LENGTH || mListSound[key].empty()) {
+				return;
+			}
+			events.push_back(MixEvent{ToFrame(time), static_cast<long long>(mListSound[key].size() / 2), static_cast<uint16_t>(key)});
+		}
+
+		/// <summary> call <paramref name="func"/>(i) for i in [0, <paramref name="count"/>) with all threads. the jobs are taken in order </summary>
+		template <typename TFunc>
+		void ParallelFor(size_t count, const TFunc& func) {
+			std::atomic<size_t> next(0);
+			auto work = [&]() {
+				for (size_t i = next++; i < count; i = next++) {
+					func(i);
+				}
+			};
+			std::vector<std::thread> threads;
+			for (unsigned i = 1; i < mThreadCount && i < count; ++i) {
+				threads.emplace_back(work);
+			}
+			work();
+			for (std::thread& thread : threads) {
+				thread.join();
+			}
+		}
+	};
+}
\ No newline at end of file
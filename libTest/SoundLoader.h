@@ -0,0 +1,241 @@
+#pragma once
+
+#include "AudioBackend.h"
+#include "BMSData.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <climits>
+#include <condition_variable>
+#include <queue>
+#include <thread>
+
+namespace bms {
+	/// <summary>
+	/// A service that creates the keysounds of a play with a persistent pool of threads.
+	/// the keys of the playback tracks are deduplicated when they are published, and the sounds are created in the order of the first use of the key,
+	/// so the sounds needed first are ready first. the tracks can be still filled by the streaming build.
+	/// <see cref="IsReady"/> can be called by the play thread at any time without locking
+	/// </summary>
+	class SoundLoader {
+	public:
+		/// <param name="threadCount"> zero means std::thread::hardware_concurrency(), at least 2 so that a large file doesn't stop the others </param>
+		SoundLoader(unsigned threadCount = 0) : mbExit(false), mbActive(false), mAudio(nullptr), mData(nullptr), mBgmScan(0), mNoteScan(0), mbScanComplete(true) {
+			unsigned count = threadCount == 0 ? std::max(2u, std::thread::hardware_concurrency()) : threadCount;
+			for (std::atomic<uint8_t>& state : mListState) {
+				state.store(NONE, std::memory_order_relaxed);
+			}
+			mListLoadingTime.assign(count, LLONG_MAX);
+			for (unsigned i = 0; i < count; ++i) {
+				mListThread.emplace_back(&SoundLoader::Work, this, i);
+			}
+		}
+		~SoundLoader() {
+			Cancel();
+			{
+				std::lock_guard<std::mutex> guard{mMutex};
+				mbExit = true;
+			}
+			mWorkCondition.notify_all();
+			for (std::thread& thread : mListThread) {
+				thread.join();
+			}
+		}
+		DISALLOW_COPY_AND_ASSIGN(SoundLoader)
+
+		/// <summary>
+		/// cancel the previous job and start to create the sounds of the playback tracks of <paramref name="data"/> in <paramref name="folderPath"/> by <paramref name="audio"/>.
+		/// <paramref name="audio"/> and <paramref name="data"/> must be alive until <see cref="Cancel"/>
+		/// </summary>
+		void Start(AudioBackend& audio, const BMSData& data, const std::string& folderPath) {
+			Cancel();
+			std::lock_guard<std::mutex> guard{mMutex};
+			mAudio = &audio;
+			mData = &data;
+			mFolderPath = folderPath;
+			for (std::atomic<uint8_t>& state : mListState) {
+				state.store(NONE, std::memory_order_relaxed);
+			}
+			mBgmScan = 0;
+			mNoteScan = 0;
+			mbScanComplete = false;
+			mbActive = true;
+			ScanTracks();
+			mWorkCondition.notify_all();
+		}
+
+		/// <summary> stop creating the sounds. the sounds being created are finished before it returns, so the sounds can be released after it </summary>
+		void Cancel() {
+			std::unique_lock<std::mutex> lock(mMutex);
+			mbActive = false;
+			mQueue = std::priority_queue<Job>();
+			mReadyCondition.wait(lock, [this]() {
+				return std::all_of(mListLoadingTime.begin(), mListLoadingTime.end(), [](long long time) { return time == LLONG_MAX; });
+			});
+		}
+
+		/// <summary>
+		/// block until all sounds used before <paramref name="time"/> (microseconds) are created. the pool creates them in parallel.
+		/// it returns immediately if the loader is not started
+		/// </summary>
+		void WaitUntilReady(long long time) {
+			std::unique_lock<std::mutex> lock(mMutex);
+			while (mbActive) {
+				ScanTracks();
+				if (IsScanned(time) && GetFirstJobTime() >= time &&
+					std::all_of(mListLoadingTime.begin(), mListLoadingTime.end(), [time](long long loading) { return loading >= time; })) {
+					return;
+				}
+				// the streaming build doesn't notify, so the tracks are checked again after a while
+				mReadyCondition.wait_for(lock, std::chrono::milliseconds(1));
+			}
+		}
+
+		inline bool IsActive() const {
+			return mbActive.load(std::memory_order_acquire);
+		}
+
+		/// <summary> return true if the sound of <paramref name="key"/> is created </summary>
+		inline bool IsReady(int key) const {
+			return key >= 0 && key < MAX_INDEX_LENGTH && mListState[key].load(std::memory_order_acquire) == READY;
+		}
+
+		inline size_t GetThreadCount() const {
+			return mListThread.size();
+		}
+
+	private:
+		enum State : uint8_t {
+			NONE,			// not used yet
+			QUEUED,
+			LOADING,
+			READY,
+			NO_FILE			// no file name in the chart
+		};
+
+		struct Job {
+			long long mTime;	// the first use of the key
+			uint16_t mKey;
+
+			/// <summary> std::priority_queue takes the largest, so the earliest is the largest </summary>
+			inline bool operator<(const Job& other) const {
+				return mTime > other.mTime;
+			}
+		};
+
+		std::vector<std::thread> mListThread;
+		bool mbExit;
+		std::atomic<bool> mbActive;
+		std::mutex mMutex;
+		std::condition_variable mWorkCondition;		// a job is added or the pool is stopped
+		std::condition_variable mReadyCondition;	// a sound is created
+
+		AudioBackend* mAudio;
+		const BMSData* mData;
+		std::string mFolderPath;
+
+		std::priority_queue<Job> mQueue;
+		std::array<std::atomic<uint8_t>, MAX_INDEX_LENGTH> mListState;
+		std::array<long long, MAX_INDEX_LENGTH> mListFirstUse;		// valid if the state is not NONE
+		std::vector<long long> mListLoadingTime;	// the first use of the sound each thread is creating. LLONG_MAX if it is idle
+		uint32_t mBgmScan;							// the number of the scanned notes of each track
+		uint32_t mNoteScan;
+		bool mbScanComplete;						// true if all notes of the tracks are scanned
+
+		void Work(size_t index) {
+			std::unique_lock<std::mutex> lock(mMutex);
+			while (!mbExit) {
+				if (mbActive) {
+					ScanTracks();
+				}
+				if (mQueue.empty()) {
+					// wait for a new job, or for the notes of the streaming build
+					if (mbActive && !mbScanComplete) {
+						mWorkCondition.wait_for(lock, std::chrono::milliseconds(1));
+					} else {
+						mWorkCondition.wait(lock);
+					}
+					continue;
+				}
+				Job job = mQueue.top();
+				mQueue.pop();
+				// a key used earlier than it was queued has another job
+				if (mListState[job.mKey].load(std::memory_order_relaxed) != QUEUED || job.mTime != mListFirstUse[job.mKey]) {
+					continue;
+				}
+				mListState[job.mKey].store(LOADING, std::memory_order_relaxed);
+				mListLoadingTime[index] = job.mTime;
+				AudioBackend* audio = mAudio;
+				std::string path = mFolderPath + mData->mListWavName[job.mKey];
+
+				lock.unlock();
+				audio->CreateSound(path, job.mKey);
+				lock.lock();
+
+				mListState[job.mKey].store(READY, std::memory_order_release);
+				mListLoadingTime[index] = LLONG_MAX;
+				mReadyCondition.notify_all();
+			}
+		}
+
+		/// <summary> queue the keys of the notes published after the last scan. called with the lock </summary>
+		void ScanTracks() {
+			if (mbScanComplete) {
+				return;
+			}
+			// check the completion before the count, so no note is published after it
+			bool bComplete = mData->mPlayBgm.IsComplete() && mData->mPlayNote.IsComplete();
+			ScanTrack(mData->mPlayBgm, mBgmScan);
+			ScanTrack(mData->mPlayNote, mNoteScan);
+			mbScanComplete = bComplete;
+		}
+
+		void ScanTrack(const PlaybackTrack& track, uint32_t& scan) {
+			uint32_t count = track.GetReadyCount();
+			for (; scan < count; ++scan) {
+				// landmine doesn't have own sound
+				if (track.GetType(scan) == NoteType::LANDMINE) {
+					continue;
+				}
+				uint16_t key = track.GetKey(scan);
+				long long time = track.GetTime(scan);
+				uint8_t state = mListState[key].load(std::memory_order_relaxed);
+				if (state == NONE) {
+					mListFirstUse[key] = time;
+					if (mData->mListWavName[key].empty()) {
+						mListState[key].store(NO_FILE, std::memory_order_relaxed);
+						continue;
+					}
+					mListState[key].store(QUEUED, std::memory_order_relaxed);
+					mQueue.push(Job{time, key});
+				} else if (state == QUEUED && time < mListFirstUse[key]) {
+					// used earlier in the other track. the previous job is skipped
+					mListFirstUse[key] = time;
+					mQueue.push(Job{time, key});
+				}
+			}
+		}
+
+		/// <summary> return true if all notes before <paramref name="time"/> are scanned. the tracks are sorted by time </summary>
+		inline bool IsScanned(long long time) const {
+			return mbScanComplete || (IsScanned(mData->mPlayBgm, mBgmScan, time) && IsScanned(mData->mPlayNote, mNoteScan, time));
+		}
+
+		static inline bool IsScanned(const PlaybackTrack& track, uint32_t scan, long long time) {
+			return (track.IsComplete() && scan == track.GetReadyCount()) || (scan > 0 && track.GetTime(scan - 1) >= time);
+		}
+
+		/// <summary> the first use of the earliest queued job. the skipped jobs are removed </summary>
+		long long GetFirstJobTime() {
+			while (!mQueue.empty()) {
+				const Job& job = mQueue.top();
+				if (mListState[job.mKey].load(std::memory_order_relaxed) == QUEUED && job.mTime == mListFirstUse[job.mKey]) {
+					return job.mTime;
+				}
+				mQueue.pop();
+			}
+			return LLONG_MAX;
+		}
+	};
+}
\ No newline at end of file
@@ -0,0 +1,103 @@
+#pragma once
+
+#include "Utility.h"
+
+#include <memory>
+#include <mutex>
+#include <unordered_set>
+
+namespace Utility {
+	/// <summary>
+	/// An append-only pool that stores each distinct string once in large chunks.
+	/// Returned views are null-terminated and valid until <see cref="Clear"/> is called or the pool is destroyed.
+	/// <see cref="Intern"/> is thread-safe because it is called by the workers of <see cref="bms::ScanPool"/>.
+	/// </summary>
+	class StringPool {
+	public:
+		StringPool() = default;
+		DISALLOW_COPY_AND_ASSIGN(StringPool)
+
+		/// <summary> return the pooled copy of <paramref name="s"/>. the same string returns the same view </summary>
+		inline std::string_view Intern(std::string_view s) {
+			std::lock_guard<std::mutex> lock(mMutex);
+			return mText.Intern(s);
+		}
+		/// <summary> return the pooled copy of wide string <paramref name="s"/> (file path) </summary>
+		inline std::wstring_view Intern(std::wstring_view s) {
+			std::lock_guard<std::mutex> lock(mMutex);
+			return mWide.Intern(s);
+		}
+
+		/// <summary> release all chunks at once. all views returned before become invalid </summary>
+		void Clear() {
+			std::lock_guard<std::mutex> lock(mMutex);
+			mText.Clear();
+			mWide.Clear();
+		}
+
+		/// <summary> return the allocated bytes of all chunks </summary>
+		inline size_t GetBytes() const {
+			return mText.mBytes + mWide.mBytes;
+		}
+
+	private:
+		template<class CharT>
+		struct Storage {
+			static constexpr size_t CHUNK_LENGTH = 0x10000 / sizeof(CharT);	// 64KB
+
+			std::vector<std::unique_ptr<CharT[]>> mChunks;
+			std::unordered_set<std::basic_string_view<CharT>> mSet;
+			CharT* mCursor = nullptr;
+			size_t mRemain = 0;
+			size_t mBytes = 0;
+
+			std::basic_string_view<CharT> Intern(std::basic_string_view<CharT> s) {
+				static const CharT empty[1] = {};
+				if (s.empty()) {
+					return std::basic_string_view<CharT>(empty, 0);
+				}
+				auto iter = mSet.find(s);
+				if (iter != mSet.end()) {
+					return *iter;
+				}
+
+				size_t length = s.size() + 1;	// include null character
+				CharT* dest;
+				if (length > CHUNK_LENGTH / 4) {
+					// a long string has its own chunk so that the current chunk is not wasted
+					mChunks.emplace_back(std::make_unique<CharT[]>(length));
+					mBytes += length * sizeof(CharT);
+					dest = mChunks.back().get();
+				} else {
+					if (mRemain < length) {
+						mChunks.emplace_back(std::make_unique<CharT[]>(CHUNK_LENGTH));
+						mBytes += CHUNK_LENGTH * sizeof(CharT);
+						mCursor = mChunks.back().get();
+						mRemain = CHUNK_LENGTH;
+					}
+					dest = mCursor;
+					mCursor += length;
+					mRemain -= length;
+				}
+				std::copy(s.begin(), s.end(), dest);
+				dest[s.size()] = CharT();
+
+				std::basic_string_view<CharT> result(dest, s.size());
+				mSet.emplace(result);
+				return result;
+			}
+
+			void Clear() {
+				mChunks.clear();
+				mSet.clear();
+				mCursor = nullptr;
+				mRemain = 0;
+				mBytes = 0;
+			}
+		};
+
+		std::mutex mMutex;
+		Storage<char> mText;
+		Storage<wchar_t> mWide;
+	};
+}
\ No newline at end of file
@@ -1,15 +1,36 @@
 #pragma once
 
 #include <codecvt>
+#include <stdexcept>
 //#include <atlstr.h>
 
+#include "LineScanner.h"		// SCANNER_AVX2, SCANNER_SSE2
+#include "CodePage.h"			// CP932ToUTF8, CP949ToUTF8
+
 // reference : https://jacking75.github.io/cpp_StringEncoding/
 //			   https://doitnow-man.tistory.com/211
 //			   https://codingtidbit.com/2020/02/09/c17-codecvt_utf8-is-deprecated/
 namespace Utility {
-	// For convenience, frequently defined locales are statically registered. Decide whether or not to eliminate it later
-	static std::locale sKorLoc("Korean");
-	static std::locale sJpnLoc("Japanese");
+	/// <summary>
+	/// return the locale of <paramref name="name"/> created at the first call.
+	/// the locale names of Windows ("Korean", "Japanese") don't exist on other systems, so the classic locale is returned in that case.
+	/// caution : the conversion of text is done by <see cref="CP932ToUTF8"/> and <see cref="CP949ToUTF8"/>. it is only for the code that needs a locale
+	/// </summary>
+	inline std::locale MakeLocale(const char* name) {
+		try {
+			return std::locale(name);
+		} catch (const std::runtime_error&) {
+			return std::locale::classic();
+		}
+	}
+	inline const std::locale& GetKorLocale() {
+		static const std::locale loc = MakeLocale("Korean");
+		return loc;
+	}
+	inline const std::locale& GetJpnLocale() {
+		static const std::locale loc = MakeLocale("Japanese");
+		return loc;
+	}
 
 	typedef std::codecvt<wchar_t, char, mbstate_t> cvt_facet;
 	/// <summary>
@@ -30,7 +51,7 @@ namespace Utility {
 	// reference : https://www.codeproject.com/Tips/197097/Converting-ANSI-to-Unicode-and-back-2
 	/// <summary> convert ANSI to Unicode </summary>
 	inline std::wstring AnsiToWide(const std::string& s, const std::locale& loc) {
-		uint16_t bufSize = static_cast<uint16_t>(s.length());
+		size_t bufSize = s.length();
 		if (bufSize == 0) {
 			return std::wstring();
 		}
@@ -38,24 +59,22 @@ namespace Utility {
 		const cvt_facet& facet = std::use_facet<cvt_facet>(loc);
 		mbstate_t state = {0};
 
-		wchar_t* buf = new wchar_t[bufSize];
+		// the result is written to the returned string directly
+		std::wstring ws(bufSize, L'\0');
 		const char* ipc = &s[0];
 		wchar_t* opc = 0;
-		cvt_facet::result result = facet.in(state, ipc, ipc + bufSize, ipc, buf, buf + bufSize, opc);
+		cvt_facet::result result = facet.in(state, ipc, ipc + bufSize, ipc, &ws[0], &ws[0] + bufSize, opc);
 
 		if (result != cvt_facet::ok) {
-			delete[] buf;
 			return std::wstring();
 		}
-
-		std::wstring ws(buf, opc - buf);
-		delete[] buf;
+		ws.resize(opc - &ws[0]);
 
 		return ws;
 	}
 	/// <summary> convert Unicode to ANSI </summary>
 	inline std::string WideToAnsi(const std::wstring& ws, const std::locale& loc) {
-		uint16_t bufSize = static_cast<uint16_t>(ws.length() * 2);
+		size_t bufSize = ws.length() * 2;
 		if (bufSize == 0) {
 			return std::string();
 		}
@@ -63,18 +82,15 @@ namespace Utility {
 		const cvt_facet& facet = std::use_facet<cvt_facet>(loc);
 		mbstate_t state = {0};
 
-		char* buf = new char[bufSize];
+		std::string s(bufSize, '\0');
 		const wchar_t* ipc = &ws[0];
 		char* opc = 0;
-		cvt_facet::result result = facet.out(state, ipc, ipc + ws.length(), ipc, buf, buf + bufSize, opc);
+		cvt_facet::result result = facet.out(state, ipc, ipc + ws.length(), ipc, &s[0], &s[0] + bufSize, opc);
 
 		if (result != cvt_facet::ok) {
-			delete[] buf;
 			return std::string();
 		}
-
-		std::string s(buf, opc - buf);
-		delete[] buf;
+		s.resize(opc - &s[0]);
 
 		return s;
 	}
@@ -88,6 +104,77 @@ namespace Utility {
 		return WideToAnsi(UTF8ToWide(s), loc);
 	}
 
+	// reference : https://en.wikipedia.org/wiki/UTF-16#Code_points_from_U+010000_to_U+10FFFF
+	//			   https://github.com/simdutf/simdutf (ASCII fast path)
+	/// <summary>
+	/// convert UTF-16 bytes in [<paramref name="first"/>, <paramref name="last"/>) to UTF-8 and append it to <paramref name="out"/>.
+	/// runs of ASCII characters are converted 8 code units at a time, surrogate pairs are combined,
+	/// and unpaired surrogates are replaced with U+FFFD. The trailing odd byte is ignored.
+	/// caution : no allocation except the growth of <paramref name="out"/>.
+	/// </summary>
+	inline void UTF16ToUTF8(const char* first, const char* last, bool bBigEndian, std::string& out) {
+		const uint8_t* p = reinterpret_cast<const uint8_t*>(first);
+		const uint8_t* end = p + ((last - first) & ~static_cast<ptrdiff_t>(1));
+		if (p == end) {
+			return;
+		}
+
+		// worst case : 3 bytes per code unit (surrogate pair = 4 bytes per 2 code units)
+		size_t origin = out.size();
+		out.resize(origin + (end - p) / 2 * 3);
+		uint8_t* o = reinterpret_cast<uint8_t*>(&out[origin]);
+
+		while (p < end) {
+#if SCANNER_AVX2 || SCANNER_SSE2
+			// ASCII fast path : 8 code units which are all under 0x80 -> 8 bytes
+			const __m128i nonAscii = _mm_set1_epi16(static_cast<short>(0xFF80));
+			while (end - p >= 16) {
+				__m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+				if (bBigEndian) {	// swap bytes of each code unit
+					block = _mm_or_si128(_mm_slli_epi16(block, 8), _mm_srli_epi16(block, 8));
+				}
+				__m128i test = _mm_cmpeq_epi16(_mm_and_si128(block, nonAscii), _mm_setzero_si128());
+				if (_mm_movemask_epi8(test) != 0xFFFF) {
+					break;
+				}
+				_mm_storel_epi64(reinterpret_cast<__m128i*>(o), _mm_packus_epi16(block, block));
+				p += 16;
+				o += 8;
+			}
+			if (p == end) {
+				break;
+			}
+#endif
+			uint32_t cp = bBigEndian ? (p[0] << 8) | p[1] : p[0] | (p[1] << 8);
+			p += 2;
+			if (cp < 0x80) {
+				*o++ = static_cast<uint8_t>(cp);
+				continue;
+			} else if (cp < 0x800) {
+				*o++ = static_cast<uint8_t>(0xC0 | (cp >> 6));
+				*o++ = static_cast<uint8_t>(0x80 | (cp & 0x3F));
+				continue;
+			} else if (cp >= 0xD800 && cp <= 0xDFFF) {
+				uint32_t low = end - p >= 2 ? (bBigEndian ? (p[0] << 8) | p[1] : p[0] | (p[1] << 8)) : 0;
+				if (cp <= 0xDBFF && low >= 0xDC00 && low <= 0xDFFF) {
+					p += 2;
+					cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+					*o++ = static_cast<uint8_t>(0xF0 | (cp >> 18));
+					*o++ = static_cast<uint8_t>(0x80 | ((cp >> 12) & 0x3F));
+					*o++ = static_cast<uint8_t>(0x80 | ((cp >> 6) & 0x3F));
+					*o++ = static_cast<uint8_t>(0x80 | (cp & 0x3F));
+					continue;
+				}
+				cp = 0xFFFD;	// unpaired surrogate -> replacement character
+			}
+			*o++ = static_cast<uint8_t>(0xE0 | (cp >> 12));
+			*o++ = static_cast<uint8_t>(0x80 | ((cp >> 6) & 0x3F));
+			*o++ = static_cast<uint8_t>(0x80 | (cp & 0x3F));
+		}
+
+		out.resize(reinterpret_cast<char*>(o) - &out[0]);
+	}
+
 	// reference : https://stackoverflow.com/questions/28270310/how-to-easily-detect-utf8-encoding-in-the-string
 	/// <summary> check if it is UTF-8 string </summary>
 	inline bool IsValidUTF8(const char* str) {
@@ -2,11 +2,14 @@
 
 #include <vector>
 #include <string>
+#include <string_view>
 #include <sstream>
 #include <iostream>
 #include <ctime>
 #include <fstream>
 #include <chrono>
+#include <cerrno>
+#include <direct.h>		// _wmkdir
 
 #include "Unicode.h"
 
@@ -74,6 +77,10 @@ namespace Utility {
 		}
 		return !(*prefix);
 	}
+	/// <summary> Simple string compare for prefix. used for the string that is not null-terminated </summary>
+	constexpr bool StartsWith(std::string_view str, std::string_view prefix) {
+		return str.size() >= prefix.size() && str.compare(0, prefix.size(), prefix) == 0;
+	}
 
 	// strtoi source code : https://github.com/gcc-mirror/gcc/blob/master/libiberty/strtol.c
 	/// <summary> Simple string parse to integer with no exception </summary>
@@ -154,6 +161,25 @@ namespace Utility {
 		return _CSTD strtof(s, &_Eptr);
 	}
 
+	/// <summary> 
+	/// get the last modification time and the size of <paramref name="path"/> file or folder.
+	/// return false if the path is not valid.
+	/// </summary>
+	inline bool GetFileStat(const wchar_t* path, uint64_t& time, uint64_t& size) {
+		struct _stat64 buffer;
+		if (_wstat64(path, &buffer) != 0) {
+			return false;
+		}
+		time = static_cast<uint64_t>(buffer.st_mtime);
+		size = static_cast<uint64_t>(buffer.st_size);
+		return true;
+	}
+
+	/// <summary> create the folder of <paramref name="path"/>. return true if the folder exists </summary>
+	inline bool MakeDirectory(const wchar_t* path) {
+		return _wmkdir(path) == 0 || errno == EEXIST;
+	}
+
 	/// <summary> Find the greatest common divisor recursively (Euclid's Method) </summary>
 	constexpr int GCD(const int m, const int n) {
 		return n == 0 ? m : GCD(n, m % n);
@@ -164,6 +190,16 @@ namespace Utility {
 		return (m * n) / GCD(m, n);
 	}
 
+	/// <summary> Find the greatest common divisor of 64-bit integers </summary>
+	constexpr int64_t GCD64(const int64_t m, const int64_t n) {
+		return n == 0 ? m : GCD64(n, m % n);
+	}
+	/// <summary> Find the least common multiple of 64-bit integers. return 0 if the result is larger than <paramref name="limit"/> </summary>
+	constexpr int64_t LCM64(const int64_t m, const int64_t n, const int64_t limit) {
+		int64_t q = m / GCD64(m, n);
+		return q > limit / n ? 0 : q * n;
+	}
+
 	// reference : https://stackoverflow.com/questions/1640258/need-a-fast-random-generator-for-c
 	//			   https://en.wikipedia.org/wiki/Xorshift
 	static unsigned long seed = std::chrono::steady_clock::now().time_since_epoch().count();
@@ -182,6 +218,39 @@ namespace Utility {
 		return z;
 	}
 
+	/// <summary>
+	/// <see cref="xorshf96"/> with its own state, so the same seed makes the same sequence.
+	/// 32-bit arithmetic is used, because unsigned long is 32-bit in Windows and 64-bit in other platforms.
+	/// </summary>
+	class Xorshf96 {
+	public:
+		Xorshf96(uint64_t seed = 0) {
+			Seed(seed);
+		}
+
+		inline void Seed(uint64_t seed) {
+			mX = 123456789u ^ static_cast<uint32_t>(seed);
+			mY = 362436069u ^ static_cast<uint32_t>(seed >> 32);
+			mZ = 521288629u;
+		}
+
+		inline uint32_t operator()() {
+			uint32_t t;
+			mX ^= mX << 16;
+			mX ^= mX >> 5;
+			mX ^= mX << 1;
+			t = mX;
+			mX = mY;
+			mY = mZ;
+			mZ = t ^ mX ^ mY;
+
+			return mZ;
+		}
+
+	private:
+		uint32_t mX, mY, mZ;
+	};
+
 	inline bool CompareDoubleSimple(double x, double y, double absTolerance = (1.0e-8)) {
 		return fabs(x - y) <= absTolerance;
 	}
@@ -0,0 +1,171 @@
+#pragma once
+
+#include "LineScanner.h"		// SCANNER_AVX2, SCANNER_SSE2
+#include "MappedFile.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+namespace Utility {
+	/// <summary> the format tags of "fmt " chunk </summary>
+	constexpr uint16_t WAVE_FORMAT_PCM = 1;
+	constexpr uint16_t WAVE_FORMAT_IEEE_FLOAT = 3;
+	constexpr uint16_t WAVE_FORMAT_EXTENSIBLE = 0xFFFE;
+
+	/// <summary> read little endian integer of <paramref name="bytes"/> bytes </summary>
+	inline uint32_t ReadLittleEndian(const uint8_t* p, int bytes) {
+		uint32_t value = 0;
+		for (int i = bytes - 1; i >= 0; --i) {
+			value = (value << 8) | p[i];
+		}
+		return value;
+	}
+
+	/// <summary>
+	/// decode the RIFF WAVE file of <paramref name="path"/> to interleaved stereo float samples of <paramref name="sampleRate"/> in <paramref name="out"/>.
+	/// PCM 8, 16, 24, 32 bits and float 32 bits are supported. mono is copied to both channels, and only the first two channels are used.
+	/// the other sample rate is converted by linear interpolation. return false if it is not a supported wav file (ex. ogg)
+	/// </summary>
+	inline bool ReadWavFile(const wchar_t* path, uint32_t sampleRate, std::vector<float>& out) {
+		MappedFile file;
+		if (!file.Open(path) || file.Size() < 12) {
+			return false;
+		}
+		const uint8_t* data = reinterpret_cast<const uint8_t*>(file.Data());
+		const size_t size = file.Size();
+		if (memcmp(data, "RIFF", 4) != 0 || memcmp(data + 8, "WAVE", 4) != 0) {
+			return false;
+		}
+
+		// find "fmt " and "data" chunks. the chunks are 2 byte aligned
+		uint16_t format = 0, channels = 0, bits = 0;
+		uint32_t rate = 0;
+		const uint8_t* samples = nullptr;
+		size_t sampleBytes = 0;
+		for (size_t offset = 12; offset + 8 <= size;) {
+			const uint8_t* chunk = data + offset;
+			size_t length = ReadLittleEndian(chunk + 4, 4);
+			size_t body = offset + 8;
+			if (memcmp(chunk, "fmt ", 4) == 0 && length >= 16 && body + 16 <= size) {
+				format = static_cast<uint16_t>(ReadLittleEndian(chunk + 8, 2));
+				channels = static_cast<uint16_t>(ReadLittleEndian(chunk + 10, 2));
+				rate = ReadLittleEndian(chunk + 12, 4);
+				bits = static_cast<uint16_t>(ReadLittleEndian(chunk + 22, 2));
+				// the first 2 bytes of the sub format GUID is the format tag
+				if (format == WAVE_FORMAT_EXTENSIBLE && length >= 40 && body + 40 <= size) {
+					format = static_cast<uint16_t>(ReadLittleEndian(chunk + 32, 2));
+				}
+			} else if (memcmp(chunk, "data", 4) == 0) {
+				samples = chunk + 8;
+				sampleBytes = std::min(length, size - body);
+			}
+			offset = body + length + (length & 1);
+		}
+		bool bPcm = format == WAVE_FORMAT_PCM && (bits == 8 || bits == 16 || bits == 24 || bits == 32);
+		bool bFloat = format == WAVE_FORMAT_IEEE_FLOAT && bits == 32;
+		if (samples == nullptr || channels == 0 || rate == 0 || (!bPcm && !bFloat)) {
+			return false;
+		}
+
+		// 1) decode to stereo float of the source rate
+		const int bytes = bits / 8;
+		const size_t blockAlign = static_cast<size_t>(bytes) * channels;
+		const size_t frames = sampleBytes / blockAlign;
+		const size_t right = channels > 1 ? bytes : 0;
+		std::vector<float> source(frames * 2);
+		auto decode = [&](auto read) {
+			const uint8_t* p = samples;
+			for (size_t i = 0; i < frames; ++i, p += blockAlign) {
+				source[i * 2] = read(p);
+				source[i * 2 + 1] = read(p + right);
+			}
+		};
+		if (bFloat) {
+			decode([](const uint8_t* p) { float v; memcpy(&v, p, 4); return v; });
+		} else if (bits == 8) {
+			decode([](const uint8_t* p) { return (static_cast<int>(*p) - 128) / 128.0f; });
+		} else if (bits == 16) {
+			decode([](const uint8_t* p) { int16_t v; memcpy(&v, p, 2); return v / 32768.0f; });
+		} else if (bits == 24) {
+			decode([](const uint8_t* p) { return static_cast<int32_t>(ReadLittleEndian(p, 3) << 8) / 2147483648.0f; });
+		} else {
+			decode([](const uint8_t* p) { int32_t v; memcpy(&v, p, 4); return v / 2147483648.0f; });
+		}
+
+		// 2) convert the sample rate
+		if (rate == sampleRate || frames < 2) {
+			out.swap(source);
+			return true;
+		}
+		const size_t outFrames = static_cast<size_t>((static_cast<unsigned long long>(frames) * sampleRate + rate - 1) / rate);
+		const double step = static_cast<double>(rate) / sampleRate;
+		out.resize(outFrames * 2);
+		for (size_t i = 0; i < outFrames; ++i) {
+			double pos = i * step;
+			size_t index = std::min(static_cast<size_t>(pos), frames - 2);
+			float t = static_cast<float>(pos - index);
+			const float* s = &source[index * 2];
+			out[i * 2] = s[0] + (s[2] - s[0]) * t;
+			out[i * 2 + 1] = s[1] + (s[3] - s[1]) * t;
+		}
+		return true;
+	}
+
+	/// <summary> convert float samples to 16-bit PCM. the samples out of [-1, 1] are clipped </summary>
+	inline void ConvertToPcm16(const float* in, int16_t* out, size_t count) {
+		size_t i = 0;
+#if SCANNER_AVX2 || SCANNER_SSE2
+		// the packing saturates, so no clipping is required
+		const __m128 scale = _mm_set1_ps(32767.0f);
+		for (; i + 8 <= count; i += 8) {
+			__m128i low = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(in + i), scale));
+			__m128i high = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(in + i + 4), scale));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_packs_epi32(low, high));
+		}
+#endif
+		for (; i < count; ++i) {
+			float v = std::min(std::max(in[i] * 32767.0f, -32768.0f), 32767.0f);
+			out[i] = static_cast<int16_t>(std::lrint(v));
+		}
+	}
+
+	/// <summary> write interleaved stereo float samples to 16-bit PCM wav file of <paramref name="path"/> </summary>
+	inline bool WriteWavFile(const wchar_t* path, const float* stereo, size_t frames, uint32_t sampleRate) {
+		std::ofstream os(path, std::ios::binary);
+		if (!os.is_open()) {
+			return false;
+		}
+		const uint32_t dataBytes = static_cast<uint32_t>(frames * 4);
+		auto write = [&os](uint32_t value, int bytes) {
+			char buffer[4];
+			for (int i = 0; i < bytes; ++i) {
+				buffer[i] = static_cast<char>((value >> (i * 8)) & 0xFF);
+			}
+			os.write(buffer, bytes);
+		};
+		os.write("RIFF", 4);
+		write(36 + dataBytes, 4);
+		os.write("WAVEfmt ", 8);
+		write(16, 4);
+		write(WAVE_FORMAT_PCM, 2);
+		write(2, 2);						// channels
+		write(sampleRate, 4);
+		write(sampleRate * 4, 4);			// bytes per second
+		write(4, 2);						// block align
+		write(16, 2);						// bits per sample
+		os.write("data", 4);
+		write(dataBytes, 4);
+
+		// convert by blocks, so the whole file is not copied
+		std::vector<int16_t> block(1 << 16);
+		for (size_t i = 0; i < frames * 2; i += block.size()) {
+			size_t count = std::min(block.size(), frames * 2 - i);
+			ConvertToPcm16(stereo + i, block.data(), count);
+			os.write(reinterpret_cast<const char*>(block.data()), count * sizeof(int16_t));
+		}
+		return static_cast<bool>(os);
+	}
+}
\ No newline at end of file
@@ -1,10 +1,17 @@
 ﻿#include "pch.h"
 #include "BMSAdapter.h"
+#include "BMSBenchmark.h"
 
 #include <conio.h>
 #include <thread>
 
+// if it is 1, run benchmarks with the bms files in ROOT_PATH instead of the player
+#define RUN_BENCHMARK 0
+
 int main() {
+#if RUN_BENCHMARK
+	return bms::benchmark::RunAll(bms::ROOT_PATH) ? 0 : 1;
+#endif
 	//std::ios::sync_with_stdio(false);
 	bool bLoading = false;
 	int folderIndex = 0;
@@ -13,7 +20,16 @@ int main() {
 	bms::BMSAdapter adapter;
 
 	uint16_t folderMax = adapter.GetFolderList().size();
-	const std::vector<bms::BMSNode>* musicList = &adapter.GetMusicList(folderIndex);
+	bms::MusicListView musicList = adapter.GetMusicList(folderIndex);
+
+	// play the pattern if it exists. the folder can have no music
+	auto play = [&](size_t music, size_t pattern) {
+		if (music >= musicList.size() || pattern >= musicList[music].mListData.size()) {
+			std::cout << "no music" << std::endl;
+			return;
+		}
+		adapter.Play(musicList.GetPattern(music, pattern));
+	};
 
 	auto folderChange = [&](short operand) {
 		int oldIndex = folderIndex;
@@ -25,12 +41,12 @@ int main() {
 			adapter.TerminateMusic();
 			bLoading = true;
 			std::cout << "folder loading..." << std::endl;
-			musicList = &adapter.GetMusicList(folderIndex);
+			musicList = adapter.GetMusicList(folderIndex);
 			bLoading = false;
 
 			musicIndex = 0;
 			patternIndex = 0;
-			adapter.Play((*musicList)[0].mListData[0]);
+			play(0, 0);
 		}
 	};
 
@@ -38,31 +54,35 @@ int main() {
 		int oldIndex = musicIndex;
 
 		musicIndex += operand;
-		if (musicIndex < 0) musicIndex = (*musicList).size() - 1;
-		else if (musicIndex >= (*musicList).size()) musicIndex = 0;
+		if (musicIndex < 0) musicIndex = musicList.size() - 1;
+		else if (musicIndex >= musicList.size()) musicIndex = 0;
 
 		if (oldIndex != musicIndex) {
 			adapter.TerminateMusic();
 			patternIndex = 0;
-			adapter.Play((*musicList)[musicIndex].mListData[0]);
+			play(musicIndex, 0);
 		}
 	};
 
 	auto patternChange = [&](short operand) {
 		short oldIndex = patternIndex;
-		const auto& list = (*musicList)[musicIndex].mListData;
+		if (musicIndex >= musicList.size()) {
+			std::cout << "no music" << std::endl;
+			return;
+		}
+		size_t patternCount = musicList[musicIndex].mListData.size();
 
 		patternIndex += operand;
-		if (patternIndex < 0) patternIndex = list.size() - 1;
-		else if (patternIndex >= list.size()) patternIndex = 0;
+		if (patternIndex < 0) patternIndex = patternCount - 1;
+		else if (patternIndex >= patternCount) patternIndex = 0;
 
 		if (oldIndex != patternIndex) {
 			adapter.TerminateMusic();
-			adapter.Play(list[patternIndex]);
+			play(musicIndex, patternIndex);
 		}
 	};
 
-	adapter.Play((*musicList)[0].mListData[0]);
+	play(0, 0);
 
 	// main loop
 	while (true) {